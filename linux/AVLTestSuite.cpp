@@ -1,15 +1,42 @@
 #include "AVLTree.h"
+#include "SplayTree.h"
+#include "WriteAheadLog.h"
+#include "AsyncWriter.h"
+#include "Benchmark.h"
+#include "Baseline.h"
+#include "CacheControl.h"
+#include "StaticAVL.h"
+#include "GenericAVL.h"
+#include "Workload.h"
+#include "MemoryAccount.h"
+#include "Isolation.h"
+#include "PerfCounters.h"
 #include "timer.h"
 
+#include <algorithm>
+#include <charconv>
+#include <atomic>
 #include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <map>
+#include <random>
+#include <set>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include <sys/resource.h>
 #include <unistd.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 using namespace std;
 
@@ -42,9 +69,10 @@ size_t memUsed()
 #endif
 
 // ---------------------------------------------------------------------------
-// DatabaseTestSuite: A test class that contains methods to test both the
-// custom AVL tree and the standard std::map for insertion, deletion,
-// maximum size, load, search speed and (simulated) memory leaks.
+// DatabaseTestSuite: A test class that compares the custom AVL tree with
+// std::map, std::unordered_map and a sorted std::vector for insertion,
+// deletion, maximum size, load, search speed and (simulated) memory leaks,
+// and tests the AVL tree's own features.
 // ---------------------------------------------------------------------------
 class DatabaseTestSuite
 {
@@ -61,386 +89,2856 @@ public:
     }
 
     // -----------------------------------------------------------------------
-    // ===== AVL Tree Tests =====
+    // ===== Engine Comparison Tests =====
     // -----------------------------------------------------------------------
+    // Tests 1-6 have one body each, run over every engine forEachEngine()
+    // hands out (AVL, std::map, std::unordered_map, sorted std::vector), and
+    // print one table per metric with a row per engine.
 
-    // Test 1: Correctness of insertion for AVL tree.
-    void testInsertionAVL()
+    // Helper for Tests 1-6: prints table (first row: the column names) with
+    // every column as wide as its widest cell, each line after prefix.
+    void printComparison(const string &title, const vector<vector<string> > &table, const char *prefix = "[cmp]")
     {
-        cout << "[AVL] Insertion Correctness Test Started...\n";
-        AVL avl;
-        vector<int> vals = {50, 30, 70, 20, 40, 60, 80};
-        for (int v : vals)
-        {
-            avl.insert(createEmployee(v));
-        }
-        node *minNode = avl.findMin(avl.GetRoot());
-        node *maxNode = avl.findMax(avl.GetRoot());
-        assert(minNode && minNode->empl.sin == 20);
-        assert(maxNode && maxNode->empl.sin == 80);
-        cout << "[AVL] Insertion test passed.\n";
-        cout << "[AVL] Insertion Correctness Test Completed.\n\n";
-        // Clean up the tree after test.
-        avl.makeEmpty(avl.GetRoot());
+        vector<size_t> width(table[0].size(), 0);
+        for (size_t r = 0; r < table.size(); r++)
+            for (size_t c = 0; c < table[r].size(); c++)
+                width[c] = max(width[c], table[r][c].size());
+        cout << prefix << " " << title << "\n";
+        for (size_t r = 0; r < table.size(); r++)
+        {
+            cout << prefix << "  ";
+            for (size_t c = 0; c < table[r].size(); c++)
+                cout << (c == 0 ? left : right) << setw(width[c] + (c == 0 ? 0 : 2)) << table[r][c];
+            cout << left << "\n";
+        }
     }
 
-    // Test 2: Correctness of deletion for AVL tree.
-    void testDeletionAVL()
+    // Helper for the comparison tables: value to three significant digits,
+    // or rounded to a whole number from 100 up.
+    static string cell(double value)
     {
-        cout << "[AVL] Deletion Correctness Test Started...\n";
-        AVL avl;
-        vector<int> vals = {50, 30, 70, 20, 40, 60, 80};
-        for (int v : vals)
-        {
-            avl.insert(createEmployee(v));
-        }
-        // Delete nodes and verify deletion.
-        avl.remove(20);
-        assert(avl.Find(avl.GetRoot(), 20) == NULL);
-        avl.remove(30);
-        assert(avl.Find(avl.GetRoot(), 30) == NULL);
-        avl.remove(70);
-        assert(avl.Find(avl.GetRoot(), 70) == NULL);
-        cout << "[AVL] Deletion test passed.\n";
-        cout << "[AVL] Deletion Correctness Test Completed.\n\n";
-        // Clean up the tree after test.
-        avl.makeEmpty(avl.GetRoot());
+        ostringstream out;
+        if (fabs(value) >= 100)
+            out << fixed << setprecision(0) << value;
+        else
+            out << setprecision(3) << value;
+        return out.str();
     }
 
-    // Test 3: Maximum size test for AVL tree.
-    // This test repeatedly builds trees until a bad_alloc is thrown.
-    void testMaxSizeAVL()
+    // Heap and resident set before a comparison test fills an engine. Freed
+    // memory is handed back to the system first, so the resident set only
+    // grows by the pages the engine touches.
+    struct MemoryBaseline
     {
-        cout << "[AVL] Maximum Size Test Started...\n";
-        int stepSize = 100000;
-        int maxSize = 0;
-        int totalInsertions = 0;
-        long maxStorageCapacity = 50; // (500 MB =~0.5 GB) memory capacity
-        long memory_used = memUsed();
-        cout << "[AVL] Current memory usage: " << memory_used << " MB" << endl;
+        long heap;
+        long rss;
+    };
 
-        while (memory_used < maxStorageCapacity)
-        // while (false)
-        {
+    MemoryBaseline memoryBaseline()
+    {
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+        MemoryBaseline base = {heapInUse(), residentBytes()};
+        return base;
+    }
+
+    // Header and rows of the memory table Tests 3-5 print next to their own:
+    // live bytes per record (what the engine's allocations asked for, from
+    // its MemoryAccount), allocator overhead (what malloc used on top of
+    // that, per live byte) and fragmentation (resident bytes gained per heap
+    // byte in use; above 1 means pages held but not used).
+    vector<string> memoryHeader()
+    {
+        return {"engine", "records", "live bytes/record", "allocator overhead", "fragmentation", "RSS gained MB"};
+    }
+
+    template <class Engine>
+    vector<string> memoryRow(Engine &engine, long records, const MemoryBaseline &base)
+    {
+        double live = engine.liveBytes();
+        double heap = heapInUse() - base.heap;
+        double rss = residentBytes() - base.rss;
+        return {engine.name(), to_string(records), cell(live / records), cell(100 * (heap - live) / live) + "%",
+                cell(rss / heap), cell(rss / (1 << 20))};
+    }
+
+    // Test 1: Correctness of insertion: bounds, lookups, ordered scans and
+    // duplicate keys.
+    void testInsertion()
+    {
+        cout << "[cmp] Insertion Correctness Test Started...\n";
+        vector<vector<string> > table = {{"engine", "records", "result"}};
+        forEachEngine([&](auto &engine) {
+            vector<int> vals = {50, 30, 70, 20, 40, 60, 80};
+            for (int v : vals)
+                engine.insert(createEmployee(v));
+            EmployeeInfo duplicate = createEmployee(50);
+            duplicate.age = 99;
+            engine.insert(duplicate); // the first record with a sin is kept
+            int lo, hi;
+            assert(engine.bounds(lo, hi) && lo == 20 && hi == 80);
+            for (int v : vals)
+                assert(engine.read(v));
+            assert(!engine.read(55) && !engine.read(10) && !engine.read(90));
+            assert(engine.scan(INT_MIN, 100) == 7 && engine.scan(45, 100) == 4 && engine.scan(81, 100) == 0);
+            engine.clear();
+            assert(!engine.bounds(lo, hi) && !engine.read(50));
+            table.push_back({engine.name(), "7", "passed"});
+        });
+        printComparison("Insertion", table);
+        cout << "[cmp] Insertion Correctness Test Completed.\n\n";
+    }
+
+    // Test 2: Correctness of deletion, including the bounds and keys that
+    // are not there.
+    void testDeletion()
+    {
+        cout << "[cmp] Deletion Correctness Test Started...\n";
+        vector<vector<string> > table = {{"engine", "removed", "result"}};
+        forEachEngine([&](auto &engine) {
+            vector<int> vals = {50, 30, 70, 20, 40, 60, 80};
+            for (int v : vals)
+                engine.insert(createEmployee(v));
+            engine.remove(20);
+            assert(!engine.read(20));
+            engine.remove(30);
+            assert(!engine.read(30));
+            engine.remove(70);
+            assert(!engine.read(70));
+            engine.remove(55); // not there
+            int lo, hi;
+            assert(engine.bounds(lo, hi) && lo == 40 && hi == 80);
+            assert(engine.read(50) && engine.read(80) && engine.scan(INT_MIN, 100) == 4);
+            engine.remove(40);
+            engine.remove(50);
+            engine.remove(60);
+            engine.remove(80);
+            assert(!engine.bounds(lo, hi) && engine.scan(INT_MIN, 100) == 0);
+            table.push_back({engine.name(), "7", "passed"});
+        });
+        printComparison("Deletion", table);
+        cout << "[cmp] Deletion Correctness Test Completed.\n\n";
+    }
+
+    // Test 3: How many records fit in budgetMB of heap, and the bytes each
+    // one costs. Sequential sins, so every engine gets the same records.
+    void testMaxSize(long budgetMB)
+    {
+        cout << "[cmp] Maximum Size Test (" << budgetMB << " MB heap) Started...\n";
+        vector<vector<string> > table = {{"engine", "records", "seconds"}}, memory = {memoryHeader()};
+        forEachEngine([&](auto &engine) {
+            const int stepSize = 10000;
+            long budget = budgetMB << 20;
+            MemoryBaseline base = memoryBaseline();
+            long heapBefore = base.heap;
+            int records = 0;
+            Timer timer;
+            timer.start();
             try
             {
-                AVL avl;
-                // Insert 'stepSize' new elements
-                for (int i = 0; i < totalInsertions + stepSize; i++)
+                while (heapInUse() - heapBefore < budget)
+                    for (int i = 0; i < stepSize; i++, records++)
+                        engine.insert(createEmployee(records));
+            }
+            catch (const std::bad_alloc &e)
+            {
+                cerr << "[cmp] " << engine.name() << ": caught bad_alloc: " << e.what() << '\n';
+            }
+            timer.stop();
+            int lo, hi;
+            assert(engine.bounds(lo, hi) && lo == 0 && hi == records - 1);
+            memory.push_back(memoryRow(engine, records, base));
+            engine.clear();
+            table.push_back({engine.name(), to_string(records), cell(timer.currtime())});
+        });
+        printComparison("Maximum size", table);
+        printComparison("Maximum size: memory", memory);
+        cout << "[cmp] Maximum Size Test Completed.\n\n";
+    }
+
+    // Test 4: Load test: repeated insertion with a random lookup every 1000
+    // records.
+    void testLoad(int iterations)
+    {
+        cout << "[cmp] Load Test (" << iterations << " iterations) Started...\n";
+        vector<vector<string> > table = {{"engine", "operations", "seconds", "ops/s"}}, memory = {memoryHeader()};
+        forEachEngine([&](auto &engine) {
+            MemoryBaseline base = memoryBaseline();
+            srand(4);
+            long operations = 0, found = 0;
+            Timer timer;
+            timer.start();
+            for (int i = 0; i < iterations; i++, operations++)
+            {
+                engine.insert(createEmployee(i));
+                if (i % 1000 == 0)
                 {
-                    EmployeeInfo empl;
-                    empl.age = 0;
-                    empl.salary = 0;
-                    empl.emplNumber = 0;
-                    empl.sin = rand();
-                    avl.insert(empl);
-                    maxSize = max(maxSize, i);
+                    found += engine.read(rand() % (i + 1));
+                    operations++;
                 }
-                totalInsertions += stepSize;
-                // Clean up the tree to free memory
-                avl.makeEmpty(avl.GetRoot());
             }
-            catch (const std::bad_alloc &e)
+            timer.stop();
+            assert(found == (iterations + 999) / 1000);
+            memory.push_back(memoryRow(engine, iterations, base));
+            engine.clear();
+            table.push_back({engine.name(), to_string(operations), cell(timer.currtime()), cell(operations / timer.currtime())});
+        });
+        printComparison("Load", table);
+        printComparison("Load: memory", memory);
+        cout << "[cmp] Load Test Completed.\n\n";
+    }
+
+    // Test 5: Search speed for the smallest and the largest key, once each
+    // and then alternating 100000 times.
+    void testSearchSpeed(int numElements)
+    {
+        cout << "[cmp] Search Speed Test with " << numElements << " elements Started...\n";
+        vector<vector<string> > table = {{"engine", "first min ns", "first max ns", "p50 ns", "p99 ns", "p99.9 ns", "max ns"}},
+                                memory = {memoryHeader()};
+        forEachEngine([&](auto &engine) {
+            MemoryBaseline base = memoryBaseline();
+            for (int i = 0; i < numElements; i++)
+                engine.insert(createEmployee(i));
+            Timer timer;
+            timer.start();
+            bool result = engine.read(0);
+            timer.stop();
+            assert(result);
+            double minNs = timer.elapsedNs();
+            timer.reset();
+            timer.start();
+            result = engine.read(numElements - 1);
+            timer.stop();
+            assert(result);
+            double maxNs = timer.elapsedNs();
+            // A single search is close to the clock's resolution, so repeat both
+            static LatencyHistogram lat;
+            lat.reset();
+            for (int i = 0; i < 100000; i++)
             {
-                cerr << "[AVL] Caught bad_alloc: " << e.what() << '\n';
-                cerr << "[AVL] Maximum size reached!" << endl;
-                break;
+                uint64_t start = Timer::ticks();
+                result = engine.read(i % 2 ? numElements - 1 : 0);
+                lat.record(Timer::ticksToNs(Timer::ticks() - start));
+                assert(result);
             }
-            catch (const std::exception &e)
+            memory.push_back(memoryRow(engine, numElements, base));
+            engine.clear();
+            table.push_back({engine.name(), cell(minNs), cell(maxNs), cell(lat.percentile(0.5)), cell(lat.percentile(0.99)),
+                             cell(lat.percentile(0.999)), cell(lat.max())});
+        });
+        printComparison("Search speed", table);
+        printComparison("Search speed: memory", memory);
+        cout << "[cmp] Search Speed Test Completed.\n\n";
+    }
+
+    // Test 6: Memory leak check: iterations cycles of inserting 1000
+    // records (duplicates among them), removing about half and clearing the
+    // rest. After every clear the engine's live bytes must be back at the
+    // baseline; the heap held after the last one is reported.
+    void testMemoryLeak(int iterations)
+    {
+        cout << "[cmp] Memory Leak Test (" << iterations << " iterations) Started...\n";
+        vector<vector<string> > table = {{"engine", "cycles", "peak live bytes", "live bytes after clear", "heap bytes after clear"}};
+        forEachEngine([&](auto &engine) {
+            // One cycle first: the allocator keeps some bookkeeping of its own
+            // the first time it hands out a block size
+            for (int j = 0; j < 1000; j++)
+                engine.insert(createEmployee(j));
+            engine.clear();
+            long liveBefore = engine.liveBytes();
+            long heapBefore = heapInUse();
+            long peak = 0;
+            Xoshiro256 rng(6);
+            for (int i = 0; i < iterations; i++)
             {
-                cerr << "[AVL] Exception: " << e.what() << '\n';
+                for (int j = 0; j < 1000; j++)
+                    engine.insert(createEmployee((int)rng.below(2000)));
+                for (int j = 0; j < 1000; j++)
+                    engine.remove((int)rng.below(2000));
+                peak = max(peak, engine.liveBytes() - liveBefore);
+                engine.clear();
+                assert(engine.liveBytes() == liveBefore);
             }
-            memory_used = memUsed();
-            cout << "[AVL] Current memory usage: " << memory_used << " MB" << endl;
+            table.push_back({engine.name(), to_string(iterations), to_string(peak),
+                             to_string(engine.liveBytes() - liveBefore), to_string(heapInUse() - heapBefore)});
+        });
+        printComparison("Memory after clear", table);
+
+        // Each tree engine counts its own nodes only, whatever other trees
+        // allocate meanwhile
+        TreeEngine<AVL> first("avl");
+        TreeEngine<SplayTree> second("splay");
+        AVL bystander;
+        for (int j = 0; j < 1000; j++)
+        {
+            first.insert(createEmployee(j));
+            second.insert(createEmployee(j));
+            bystander.insert(createEmployee(j));
         }
-        cout << "testMaxSizeAVL: Max size AVL: " << maxSize << "\n\n";
-        cout << "[AVL] Maximum Size Test Completed.\n";
+        assert(first.liveBytes() == 1000 * (long)sizeof(node) && second.liveBytes() == 1000 * (long)sizeof(node));
+        first.clear();
+        assert(first.liveBytes() == 0 && second.liveBytes() == 1000 * (long)sizeof(node));
+        cout << "[cmp] Memory leak test passed.\n";
+        cout << "[cmp] Memory Leak Test Completed.\n\n";
     }
 
-    // Test 4: Load test for AVL tree: repeated insertion and random access.
-    void testLoadAVL(int iterations)
+    // -----------------------------------------------------------------------
+    // ===== AVL Tree Tests =====
+    // -----------------------------------------------------------------------
+
+    // Test 7: Correctness of the optional write buffer.
+    // Random inserts/removes are checked against std::map while writes are
+    // still buffered and again after they have been merged into the tree.
+    void testWriteBufferAVL()
     {
-        cout << "[AVL] Load Test (" << iterations << " iterations) Started...\n";
+        cout << "[AVL] Write Buffer Correctness Test Started...\n";
         AVL avl;
-        for (int i = 0; i < iterations; i++)
+        avl.enableWriteBuffer(256);
+        map<int, EmployeeInfo> model;
+        srand(26);
+        for (int i = 0; i < 20000; i++)
         {
-            avl.insert(createEmployee(i));
-            if (i % 1000 == 0)
+            int sin = rand() % 2000;
+            if (rand() % 3 == 0)
+            {
+                avl.remove(sin);
+                model.erase(sin);
+            }
+            else
             {
-                int target = rand() % (i + 1);
-                avl.Find(avl.GetRoot(), target);
+                EmployeeInfo e = createEmployee(sin);
+                e.salary = i; // distinguishes a re-insert from the original record
+                avl.insert(e);
+                model.insert(make_pair(sin, e));
             }
+            int probe = rand() % 2000;
+            node *found = avl.Find(avl.GetRoot(), probe);
+            map<int, EmployeeInfo>::iterator it = model.find(probe);
+            assert((found == NULL) == (it == model.end()));
+            assert(found == NULL || found->empl.salary == it->second.salary);
+        }
+        assert(avl.bufferedCount() > 0);
+        avl.flushWriteBuffer();
+        assert(avl.bufferedCount() == 0);
+        for (int sin = 0; sin < 2000; sin++)
+        {
+            node *found = avl.Find(avl.GetRoot(), sin);
+            map<int, EmployeeInfo>::iterator it = model.find(sin);
+            assert((found == NULL) == (it == model.end()));
+            assert(found == NULL || found->empl.salary == it->second.salary);
         }
-        cout << "[AVL] Load test completed.\n";
-        cout << "[AVL] Load Test Completed.\n\n";
-        // Clean up after test.
+        assert(avl.findMin(avl.GetRoot())->empl.sin == model.begin()->first);
+        assert(avl.findMax(avl.GetRoot())->empl.sin == model.rbegin()->first);
         avl.makeEmpty(avl.GetRoot());
+        // Emptying the tree drops writes still in the buffer, both while the
+        // tree has no nodes yet and once it has
+        for (int round = 0; round < 2; round++)
+        {
+            for (int sin = 0; sin < 100; sin++)
+                avl.insert(createEmployee(sin));
+            if (round == 1)
+                avl.flushWriteBuffer();
+            for (int sin = 50; sin < 150; sin++)
+                avl.insert(createEmployee(sin));
+            avl.remove(7);
+            assert(avl.bufferedCount() > 0);
+            avl.makeEmpty(avl.GetRoot());
+            assert(avl.bufferedCount() == 0 && avl.GetRoot() == NULL);
+            assert(avl.Find(avl.GetRoot(), 5) == NULL && avl.Find(avl.GetRoot(), 120) == NULL);
+            avl.flushWriteBuffer();
+            assert(avl.GetRoot() == NULL);
+        }
+        cout << "[AVL] Write buffer test passed.\n";
+        cout << "[AVL] Write Buffer Correctness Test Completed.\n\n";
+    }
+
+    // Test 8: Ingest throughput and read latency with the write buffer
+    // disabled and enabled. Reads run while the buffer still holds writes.
+    void testWriteBufferSpeedAVL(int numElements)
+    {
+        cout << "[AVL] Write Buffer Speed Test with " << numElements << " elements Started...\n";
+        vector<int> keys(numElements);
+        srand(26);
+        for (int i = 0; i < numElements; i++)
+            keys[i] = rand();
+        int lookups = 100000;
+        for (int buffered = 0; buffered < 2; buffered++)
+        {
+            const char *mode = buffered ? "enabled " : "disabled";
+            AVL avl;
+            if (buffered)
+                avl.enableWriteBuffer();
+            Timer timer;
+            timer.start();
+            for (int i = 0; i < numElements; i++)
+                avl.insert(createEmployee(keys[i]));
+            timer.stop();
+            double ingest = timer.currtime();
+            timer.reset();
+            timer.start();
+            int hits = 0;
+            for (int i = 0; i < lookups; i++)
+                hits += avl.Find(avl.GetRoot(), keys[(i * 7919) % numElements]) != NULL;
+            timer.stop();
+            double reads = timer.currtime();
+            assert(hits == lookups);
+            cout << "[AVL] Buffer " << mode << ": ingest " << numElements / ingest << " inserts/sec, "
+                 << "read latency " << reads / lookups * 1e9 << " ns/Find ("
+                 << avl.bufferedCount() << " writes pending)\n";
+            avl.flushWriteBuffer();
+            avl.makeEmpty(avl.GetRoot());
+        }
+        cout << "[AVL] Write Buffer Speed Test Completed.\n\n";
+    }
+
+    // Helper: verify the strict AVL invariant below t and return its height.
+    int checkAVLHeights(node *t)
+    {
+        if (t == NULL)
+            return -1;
+        int l = checkAVLHeights(t->left);
+        int r = checkAVLHeights(t->right);
+        assert(l - r <= 1 && r - l <= 1);
+        assert(t->height == max(l, r) + 1);
+        return t->height;
+    }
+
+    // Helper: verify the weak AVL rank rule below t and return its rank.
+    int checkWAVLRanks(node *t)
+    {
+        if (t == NULL)
+            return -1;
+        int l = checkWAVLRanks(t->left);
+        int r = checkWAVLRanks(t->right);
+        assert(t->height - l >= 1 && t->height - l <= 2);
+        assert(t->height - r >= 1 && t->height - r <= 2);
+        assert(t->left || t->right || t->height == 0);
+        return t->height;
     }
 
-    // Test 5: Speed test for AVL tree search.
-    void testSearchSpeedAVL(int numElements)
+    // Test 9: Correctness of both balance policies under insert/remove churn.
+    void testBalancePolicies()
     {
-        cout << "[AVL] Search Speed Test with " << numElements << " elements Started...\n";
+        cout << "[AVL/WAVL] Balance Policy Correctness Test Started...\n";
         AVL avl;
+        WAVL wavl;
+        map<int, EmployeeInfo> model;
+        srand(27);
+        for (int i = 0; i < 50000; i++)
+        {
+            int sin = rand() % 3000;
+            if (rand() % 2)
+            {
+                avl.insert(createEmployee(sin));
+                wavl.insert(createEmployee(sin));
+                model.insert(make_pair(sin, createEmployee(sin)));
+            }
+            else
+            {
+                avl.remove(sin);
+                wavl.remove(sin);
+                model.erase(sin);
+            }
+            if (i % 100 == 0)
+            {
+                checkAVLHeights(avl.GetRoot());
+                checkWAVLRanks(wavl.GetRoot());
+            }
+        }
+        for (int sin = 0; sin < 3000; sin++)
+        {
+            bool present = model.count(sin) > 0;
+            assert((avl.Find(avl.GetRoot(), sin) != NULL) == present);
+            assert((wavl.Find(wavl.GetRoot(), sin) != NULL) == present);
+        }
+        // Without removals a weak AVL tree is an AVL tree
+        WAVL insertOnly;
+        for (int i = 0; i < 10000; i++)
+            insertOnly.insert(createEmployee(rand()));
+        checkAVLHeights(insertOnly.GetRoot());
+        cout << "[AVL/WAVL] Balance policy test passed.\n";
+        cout << "[AVL/WAVL] Balance Policy Correctness Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+        wavl.makeEmpty(wavl.GetRoot());
+        insertOnly.makeEmpty(insertOnly.GetRoot());
+    }
+
+    // Helper for Test 10: build a tree, then churn it with remove/insert pairs
+    // and finally drain it, reporting rotations and time per operation.
+    template <class Tree>
+    void churnTree(const char *name, int numElements, int churnOps)
+    {
+        Tree tree;
+        vector<int> keys(numElements);
+        srand(27);
         for (int i = 0; i < numElements; i++)
         {
-            avl.insert(createEmployee(i));
+            keys[i] = rand();
+            tree.insert(createEmployee(keys[i]));
         }
+        unsigned long insertRotations = 0, removeRotations = 0;
+        double insertTime = 0, removeTime = 0;
         Timer timer;
-        // Worst-case: search for the minimum value.
+        for (int i = 0; i < churnOps; i++)
+        {
+            int slot = rand() % numElements;
+            tree.resetRotationCount();
+            timer.reset();
+            timer.start();
+            tree.remove(keys[slot]);
+            timer.stop();
+            removeTime += timer.currtime();
+            removeRotations += tree.getRotationCount();
+
+            keys[slot] = rand();
+            tree.resetRotationCount();
+            timer.reset();
+            timer.start();
+            tree.insert(createEmployee(keys[slot]));
+            timer.stop();
+            insertTime += timer.currtime();
+            insertRotations += tree.getRotationCount();
+        }
+        int churnedHeight = tree.GetRoot() ? tree.GetRoot()->height : -1;
+        tree.resetRotationCount();
+        timer.reset();
         timer.start();
-        node *result = avl.Find(avl.GetRoot(), 0);
+        for (int i = 0; i < numElements; i++)
+            tree.remove(keys[i]);
         timer.stop();
-        double elapsed = timer.currtime();
-        cout << "[AVL] Time to search for minimum element (key 0): " << elapsed << " seconds.\n";
-        // Also search for maximum.
-        timer.reset();
+        assert(tree.GetRoot() == NULL);
+        cout << "[" << name << "] churn: " << (double)insertRotations / churnOps << " rotations/insert, "
+             << (double)removeRotations / churnOps << " rotations/remove, "
+             << insertTime / churnOps * 1e9 << " ns/insert, " << removeTime / churnOps * 1e9 << " ns/remove, "
+             << "height/rank after churn " << churnedHeight << "\n";
+        cout << "[" << name << "] drain: " << (double)tree.getRotationCount() / numElements << " rotations/remove, "
+             << timer.currtime() / numElements * 1e9 << " ns/remove\n";
+    }
+
+    // Test 10: Delete-heavy churn benchmark comparing AVL and WAVL rebalancing.
+    void testChurnRotations(int numElements, int churnOps)
+    {
+        cout << "[AVL/WAVL] Churn Rotation Test with " << numElements << " elements Started...\n";
+        churnTree<AVL>("AVL", numElements, churnOps);
+        churnTree<WAVL>("WAVL", numElements, churnOps);
+        cout << "[AVL/WAVL] Churn Rotation Test Completed.\n\n";
+    }
+
+    // Test 11: Correctness of the splay tree engine against std::map.
+    void testSplayTree()
+    {
+        cout << "[splay] Correctness Test Started...\n";
+        SplayTree splay;
+        map<int, EmployeeInfo> model;
+        srand(28);
+        for (int i = 0; i < 50000; i++)
+        {
+            int sin = rand() % 3000;
+            int op = rand() % 3;
+            if (op == 0)
+            {
+                splay.insert(createEmployee(sin));
+                model.insert(make_pair(sin, createEmployee(sin)));
+            }
+            else if (op == 1)
+            {
+                splay.remove(sin);
+                model.erase(sin);
+            }
+            else
+            {
+                node *found = splay.Find(splay.GetRoot(), sin);
+                assert((found != NULL) == (model.count(sin) > 0));
+                assert(found == NULL || splay.GetRoot() == found);
+            }
+        }
+        if (!model.empty())
+        {
+            assert(splay.findMin(splay.GetRoot())->empl.sin == model.begin()->first);
+            assert(splay.findMax(splay.GetRoot())->empl.sin == model.rbegin()->first);
+        }
+        // Sequential inserts degenerate into a path; walks must not recurse
+        SplayTree path;
+        for (int i = 0; i < 1000000; i++)
+            path.insert(createEmployee(i));
+        assert(path.Find(path.GetRoot(), 0) != NULL);
+        path.makeEmpty(path.GetRoot());
+        cout << "[splay] Correctness test passed.\n";
+        cout << "[splay] Correctness Test Completed.\n\n";
+        splay.makeEmpty(splay.GetRoot());
+    }
+
+    // Helper: number of nodes visited by a search for sin starting at t.
+    int pathLength(node *t, int sin)
+    {
+        int visited = 0;
+        while (t != NULL)
+        {
+            visited++;
+            if (sin == t->empl.sin)
+                break;
+            t = sin < t->empl.sin ? t->left : t->right;
+        }
+        return visited;
+    }
+
+    // Helper: count ranks in [0, n) drawn from a Zipfian distribution with
+    // exponent theta (rank 0 is the hottest).
+    vector<int> zipfRanks(int n, int count, double theta)
+    {
+        vector<double> cdf(n);
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+        {
+            sum += 1.0 / pow(i + 1.0, theta);
+            cdf[i] = sum;
+        }
+        vector<int> ranks(count);
+        for (int i = 0; i < count; i++)
+        {
+            double u = (rand() + 0.5) / (RAND_MAX + 1.0) * sum;
+            ranks[i] = (int)(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+        }
+        return ranks;
+    }
+
+    // Helper for Test 12: time the lookups, then replay them once more
+    // measuring the search path of every access.
+    template <class Tree>
+    void skewedLookups(const char *name, const char *dist, Tree &tree, const vector<int> &probes)
+    {
+        Timer timer;
         timer.start();
-        result = avl.Find(avl.GetRoot(), numElements - 1);
+        for (size_t i = 0; i < probes.size(); i++)
+            tree.Find(tree.GetRoot(), probes[i]);
         timer.stop();
-        elapsed = timer.currtime();
-        cout << "[AVL] Time to search for maximum element (key " << numElements - 1 << "): " << elapsed << " seconds.\n";
-        cout << "[AVL] Search Speed Test Completed.\n\n";
-        // Clean up after test.
+        double elapsed = timer.currtime();
+        long long visited = 0;
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            visited += pathLength(tree.GetRoot(), probes[i]);
+            tree.Find(tree.GetRoot(), probes[i]);
+        }
+        cout << "[" << name << "] " << dist << ": " << elapsed / probes.size() * 1e9 << " ns/Find, "
+             << (double)visited / probes.size() << " nodes on average path\n";
+    }
+
+    // Test 12: Search latency and path length of AVL vs splay tree under
+    // uniform and Zipfian key distributions.
+    void testSkewedAccess(int numElements, int lookups)
+    {
+        cout << "[AVL/splay] Skewed Access Test with " << numElements << " elements Started...\n";
+        srand(28);
+        vector<int> keys(numElements);
+        for (int i = 0; i < numElements; i++)
+            keys[i] = i;
+        mt19937 rng(28);
+        shuffle(keys.begin(), keys.end(), rng);
+        AVL avl;
+        SplayTree splay;
+        for (int i = 0; i < numElements; i++)
+        {
+            avl.insert(createEmployee(keys[i]));
+            splay.insert(createEmployee(keys[i]));
+        }
+        vector<int> uniform(lookups);
+        for (int i = 0; i < lookups; i++)
+            uniform[i] = rand() % numElements;
+        // Hot ranks map to a second shuffle of the keys, so hot employees are
+        // neither neighbours nor the first ones inserted (which sit near the root)
+        vector<int> hot = keys;
+        shuffle(hot.begin(), hot.end(), rng);
+        vector<int> zipf = zipfRanks(numElements, lookups, 0.99);
+        for (int i = 0; i < lookups; i++)
+            zipf[i] = hot[zipf[i]];
+        skewedLookups("AVL", "uniform", avl, uniform);
+        skewedLookups("splay", "uniform", splay, uniform);
+        skewedLookups("AVL", "zipfian", avl, zipf);
+        skewedLookups("splay", "zipfian", splay, zipf);
+        cout << "[AVL/splay] Skewed Access Test Completed.\n\n";
         avl.makeEmpty(avl.GetRoot());
+        splay.makeEmpty(splay.GetRoot());
     }
 
-    // Test 6: Memory leak simulation for AVL tree.
-    // (For true memory leak detection, use valgrind or Visual Studio's leak detector.)
-    void testMemoryLeakAVL(int iterations)
+    // Test 13: Correctness of the top-levels mirror. A 4-level mirror makes
+    // most lookups cross from the mirror into the pointer-based tree.
+    void testTopMirrorAVL()
     {
-        cout << "[AVL] Memory Leak Test Simulation (" << iterations << " iterations) Started...\n";
-        for (int i = 0; i < iterations; i++)
+        cout << "[AVL] Top-Levels Mirror Correctness Test Started...\n";
+        for (int levels = 4; levels <= 16; levels += 12)
         {
             AVL avl;
-            for (int j = 0; j < 1000; j++)
+            avl.enableTopMirror(levels);
+            map<int, EmployeeInfo> model;
+            srand(29);
+            for (int i = 0; i < 100000; i++)
             {
-                avl.insert(createEmployee(j));
+                int sin = rand() % 5000;
+                int op = rand() % 3;
+                if (op == 0)
+                {
+                    avl.insert(createEmployee(sin));
+                    model.insert(make_pair(sin, createEmployee(sin)));
+                }
+                else if (op == 1)
+                {
+                    avl.remove(sin);
+                    model.erase(sin);
+                }
+                else
+                {
+                    node *found = avl.Find(avl.GetRoot(), sin);
+                    assert((found != NULL) == (model.count(sin) > 0));
+                    assert(found == NULL || found->empl.sin == sin);
+                }
             }
+            avl.disableTopMirror();
+            for (int sin = 0; sin < 5000; sin++)
+                assert((avl.Find(avl.GetRoot(), sin) != NULL) == (model.count(sin) > 0));
             avl.makeEmpty(avl.GetRoot());
         }
-        cout << "[AVL] Memory Leak Test Simulation Completed.\n\n";
+        cout << "[AVL] Top-levels mirror test passed.\n";
+        cout << "[AVL] Top-Levels Mirror Correctness Test Completed.\n\n";
     }
 
-    // -----------------------------------------------------------------------
-    // ===== std::map Tests =====
-    // -----------------------------------------------------------------------
-
-    // Test 1 (Map): Correctness of insertion.
-    void testInsertionMap()
-    {
-        cout << "[map] Insertion Correctness Test Started...\n";
-        map<int, EmployeeInfo> m;
-        vector<int> vals = {50, 30, 70, 20, 40, 60, 80};
-        for (int v : vals)
-        {
-            m.insert(make_pair(v, createEmployee(v)));
-        }
-        // Check that the smallest key is 20 and the largest is 80.
-        assert(m.begin()->first == 20);
-        auto it = m.end();
-        it--;
-        assert(it->first == 80);
-        cout << "[map] Insertion test passed.\n";
-        cout << "[map] Insertion Correctness Test Completed.\n\n";
-        // Clean up the map.
-        m.clear();
-    }
-
-    // Test 2 (Map): Correctness of deletion.
-    void testDeletionMap()
-    {
-        cout << "[map] Deletion Correctness Test Started...\n";
-        map<int, EmployeeInfo> m;
-        vector<int> vals = {50, 30, 70, 20, 40, 60, 80};
-        for (int v : vals)
-        {
-            m.insert(make_pair(v, createEmployee(v)));
-        }
-        // Remove keys and verify deletion.
-        m.erase(20);
-        assert(m.find(20) == m.end());
-        m.erase(30);
-        assert(m.find(30) == m.end());
-        m.erase(70);
-        assert(m.find(70) == m.end());
-        cout << "[map] Deletion test passed.\n";
-        cout << "[map] Deletion Correctness Test Completed.\n\n";
-        // Clean up the map.
-        m.clear();
-    }
-
-    // Test 3 (Map): Maximum size test.
-    void testMaxSizeMap()
-    {
-        cout << "[map] Maximum Size Test Started...\n";
-        int stepSize = 100000;
-        int maxSize = 0;
-        int totalInsertions = 0;
-        long memory_used = memUsed();
-        long maxStorageCapacity = memory_used + 50; // (500 MB =~0.5 GB) memory capacity
-        cout << "[map] Current memory usage: " << memory_used << " MB" << endl;
-        
-        map<int, EmployeeInfo> m;
-        while (memory_used < maxStorageCapacity)
-        {
-            // cout<<"Max Size: " << maxSize << endl;
-            try
+    // Test 14: Random lookup latency with and without the top-levels mirror,
+    // and the cost of keeping it current under insert/remove churn.
+    void testTopMirrorSpeedAVL(int numElements, int lookups)
+    {
+        cout << "[AVL] Top-Levels Mirror Speed Test with " << numElements << " elements Started...\n";
+        AVL avl;
+        vector<int> keys(numElements);
+        srand(29);
+        for (int i = 0; i < numElements; i++)
+        {
+            keys[i] = rand();
+            avl.insert(createEmployee(keys[i]));
+        }
+        vector<int> probes(lookups);
+        for (int i = 0; i < lookups; i++)
+            probes[i] = keys[rand() % numElements];
+        Timer timer;
+        for (int levels = 0; levels <= 16; levels += 8)
+        {
+            if (levels > 0)
+                avl.enableTopMirror(levels);
+            avl.Find(avl.GetRoot(), probes[0]); // builds the mirror
+            timer.reset();
+            timer.start();
+            for (int i = 0; i < lookups; i++)
+                avl.Find(avl.GetRoot(), probes[i]);
+            timer.stop();
+            double findTime = timer.currtime();
+            // Churn: remove and re-insert a key, then look one up
+            timer.reset();
+            timer.start();
+            for (int i = 0; i < lookups / 10; i++)
             {
-                // Insert exactly 'stepSize' new elements in each iteration.
-                for (int i = 0; i < totalInsertions + stepSize; i++)
-                {
-                    int key = totalInsertions + i;
-                    m.insert(make_pair(key, createEmployee(key)));
-                    maxSize = max(maxSize, i);
-                }
-                totalInsertions += stepSize;
+                avl.remove(probes[i]);
+                avl.insert(createEmployee(probes[i]));
+                avl.Find(avl.GetRoot(), probes[lookups - 1 - i]);
             }
-            catch (const std::bad_alloc &e)
+            timer.stop();
+            cout << "[AVL] Mirror levels " << levels << ": " << findTime / lookups * 1e9 << " ns/Find, "
+                 << timer.currtime() / (lookups / 10) * 1e9 << " ns per remove+insert+Find\n";
+        }
+        cout << "[AVL] Top-Levels Mirror Speed Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+    }
+
+    // Test 15: Correctness of incremental compaction interleaved with
+    // inserts, removes and lookups.
+    void testCompactAVL()
+    {
+        cout << "[AVL] Compaction Correctness Test Started...\n";
+        long nodesBefore = nodeMemory.bytes();
+        AVL avl;
+        avl.enableTopMirror(8);
+        map<int, EmployeeInfo> model;
+        srand(30);
+        int passes = 0;
+        for (int i = 0; i < 200000; i++)
+        {
+            int sin = rand() % 20000;
+            int op = rand() % 4;
+            if (op == 0)
             {
-                cout << "[map] Caught bad_alloc after inserting approximately "
-                     << totalInsertions << " elements into std::map.\n\n";
-                break;
+                avl.insert(createEmployee(sin));
+                model.insert(make_pair(sin, createEmployee(sin)));
             }
-            catch (const std::exception &e)
+            else if (op == 1)
             {
-                cerr << "[map] Exception: " << e.what() << '\n';
+                avl.remove(sin);
+                model.erase(sin);
             }
-            memory_used = memUsed();
-            cout << "[map] Current memory usage: " << memory_used << " MB" << endl;
+            else if (op == 2)
+                assert((avl.Find(avl.GetRoot(), sin) != NULL) == (model.count(sin) > 0));
+            else
+                passes += avl.compact(rand() % 64);
+        }
+        assert(passes > 0);
+        while (!avl.compact(1000))
+            ;
+        checkAVLHeights(avl.GetRoot());
+        // After a full pass neighbouring keys sit in neighbouring slots
+        node *prev = NULL;
+        int adjacent = 0;
+        for (map<int, EmployeeInfo>::iterator it = model.begin(); it != model.end(); ++it)
+        {
+            node *t = avl.Find(avl.GetRoot(), it->first);
+            assert(t != NULL && t->empl.sin == it->first);
+            adjacent += prev != NULL && t == prev + 1;
+            prev = t;
         }
-        m.clear();
-        cout << "[map] Maximum Size Test Completed.\n";
-        cout << "testMaxSizeMap: Max size of std::map is: " << maxSize << "\n\n";
+        assert(adjacent > (int)model.size() * 9 / 10);
+        // Regions are released with their last node
+        avl.makeEmpty(avl.GetRoot());
+        assert(nodeMemory.bytes() == nodesBefore);
+        cout << "[AVL] Compaction test passed.\n";
+        cout << "[AVL] Compaction Correctness Test Completed.\n\n";
     }
 
-    // Test 4 (Map): Load test.
-    void testLoadMap(int iterations)
+    // Helper: in-order scan of the tree; returns the number of nodes visited.
+    long scanTree(node *t, long &checksum)
     {
-        cout << "[map] Load Test (" << iterations << " iterations) Started...\n";
-        map<int, EmployeeInfo> m;
-        for (int i = 0; i < iterations; i++)
+        vector<node *> stack;
+        long visited = 0;
+        while (t != NULL || !stack.empty())
         {
-            m.insert(make_pair(i, createEmployee(i)));
-            if (i % 1000 == 0)
+            while (t != NULL)
             {
-                int target = rand() % (i + 1);
-                m.find(target);
+                stack.push_back(t);
+                t = t->left;
             }
+            t = stack.back();
+            stack.pop_back();
+            checksum += t->empl.salary + t->empl.sin;
+            visited++;
+            t = t->right;
         }
-        cout << "[map] Load test completed.\n";
-        cout << "[map] Load Test Completed.\n\n";
-        m.clear();
+        return visited;
     }
 
-    // Test 5 (Map): Search speed test.
-    void testSearchSpeedMap(int numElements)
+    // Test 16: Scan throughput of a churned tree before and after online
+    // compaction, and the cost of the incremental compaction steps.
+    void testCompactScanAVL(int numElements, int churnOps)
     {
-        cout << "[map] Search Speed Test with " << numElements << " elements Started...\n";
-        map<int, EmployeeInfo> m;
+        cout << "[AVL] Churn-Then-Scan Compaction Test with " << numElements << " elements Started...\n";
+        AVL avl;
+        vector<int> keys(numElements);
+        srand(30);
         for (int i = 0; i < numElements; i++)
         {
-            m.insert(make_pair(i, createEmployee(i)));
+            keys[i] = rand();
+            avl.insert(createEmployee(keys[i]));
+        }
+        for (int i = 0; i < churnOps; i++)
+        {
+            int slot = rand() % numElements;
+            avl.remove(keys[slot]);
+            keys[slot] = rand();
+            avl.insert(createEmployee(keys[slot]));
         }
         Timer timer;
+        long checksum = 0, visited = 0;
         timer.start();
-        auto it = m.find(0);
+        for (int rep = 0; rep < 5; rep++)
+            visited += scanTree(avl.GetRoot(), checksum);
         timer.stop();
-        double elapsed = timer.currtime();
-        cout << "[map] Time to search for minimum element (key 0): " << elapsed << " seconds.\n";
+        cout << "[AVL] Scan before compaction: " << visited / timer.currtime() << " nodes/sec\n";
+
+        const size_t budget = 4096;
+        int steps = 0;
+        double worstStep = 0, compactTime = 0;
+        bool done = false;
+        while (!done)
+        {
+            timer.reset();
+            timer.start();
+            done = avl.compact(budget);
+            timer.stop();
+            worstStep = max(worstStep, timer.currtime());
+            compactTime += timer.currtime();
+            steps++;
+        }
+        cout << "[AVL] Compaction: " << steps << " steps of " << budget << " nodes, worst step "
+             << worstStep * 1e6 << " us, full pass " << compactTime << " seconds\n";
+
+        long checksumAfter = 0;
+        visited = 0;
         timer.reset();
         timer.start();
-        it = m.find(numElements - 1);
+        for (int rep = 0; rep < 5; rep++)
+            visited += scanTree(avl.GetRoot(), checksumAfter);
         timer.stop();
-        elapsed = timer.currtime();
-        cout << "[map] Time to search for maximum element (key " << numElements - 1 << "): " << elapsed << " seconds.\n";
-        cout << "[map] Search Speed Test Completed.\n\n";
-        m.clear();
+        assert(checksum == checksumAfter);
+        cout << "[AVL] Scan after compaction: " << visited / timer.currtime() << " nodes/sec\n";
+        cout << "[AVL] Churn-Then-Scan Compaction Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
     }
 
-    // Test 6 (Map): Memory leak simulation.
-    void testMemoryLeakMap(int iterations)
+    // -----------------------------------------------------------------------
+    // Test 17: Small trees against std::map, growing past the threshold
+    // and shrinking back below it.
+    void testSmallModeAVL()
     {
-        cout << "[map] Memory Leak Test Simulation (" << iterations << " iterations) Started...\n";
-        for (int i = 0; i < iterations; i++)
+        cout << "[AVL] Small Mode Correctness Test Started...\n";
+        AVL avl;
+        avl.enableSmallMode(32);
+        map<int, EmployeeInfo> model;
+        srand(31);
+        int smallFinds = 0;
+        for (int i = 0; i < 100000; i++)
         {
-            map<int, EmployeeInfo> m;
-            for (int j = 0; j < 1000; j++)
+            int sin = rand() % 100;
+            int op = rand() % 3;
+            if (op == 0)
+            {
+                avl.insert(createEmployee(sin));
+                model.insert(make_pair(sin, createEmployee(sin)));
+            }
+            else if (op == 1)
+            {
+                avl.remove(sin);
+                model.erase(sin);
+            }
+            else
             {
-                m.insert(make_pair(j, createEmployee(j)));
+                node *t = avl.Find(avl.GetRoot(), sin);
+                assert((t != NULL) == (model.count(sin) > 0));
+                if (t != NULL)
+                    assert(t->empl.sin == sin && t->empl.age == model[sin].age);
+                smallFinds += avl.GetRoot() == NULL;
             }
-            m.clear();
+            if (avl.GetRoot() != NULL)
+                assert(model.size() > 16);
+            else
+                assert(model.size() <= 32);
         }
-        cout << "[map] Memory Leak Test Simulation Completed.\n\n";
+        assert(smallFinds > 0);
+        for (map<int, EmployeeInfo>::iterator it = model.begin(); it != model.end(); ++it)
+            assert(avl.Find(avl.GetRoot(), it->first) != NULL);
+        avl.disableSmallMode();
+        checkAVLHeights(avl.GetRoot());
+        cout << "[AVL] Small mode test passed.\n";
+        cout << "[AVL] Small Mode Correctness Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
     }
-};
-
-// ---------------------------------------------------------------------------
-// Main Function: Run all tests with pauses between groups.
-// ---------------------------------------------------------------------------
-int main()
-{
-    DatabaseTestSuite suite;
-
-    cout << "=============================================\n";
-    cout << "Starting Database Performance Tests\n";
-    cout << "=============================================\n\n";
 
-    // ----- AVL Tree Tests -----
-    cout << "==== Running AVL Tree Tests ====\n\n";
-    suite.testInsertionAVL();
-    cout << "Press Enter to continue...\n";
-    getchar();
+    // Bytes currently handed out by malloc, where the C library can tell us;
+    // blocks big enough to get their own mapping included.
+    long heapInUse()
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        struct mallinfo2 info = mallinfo2();
+        return (long)(info.uordblks + info.hblkhd);
+#else
+        return residentBytes();
+#endif
+    }
 
-    suite.testDeletionAVL();
-    cout << "Press Enter to continue...\n";
-    getchar();
+    // Test 18: Memory and lookup speed of many tiny trees, one node per
+    // record versus one sorted array per tree.
+    void testSmallModeSpeedAVL(int numTrees, int lookups)
+    {
+        cout << "[AVL] Tiny Trees Test with " << numTrees << " trees Started...\n";
+        const int sizes[] = {8, 32, 60};
+        for (int s = 0; s < 3; s++)
+        {
+            for (int mode = 0; mode < 2; mode++)
+            {
+                long before = heapInUse();
+                vector<AVL> trees(numTrees);
+                for (int i = 0; i < numTrees; i++)
+                {
+                    if (mode == 1)
+                        trees[i].enableSmallMode(64);
+                    for (int k = 0; k < sizes[s]; k++)
+                        trees[i].insert(createEmployee(k * 2));
+                }
+                long bytes = heapInUse() - before;
+                srand(31);
+                long found = 0;
+                Timer timer;
+                timer.start();
+                for (int i = 0; i < lookups; i++)
+                {
+                    AVL &avl = trees[rand() % numTrees];
+                    found += avl.Find(avl.GetRoot(), rand() % (sizes[s] * 2)) != NULL;
+                }
+                timer.stop();
+                assert(found > 0);
+                cout << "[AVL] " << sizes[s] << " records per tree, " << (mode == 1 ? "small mode" : "nodes     ")
+                     << ": " << (double)bytes / ((double)numTrees * sizes[s]) << " bytes/record, "
+                     << timer.currtime() * 1e9 / lookups << " ns/Find\n";
+                for (int i = 0; i < numTrees; i++)
+                    trees[i].makeEmpty(trees[i].GetRoot());
+            }
+        }
+        cout << "[AVL] Tiny Trees Test Completed.\n\n";
+    }
 
-    suite.testMaxSizeAVL();
-    cout << "Press Enter to continue...\n";
-    getchar();
+    // Helper for Test 19: how many mappings of file the process holds.
+    int mappingsOf(const char *file)
+    {
+        ifstream maps("/proc/self/maps");
+        string line;
+        int n = 0;
+        while (getline(maps, line))
+            n += line.find(file) != string::npos;
+        return n;
+    }
 
-    suite.testLoadAVL(50000); // Adjust iterations as needed.
-    cout << "Press Enter to continue...\n";
-    getchar();
+    // Test 19: Snapshot round trip, read-only serving and checksum checks.
+    void testSnapshotAVL()
+    {
+        cout << "[AVL] Snapshot Correctness Test Started...\n";
+        const char *file = "avl_snapshot.bin";
+        AVL avl;
+        map<int, EmployeeInfo> model;
+        srand(32);
+        for (int i = 0; i < 100000; i++)
+        {
+            int sin = rand() % 200000;
+            avl.insert(createEmployee(sin));
+            model.insert(make_pair(sin, createEmployee(sin)));
+        }
+        assert(avl.saveSnapshot(file));
 
-    suite.testSearchSpeedAVL(100000); // Adjust element count as needed.
-    cout << "Press Enter to continue...\n";
-    getchar();
+        AVL snap;
+        assert(snap.openSnapshot(file, true));
+        assert(snap.GetRoot() == NULL);
+        for (int sin = 0; sin < 200000; sin++)
+        {
+            node *t = snap.Find(snap.GetRoot(), sin);
+            assert((t != NULL) == (model.count(sin) > 0));
+            if (t != NULL)
+                assert(t->empl.age == model[sin].age && t->empl.salary == model[sin].salary);
+        }
+        // Read-only while the snapshot is open
+        snap.insert(createEmployee(-1));
+        snap.remove(model.begin()->first);
+        assert(snap.Find(snap.GetRoot(), -1) == NULL);
+        assert(snap.Find(snap.GetRoot(), model.begin()->first) != NULL);
+        assert(!avl.openSnapshot(file));
+        snap.makeEmpty(snap.GetRoot());
+        assert(!snap.snapshotOpen());
 
-    suite.testMemoryLeakAVL(100); // 100 iterations of creation/destruction.
-    cout << "Press Enter to continue...\n";
-    getchar();
+        // A tree destroyed while serving a snapshot unmaps it
+        {
+            AVL served;
+            assert(served.openSnapshot(file) && mappingsOf(file) == 1);
+        }
+        assert(mappingsOf(file) == 0);
 
-    // ----- std::map Tests -----
-    cout << "\n==== Running std::map Tests ====\n\n";
-    suite.testInsertionMap();
-    cout << "Press Enter to continue...\n";
-    getchar();
+        // A flipped bit in a record only shows up when verifying, one in the
+        // header always does
+        vector<char> bytes;
+        {
+            ifstream in(file, ios::binary);
+            bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }
+        bytes[bytes.size() / 2] ^= 1;
+        {
+            ofstream out(file, ios::binary | ios::trunc);
+            out.write(&bytes[0], bytes.size());
+        }
+        assert(snap.openSnapshot(file, false));
+        snap.closeSnapshot();
+        assert(!snap.openSnapshot(file, true));
+        bytes[bytes.size() / 2] ^= 1;
+        bytes[16] ^= 1;
+        {
+            ofstream out(file, ios::binary | ios::trunc);
+            out.write(&bytes[0], bytes.size());
+        }
+        assert(!snap.openSnapshot(file, false));
+        assert(!snap.openSnapshot("missing_snapshot.bin"));
+        remove(file);
+        cout << "[AVL] Snapshot test passed.\n";
+        cout << "[AVL] Snapshot Correctness Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+    }
 
-    suite.testDeletionMap();
-    cout << "Press Enter to continue...\n";
-    getchar();
+    // Test 20: Time to first query, mapping a snapshot versus rebuilding the
+    // tree by re-inserting every record.
+    void testSnapshotOpenSpeedAVL(int numElements, int lookups)
+    {
+        cout << "[AVL] Snapshot Open Test with " << numElements << " elements Started...\n";
+        const char *file = "avl_snapshot.bin";
+        AVL avl;
+        Timer timer;
+        timer.start();
+        for (int i = 0; i < numElements; i++)
+            avl.insert(createEmployee(i));
+        timer.stop();
+        cout << "[AVL] Rebuild by insertion: " << timer.currtime() << " seconds\n";
+        timer.reset();
+        timer.start();
+        assert(avl.saveSnapshot(file));
+        timer.stop();
+        cout << "[AVL] Save snapshot: " << timer.currtime() << " seconds\n";
+        avl.makeEmpty(avl.GetRoot());
 
-    suite.testMaxSizeMap();
-    cout << "Press Enter to continue...\n";
-    getchar();
+        AVL snap;
+        timer.reset();
+        timer.start();
+        assert(snap.openSnapshot(file));
+        node *first = snap.Find(snap.GetRoot(), numElements / 3);
+        timer.stop();
+        assert(first != NULL && first->empl.sin == numElements / 3);
+        cout << "[AVL] Open snapshot and first Find: " << timer.currtime() * 1e3 << " ms\n";
 
-    suite.testLoadMap(50000);
-    cout << "Press Enter to continue...\n";
-    getchar();
+        srand(32);
+        long found = 0;
+        timer.reset();
+        timer.start();
+        for (int i = 0; i < lookups; i++)
+            found += snap.Find(snap.GetRoot(), rand() % numElements) != NULL;
+        timer.stop();
+        assert(found == lookups);
+        cout << "[AVL] Find from the mapped snapshot: " << timer.currtime() * 1e9 / lookups << " ns/Find\n";
+        snap.closeSnapshot();
 
-    suite.testSearchSpeedMap(100000);
-    cout << "Press Enter to continue...\n";
-    getchar();
+        timer.reset();
+        timer.start();
+        assert(snap.openSnapshot(file, true));
+        timer.stop();
+        cout << "[AVL] Open snapshot with full checksum verification: " << timer.currtime() * 1e3 << " ms\n";
+        snap.closeSnapshot();
+        remove(file);
+        cout << "[AVL] Snapshot Open Test Completed.\n\n";
+    }
 
-    suite.testMemoryLeakMap(100);
-    cout << "Press Enter to continue...\n";
-    getchar();
+    // Test 21: Crash recovery from a snapshot plus the write-ahead log,
+    // including a torn entry at the end of the log.
+    void testWriteAheadLogAVL()
+    {
+        cout << "[AVL] Write-Ahead Log Recovery Test Started...\n";
+        const char *logFile = "avl_wal.log";
+        const char *snapFile = "avl_snapshot.bin";
+        remove(logFile);
+        remove(snapFile);
+        map<int, EmployeeInfo> model;
+        srand(33);
+        {
+            WriteAheadLog wal;
+            assert(wal.open(logFile));
+            AVL avl;
+            avl.attachLog(&wal);
+            for (int i = 0; i < 20000; i++)
+            {
+                int sin = rand() % 5000;
+                if (rand() % 3 != 0)
+                {
+                    avl.insert(createEmployee(sin));
+                    model.insert(make_pair(sin, createEmployee(sin)));
+                }
+                else
+                {
+                    avl.remove(sin);
+                    model.erase(sin);
+                }
+                if (i == 12000)
+                    assert(avl.saveSnapshot(snapFile));
+            }
+            assert(wal.lastLsn() == 20000);
+            avl.makeEmpty(avl.GetRoot());
+        } // "Crash": the tree is gone, only the files remain
+        {
+            // A writer died halfway through an entry
+            ofstream torn(logFile, ios::binary | ios::app);
+            torn.write("\x01garbage", 8);
+        }
+
+        AVL recovered;
+        assert(recovered.recover(snapFile, logFile));
+        checkAVLHeights(recovered.GetRoot());
+        for (int sin = 0; sin < 5000; sin++)
+            assert((recovered.Find(recovered.GetRoot(), sin) != NULL) == (model.count(sin) > 0));
+
+        // Reopening cuts the torn tail off and continues the LSNs
+        WriteAheadLog wal;
+        assert(wal.open(logFile));
+        assert(wal.lastLsn() == 20000);
+        recovered.attachLog(&wal);
+        recovered.insert(createEmployee(7777));
+        recovered.remove(model.begin()->first);
+        model.insert(make_pair(7777, createEmployee(7777)));
+        model.erase(model.begin());
+        wal.close();
+        AVL again;
+        assert(again.recover(NULL, logFile));
+        for (int sin = 0; sin < 8000; sin++)
+            assert((again.Find(again.GetRoot(), sin) != NULL) == (model.count(sin) > 0));
+        assert(!again.recover(NULL, logFile));
+        remove(logFile);
+        remove(snapFile);
+        cout << "[AVL] Write-ahead log test passed.\n";
+        cout << "[AVL] Write-Ahead Log Recovery Test Completed.\n\n";
+        recovered.makeEmpty(recovered.GetRoot());
+        again.makeEmpty(again.GetRoot());
+    }
+
+    // Test 22: Durable write throughput, syncing every write versus group
+    // commit across concurrent writers (each writing its own tree).
+    void testGroupCommitAVL(double seconds)
+    {
+        cout << "[AVL] Durable Write Throughput Test Started...\n";
+        const char *logFile = "avl_wal.log";
+        struct Mode
+        {
+            const char *name;
+            int writers;
+            unsigned windowMicros;
+        } modes[] = {
+            {"per-op sync, 1 writer         ", 1, 0},
+            {"no window, 16 writers         ", 16, 0},
+            {"group commit 1 ms, 16 writers ", 16, 1000},
+            {"group commit 10 ms, 16 writers", 16, 10000},
+        };
+        for (int m = 0; m < 4; m++)
+        {
+            remove(logFile);
+            WriteAheadLog wal;
+            assert(wal.open(logFile));
+            wal.setGroupCommit(modes[m].windowMicros);
+            vector<AVL> trees(modes[m].writers);
+            atomic<bool> stop(false);
+            atomic<long> ops(0);
+            vector<thread> writers;
+            Timer timer;
+            timer.start();
+            for (int w = 0; w < modes[m].writers; w++)
+                writers.push_back(thread([&, w]() {
+                    trees[w].attachLog(&wal);
+                    long done = 0;
+                    for (int i = 0; !stop; i++, done++)
+                        trees[w].insert(createEmployee(i));
+                    ops += done;
+                }));
+            usleep((useconds_t)(seconds * 1e6));
+            stop = true;
+            for (size_t w = 0; w < writers.size(); w++)
+                writers[w].join();
+            timer.stop();
+            cout << "[AVL] " << modes[m].name << ": " << ops / timer.currtime() << " durable writes/sec, "
+                 << (double)ops / wal.syncCount() << " writes per fdatasync\n";
+            wal.close();
+            for (size_t w = 0; w < trees.size(); w++)
+                trees[w].makeEmpty(trees[w].GetRoot());
+        }
+        remove(logFile);
+        cout << "[AVL] Durable Write Throughput Test Completed.\n\n";
+    }
+
+    // Test 23: A background checkpoint holds exactly the records present when
+    // it started, however the tree changes while it runs.
+    void testCheckpointAVL()
+    {
+        cout << "[AVL] Checkpoint Correctness Test Started...\n";
+        const char *file = "avl_checkpoint.bin";
+        AVL avl;
+        avl.enableTopMirror(8);
+        map<int, EmployeeInfo> model;
+        srand(34);
+        for (int i = 0; i < 100000; i++)
+        {
+            int sin = rand() % 200000;
+            avl.insert(createEmployee(sin));
+            model.insert(make_pair(sin, createEmployee(sin)));
+        }
+        map<int, EmployeeInfo> atStart(model);
+        assert(avl.startCheckpoint(file, 64));
+        assert(!avl.startCheckpoint(file));
+        for (int i = 0; i < 200000; i++)
+        {
+            int sin = rand() % 200000;
+            if (rand() % 2 == 0)
+            {
+                EmployeeInfo empl = createEmployee(sin);
+                empl.age = -1; // Tells a record written during the checkpoint apart
+                avl.insert(empl);
+                model.insert(make_pair(sin, empl));
+            }
+            else
+            {
+                avl.remove(sin);
+                model.erase(sin);
+            }
+            if (i % 1000 == 0)
+                avl.compact(256);
+        }
+        CheckpointStats stats;
+        assert(avl.finishCheckpoint(&stats));
+        assert(stats.records == atStart.size() && stats.writes == 200000);
+
+        AVL snap;
+        assert(snap.openSnapshot(file, true));
+        for (int sin = 0; sin < 200000; sin++)
+        {
+            node *t = snap.Find(snap.GetRoot(), sin);
+            assert((t != NULL) == (atStart.count(sin) > 0));
+            if (t != NULL)
+                assert(t->empl.age == atStart[sin].age);
+            assert((avl.Find(avl.GetRoot(), sin) != NULL) == (model.count(sin) > 0));
+        }
+        snap.closeSnapshot();
+        remove(file);
+
+        // A checkpoint whose file cannot be created fails, and leaves the tree
+        // as the writes made meanwhile left it
+        assert(avl.startCheckpoint("no_such_dir/avl_checkpoint.bin", 64));
+        for (int i = 0; i < 1000; i++)
+        {
+            int sin = rand() % 200000;
+            if (rand() % 2 == 0)
+            {
+                avl.insert(createEmployee(sin));
+                model.insert(make_pair(sin, createEmployee(sin)));
+            }
+            else
+            {
+                avl.remove(sin);
+                model.erase(sin);
+            }
+        }
+        assert(!avl.finishCheckpoint(&stats));
+        for (int sin = 0; sin < 200000; sin++)
+            assert((avl.Find(avl.GetRoot(), sin) != NULL) == (model.count(sin) > 0));
+        assert(avl.startCheckpoint(file));
+        assert(avl.finishCheckpoint(&stats) && stats.records == model.size());
+        remove(file);
+
+        // A tree that goes away while its checkpoint runs waits for it
+        {
+            AVL doomed;
+            for (int sin = 0; sin < 100000; sin++)
+                doomed.insert(createEmployee(sin));
+            assert(doomed.startCheckpoint(file, 16));
+        }
+        assert(snap.openSnapshot(file, true));
+        for (int sin = 0; sin < 100000; sin += 997)
+            assert(snap.Find(snap.GetRoot(), sin) != NULL);
+        snap.closeSnapshot();
+        remove(file);
+        cout << "[AVL] Checkpoint test passed.\n";
+        cout << "[AVL] Checkpoint Correctness Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+    }
+
+    // Test 24: Write stalls while a large tree is checkpointed in the
+    // background, against the pause of a stop-the-world saveSnapshot().
+    void testCheckpointStallsAVL(int numElements)
+    {
+        cout << "[AVL] Background Checkpoint Test with " << numElements << " elements Started...\n";
+        const char *file = "avl_checkpoint.bin";
+        AVL avl;
+        for (int i = 0; i < numElements; i++)
+            avl.insert(createEmployee(i * 2));
+        Timer timer;
+        timer.start();
+        assert(avl.saveSnapshot(file));
+        timer.stop();
+        cout << "[AVL] Stop-the-world saveSnapshot: writes blocked for " << timer.currtime() * 1e3 << " ms\n";
+
+        srand(34);
+        assert(avl.startCheckpoint(file));
+        while (avl.checkpointRunning())
+        {
+            int sin = rand() % (numElements * 2);
+            if (rand() % 2 == 0)
+                avl.insert(createEmployee(sin));
+            else
+                avl.remove(sin);
+        }
+        CheckpointStats stats;
+        assert(avl.finishCheckpoint(&stats));
+        assert(stats.records == (size_t)numElements);
+        cout << "[AVL] Background checkpoint: " << stats.seconds << " seconds, " << stats.writes << " writes ("
+             << stats.captured << " saved a pre-image)\n";
+        cout << "[AVL] Write stalls (us): p50 " << stats.stallP50 << ", p99 " << stats.stallP99 << ", p99.9 "
+             << stats.stallP999 << ", max " << stats.stallMax << "\n";
+        remove(file);
+        cout << "[AVL] Background Checkpoint Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+    }
+
+    // Reads back a CSV, JSON Lines or binary export.
+    vector<EmployeeInfo> readExport(const char *file, ExportFormat format)
+    {
+        vector<EmployeeInfo> recs;
+        ifstream in(file, ios::binary);
+        EmployeeInfo e;
+        if (format == EXPORT_BINARY)
+        {
+            char header[16];
+            in.read(header, sizeof(header));
+            assert(memcmp(header, "AVLRECS", 8) == 0);
+            while (in.read((char *)&e, sizeof(e)))
+                recs.push_back(e);
+            return recs;
+        }
+        string line;
+        if (format == EXPORT_CSV)
+        {
+            getline(in, line);
+            assert(line == "sin,emplNumber,salary,age");
+        }
+        while (getline(in, line))
+        {
+            const char *pattern = format == EXPORT_CSV ? "%d,%d,%d,%d" : "{\"sin\":%d,\"emplNumber\":%d,\"salary\":%d,\"age\":%d}";
+            assert(sscanf(line.c_str(), pattern, &e.sin, &e.emplNumber, &e.salary, &e.age) == 4);
+            recs.push_back(e);
+        }
+        return recs;
+    }
+
+    // Test 25: Every export format round trips, in key order, also for small
+    // trees and for two trees exporting at the same time.
+    void testExportAVL()
+    {
+        cout << "[AVL] Export Correctness Test Started...\n";
+        const ExportFormat formats[] = {EXPORT_CSV, EXPORT_JSONL, EXPORT_BINARY};
+        AVL avl, small;
+        small.enableSmallMode(64);
+        map<int, EmployeeInfo> model, smallModel;
+        srand(35);
+        for (int i = 0; i < 50000; i++)
+        {
+            EmployeeInfo empl = createEmployee(rand() - RAND_MAX / 2);
+            avl.insert(empl);
+            model.insert(make_pair(empl.sin, empl));
+        }
+        for (int i = 0; i < 40; i++)
+        {
+            small.insert(createEmployee(i * 3));
+            smallModel.insert(make_pair(i * 3, createEmployee(i * 3)));
+        }
+        for (int f = 0; f < 3; f++)
+        {
+            // The two exports share no state, so they can run side by side
+            thread other([&]() { assert(small.exportTo("avl_export_small.out", formats[f], 2)); });
+            assert(avl.exportTo("avl_export.out", formats[f], 4));
+            other.join();
+            const map<int, EmployeeInfo> *models[] = {&model, &smallModel};
+            const char *files[] = {"avl_export.out", "avl_export_small.out"};
+            for (int t = 0; t < 2; t++)
+            {
+                vector<EmployeeInfo> recs = readExport(files[t], formats[f]);
+                assert(recs.size() == models[t]->size());
+                size_t i = 0;
+                for (map<int, EmployeeInfo>::const_iterator it = models[t]->begin(); it != models[t]->end(); ++it, i++)
+                    assert(recs[i].sin == it->first && recs[i].age == it->second.age && recs[i].salary == it->second.salary &&
+                           recs[i].emplNumber == it->second.emplNumber);
+            }
+        }
+        char displayFile[] = "avl_export.out";
+        small.display(displayFile);
+        ifstream in(displayFile);
+        string line;
+        getline(in, line);
+        assert(line == " height:0 sin:0 employee number:" + to_string(smallModel[0].emplNumber) + " salary:" +
+                           to_string(smallModel[0].salary) + " age:" + to_string(smallModel[0].age));
+        remove("avl_export.out");
+        remove("avl_export_small.out");
+        cout << "[AVL] Export test passed.\n";
+        cout << "[AVL] Export Correctness Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+        small.makeEmpty(small.GetRoot());
+    }
+
+    // Test 26: Export throughput per format and worker count, against
+    // display().
+    void testExportSpeedAVL(int numElements)
+    {
+        cout << "[AVL] Export Speed Test with " << numElements << " elements Started...\n";
+        const char *file = "avl_export.out";
+        AVL avl;
+        srand(35);
+        for (int i = 0; i < numElements; i++)
+            avl.insert(createEmployee(i));
+        Timer timer;
+        char displayFile[] = "avl_export.out";
+        timer.start();
+        avl.display(displayFile);
+        timer.stop();
+        cout << "[AVL] display(): " << timer.currtime() << " seconds\n";
+        struct Run
+        {
+            const char *name;
+            ExportFormat format;
+            int threads;
+        } runs[] = {
+            {"CSV, 1 thread    ", EXPORT_CSV, 1},
+            {"CSV, 4 threads   ", EXPORT_CSV, 4},
+            {"JSONL, 4 threads ", EXPORT_JSONL, 4},
+            {"binary, 4 threads", EXPORT_BINARY, 4},
+        };
+        for (int r = 0; r < 4; r++)
+        {
+            timer.reset();
+            timer.start();
+            assert(avl.exportTo(file, runs[r].format, runs[r].threads));
+            timer.stop();
+            ifstream in(file, ios::binary | ios::ate);
+            double mb = in.tellg() / 1e6;
+            cout << "[AVL] exportTo " << runs[r].name << ": " << timer.currtime() << " seconds, " << mb / timer.currtime()
+                 << " MB/s\n";
+        }
+        remove(file);
+        cout << "[AVL] Export Speed Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+    }
+
+    // Test 27: Import round trips exports, keeps the first of duplicate sins,
+    // tolerates header/CRLF/blank lines and rejects malformed input whole.
+    void testImportAVL()
+    {
+        cout << "[AVL] Import Correctness Test Started...\n";
+        const char *file = "avl_import.in";
+        {
+            ofstream out(file, ios::binary);
+            out << "sin,emplNumber,salary,age\r\n5,1,2,3\r\n-7,4,5,6\n5,9,9,9\n\n"
+                << INT_MAX << "," << INT_MIN << ",12345678,123456789\n0,00000000012,1,1";
+        }
+        AVL avl;
+        assert(avl.importFrom(file, EXPORT_CSV, 3));
+        node *t = avl.Find(avl.GetRoot(), 5);
+        assert(t != NULL && t->empl.emplNumber == 1 && t->empl.age == 3);
+        t = avl.Find(avl.GetRoot(), -7);
+        assert(t != NULL && t->empl.age == 6);
+        t = avl.Find(avl.GetRoot(), INT_MAX);
+        assert(t != NULL && t->empl.emplNumber == INT_MIN && t->empl.salary == 12345678 && t->empl.age == 123456789);
+        t = avl.Find(avl.GetRoot(), 0);
+        assert(t != NULL && t->empl.emplNumber == 12);
+        avl.makeEmpty(avl.GetRoot());
+        {
+            ofstream out(file, ios::binary);
+            out << "1,2,3,4\n1,2,x,4\n";
+        }
+        AVL rejected;
+        assert(!rejected.importFrom(file, EXPORT_CSV));
+        assert(rejected.GetRoot() == NULL);
+        // Numbers outside the int range are rejected, not truncated
+        const char *outOfRange[] = {"2147483648,1,1,1\n", "-2147483649,1,1,1\n", "1,99999999999,1,1\n",
+                                    "1,1,1,4294967297\n"};
+        for (const char *line : outOfRange)
+        {
+            ofstream(file, ios::binary) << line;
+            assert(!rejected.importFrom(file, EXPORT_CSV));
+            assert(rejected.Find(rejected.GetRoot(), 1) == NULL);
+        }
+        // An empty CSV is an empty import; an empty binary file has no header
+        ofstream(file, ios::binary).close();
+        assert(rejected.importFrom(file, EXPORT_CSV) && rejected.GetRoot() == NULL);
+        assert(!rejected.importFrom(file, EXPORT_BINARY));
+
+        AVL source;
+        map<int, EmployeeInfo> model;
+        srand(36);
+        for (int i = 0; i < 100000; i++)
+        {
+            EmployeeInfo empl = createEmployee(rand() - RAND_MAX / 2);
+            empl.salary = -empl.salary;
+            source.insert(empl);
+            model.insert(make_pair(empl.sin, empl));
+        }
+        const ExportFormat formats[] = {EXPORT_CSV, EXPORT_BINARY};
+        for (int f = 0; f < 2; f++)
+        {
+            assert(source.exportTo(file, formats[f]));
+            AVL imported, merged;
+            assert(imported.importFrom(file, formats[f], 4));
+            merged.insert(createEmployee(1)); // Not empty: inserted one by one
+            assert(merged.importFrom(file, formats[f], 2));
+            checkAVLHeights(imported.GetRoot());
+            checkAVLHeights(merged.GetRoot());
+            for (map<int, EmployeeInfo>::iterator it = model.begin(); it != model.end(); ++it)
+            {
+                t = imported.Find(imported.GetRoot(), it->first);
+                assert(t != NULL && t->empl.salary == it->second.salary && t->empl.age == it->second.age);
+                assert(merged.Find(merged.GetRoot(), it->first) != NULL);
+            }
+            assert(merged.Find(merged.GetRoot(), 1) != NULL);
+            imported.makeEmpty(imported.GetRoot());
+            merged.makeEmpty(merged.GetRoot());
+        }
+        remove(file);
+        cout << "[AVL] Import test passed.\n";
+        cout << "[AVL] Import Correctness Test Completed.\n\n";
+        source.makeEmpty(source.GetRoot());
+    }
+
+    // Test 28: Import throughput of a synthetic employee file, CSV and
+    // binary, against inserting the records one by one.
+    void testImportSpeedAVL(int numRows)
+    {
+        cout << "[AVL] Import Speed Test with " << numRows << " rows Started...\n";
+        const char *file = "avl_import.in";
+        {
+            // Distinct sins in scrambled order (multiplying by an odd number
+            // permutes the integers modulo 2^31)
+            ofstream out(file, ios::binary);
+            string buf;
+            char line[64];
+            for (int i = 0; i < numRows; i++)
+            {
+                EmployeeInfo e = createEmployee((int)(((uint32_t)i * 2654435761u) & 0x7FFFFFFF));
+                char *p = line;
+                int fields[] = {e.sin, e.emplNumber, e.salary, e.age};
+                for (int f = 0; f < 4; f++)
+                {
+                    p = to_chars(p, line + sizeof(line), fields[f]).ptr;
+                    *p++ = f < 3 ? ',' : '\n';
+                }
+                buf.append(line, p - line);
+                if (buf.size() > (1 << 20))
+                {
+                    out.write(buf.data(), buf.size());
+                    buf.clear();
+                }
+            }
+            out.write(buf.data(), buf.size());
+        }
+        Timer timer;
+        AVL avl;
+        timer.start();
+        assert(avl.importFrom(file, EXPORT_CSV));
+        timer.stop();
+        cout << "[AVL] importFrom CSV:    " << numRows / timer.currtime() << " records/sec\n";
+        assert(avl.Find(avl.GetRoot(), (int)((12345u * 2654435761u) & 0x7FFFFFFF)) != NULL);
+        assert(avl.exportTo(file, EXPORT_BINARY));
+        avl.makeEmpty(avl.GetRoot());
+
+        AVL binary;
+        timer.reset();
+        timer.start();
+        assert(binary.importFrom(file, EXPORT_BINARY));
+        timer.stop();
+        cout << "[AVL] importFrom binary: " << numRows / timer.currtime() << " records/sec\n";
+        binary.makeEmpty(binary.GetRoot());
+        remove(file);
+
+        // The loop the importer replaces, on a slice of the same records
+        int slice = min(numRows, 5000000);
+        AVL inserted;
+        timer.reset();
+        timer.start();
+        for (int i = 0; i < slice; i++)
+            inserted.insert(createEmployee((int)(((uint32_t)i * 2654435761u) & 0x7FFFFFFF)));
+        timer.stop();
+        cout << "[AVL] insert() loop:     " << slice / timer.currtime() << " records/sec (" << slice << " records)\n";
+        inserted.makeEmpty(inserted.GetRoot());
+        cout << "[AVL] Import Speed Test Completed.\n\n";
+    }
+
+    // Helper for Test 29: random churn on a tiered tree against std::map.
+    template <class Tree>
+    void churnTiered(Tree &tree, const char *file, unsigned seed)
+    {
+        const size_t budget = 1500;
+        assert(tree.enableTiering(file, budget * sizeof(node)));
+        map<int, EmployeeInfo> model;
+        srand(seed);
+        size_t spilledMax = 0;
+        for (int i = 0; i < 200000; i++)
+        {
+            int sin = rand() % 20000;
+            if (rand() % 3 != 0)
+            {
+                EmployeeInfo empl = createEmployee(sin);
+                empl.age = i;
+                tree.insert(empl);
+                model.insert(make_pair(sin, empl));
+            }
+            else
+            {
+                tree.remove(sin);
+                model.erase(sin);
+            }
+            if (i % 7 == 0)
+            {
+                int key = rand() % 20000;
+                node *t = tree.Find(tree.GetRoot(), key);
+                assert((t != NULL) == (model.count(key) > 0));
+                if (t != NULL)
+                    assert(t->empl.age == model[key].age);
+            }
+            // Eviction runs before each operation, which faults in at most
+            // a few pages of 127 nodes
+            assert(tree.residentNodes() <= budget + 1024);
+            spilledMax = max(spilledMax, tree.spilledRecords());
+        }
+        assert(spilledMax > 0);
+        assert(tree.residentNodes() + tree.spilledRecords() == model.size());
+        for (map<int, EmployeeInfo>::iterator it = model.begin(); it != model.end(); ++it)
+        {
+            node *t = tree.Find(tree.GetRoot(), it->first);
+            assert(t != NULL && t->empl.age == it->second.age);
+        }
+        tree.disableTiering();
+        assert(tree.spilledRecords() == 0 && tree.residentNodes() == model.size());
+        assert(access(file, F_OK) != 0);
+    }
+
+    // Test 29: Tiered storage under a budget far below the tree's size,
+    // for both balance policies; the trees stay balanced.
+    void testTieringAVL()
+    {
+        cout << "[AVL/WAVL] Tiered Storage Correctness Test Started...\n";
+        const char *file = "avl_tier.pages";
+        AVL avl;
+        churnTiered(avl, file, 37);
+        checkAVLHeights(avl.GetRoot());
+        WAVL wavl;
+        churnTiered(wavl, file, 38);
+        checkWAVLRanks(wavl.GetRoot());
+
+        // Whole-tree operations see spilled records too
+        AVL tiered;
+        for (int i = 0; i < 50000; i++)
+            tiered.insert(createEmployee(i));
+        assert(tiered.enableTiering(file, 2000 * sizeof(node)));
+        assert(tiered.spilledRecords() > 0);
+        assert(tiered.exportTo("avl_tier.csv", EXPORT_CSV));
+        vector<EmployeeInfo> rows = readExport("avl_tier.csv", EXPORT_CSV);
+        assert(rows.size() == 50000 && rows[49999].sin == 49999);
+        remove("avl_tier.csv");
+        tiered.enableTopMirror(4); // Turns tiering off
+        assert(tiered.spilledRecords() == 0);
+        assert(!tiered.enableTiering(file, 2000 * sizeof(node)));
+
+        // The page file has no name while in use, and a tree destroyed
+        // without disableTiering closes it: the lowest free descriptor is
+        // the same before and after
+        int probe = dup(1);
+        close(probe);
+        {
+            AVL dropped;
+            for (int i = 0; i < 20000; i++)
+                dropped.insert(createEmployee(i));
+            assert(dropped.enableTiering(file, 2000 * sizeof(node)) && dropped.spilledRecords() > 0);
+            assert(access(file, F_OK) != 0);
+        }
+        int again = dup(1);
+        assert(again == probe);
+        close(again);
+        cout << "[AVL/WAVL] Tiered storage test passed.\n";
+        cout << "[AVL/WAVL] Tiered Storage Correctness Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+        wavl.makeEmpty(wavl.GetRoot());
+        tiered.makeEmpty(tiered.GetRoot());
+    }
+
+    // Helper for Test 30: Find latency percentiles in microseconds.
+    void reportFindLatency(AVL &avl, const char *label, int lo, int span, int lookups)
+    {
+        vector<double> lat(lookups);
+        Timer timer;
+        for (int i = 0; i < lookups; i++)
+        {
+            int sin = lo + rand() % span;
+            timer.reset();
+            timer.start();
+            node *t = avl.Find(avl.GetRoot(), sin);
+            timer.stop();
+            assert(t != NULL);
+            lat[i] = timer.currtime() * 1e6;
+        }
+        sort(lat.begin(), lat.end());
+        cout << "[AVL] " << label << ": Find (us) p50 " << lat[lookups / 2] << ", p99 " << lat[lookups * 99 / 100]
+             << ", p99.9 " << lat[lookups * 999 / 1000] << ", max " << lat[lookups - 1] << "\n";
+    }
+
+    // Test 30: A tree several times larger than its memory budget. Recently
+    // inserted keys stay resident; uniformly random keys mostly fault a page
+    // in from the page file.
+    void testTieringSpeedAVL(int numElements, size_t budgetMB)
+    {
+        cout << "[AVL] Tiered Storage Test with " << numElements << " elements and a " << budgetMB
+             << " MB budget Started...\n";
+        const char *file = "avl_tier.pages";
+        const int lookups = 200000;
+        AVL avl;
+        assert(avl.enableTiering(file, budgetMB << 20));
+        Timer timer;
+        timer.start();
+        for (int i = 0; i < numElements; i++)
+            avl.insert(createEmployee(i));
+        timer.stop();
+        ifstream pages(file, ios::binary | ios::ate);
+        cout << "[AVL] Inserted in " << timer.currtime() << " seconds; " << avl.residentNodes() * sizeof(node) / 1e6
+             << " MB resident, " << avl.spilledRecords() << " records in a " << pages.tellg() / 1e6
+             << " MB page file\n";
+        srand(39);
+        int hot = numElements / 100;
+        reportFindLatency(avl, "Tiered, hot keys", numElements - hot, hot, lookups);
+        reportFindLatency(avl, "Tiered, cold keys", 0, numElements, lookups);
+        avl.disableTiering();
+        reportFindLatency(avl, "Fully resident", 0, numElements, lookups);
+        cout << "[AVL] Tiered Storage Test Completed.\n\n";
+        avl.makeEmpty(avl.GetRoot());
+    }
+
+    // Test 31: The io_uring and pwrite paths of AsyncWriter produce the same
+    // file, including a header patched after the body.
+    void testAsyncWriterAVL()
+    {
+        cout << "[AVL] Async Writer Correctness Test Started...\n";
+        const char *file = "avl_async.bin";
+        srand(40);
+        string expected;
+        vector<string> pieces;
+        for (int i = 0; i < 2000; i++)
+        {
+            // Up to three buffers long, so pieces straddle buffer boundaries
+            string piece(rand() % (3 * AsyncWriter::BUFFER_SIZE / 100), (char)('a' + i % 26));
+            pieces.push_back(piece);
+            expected += piece;
+        }
+        expected.replace(0, 8, "HEADER!!");
+        for (int uring = 0; uring < 2; uring++)
+        {
+            AsyncWriter out;
+            assert(out.open(file, uring == 1));
+            bool ring = out.usingUring();
+            for (size_t i = 0; i < pieces.size(); i++)
+                assert(out.write(pieces[i]));
+            assert(out.size() == expected.size());
+            assert(out.writeAt(0, "HEADER!!", 8));
+            assert(out.close());
+            ifstream in(file, ios::binary);
+            string got((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            assert(got == expected);
+            cout << "[AVL] " << (uring ? "io_uring" : "pwrite") << " path: " << got.size() << " bytes match"
+                 << (uring && !ring ? " (io_uring unavailable, pwrite used)" : "") << "\n";
+        }
+        assert(!AsyncWriter().open("no_such_directory/avl_async.bin"));
+        remove(file);
+        cout << "[AVL] Async writer test passed.\n";
+        cout << "[AVL] Async Writer Correctness Test Completed.\n\n";
+    }
+
+    // Helper for Test 32: user plus system CPU seconds of this thread or,
+    // with who == RUSAGE_SELF, of the whole process (io_uring's kernel
+    // workers included).
+    double cpuSeconds(int who)
+    {
+        struct rusage ru;
+        getrusage(who, &ru);
+        return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    }
+
+    // Test 32: Throughput and CPU cost of writing a local file through the
+    // pwrite and io_uring paths.
+    void testAsyncWriterSpeedAVL(size_t totalMB)
+    {
+        cout << "[AVL] Async Writer Speed Test with " << totalMB << " MB Started...\n";
+        const char *file = "avl_async.bin";
+        string piece(64 << 10, 'x');
+        size_t pieces = (totalMB << 20) / piece.size();
+        for (int uring = 0; uring < 2; uring++)
+        {
+            AsyncWriter out;
+            Timer timer;
+            double cpu = cpuSeconds(RUSAGE_SELF), caller = cpuSeconds(RUSAGE_THREAD);
+            timer.start();
+            assert(out.open(file, uring == 1));
+            bool ring = out.usingUring();
+            for (size_t i = 0; i < pieces; i++)
+                out.write(piece);
+            assert(out.close());
+            timer.stop();
+            cpu = cpuSeconds(RUSAGE_SELF) - cpu;
+            caller = cpuSeconds(RUSAGE_THREAD) - caller;
+            cout << "[AVL] " << (ring ? "io_uring" : "pwrite  ") << ": " << totalMB / timer.currtime()
+                 << " MB/sec, CPU " << cpu << " s (calling thread " << caller << " s)\n";
+            remove(file);
+        }
+        cout << "[AVL] Async Writer Speed Test Completed.\n\n";
+    }
+
+    // Test 33: StaticAVL against std::map under churn, with the tree often
+    // full; no heap memory is allocated once it is constructed.
+    void testStaticAVL()
+    {
+        cout << "[AVL] Static AVL Correctness Test Started...\n";
+        static StaticAVL<4096> avl;
+        const int numOps = 500000;
+        srand(41);
+        vector<pair<bool, int> > ops(numOps);
+        for (int i = 0; i < numOps; i++)
+            ops[i] = make_pair(rand() % 10 < 7, rand() % 8000);
+        vector<StaticStatus> status(numOps);
+        vector<int> heights(numOps);
+        // The tree alone first, so that only its allocations would count
+        long heapBefore = heapInUse();
+        for (int i = 0; i < numOps; i++)
+        {
+            EmployeeInfo empl = createEmployee(ops[i].second);
+            empl.age = i;
+            status[i] = ops[i].first ? avl.insert(empl) : avl.remove(ops[i].second);
+            heights[i] = avl.treeHeight();
+        }
+        assert(heapInUse() == heapBefore);
+
+        map<int, EmployeeInfo> model;
+        size_t fullSeen = 0;
+        for (int i = 0; i < numOps; i++)
+        {
+            int sin = ops[i].second;
+            if (!ops[i].first)
+                assert((status[i] == STATIC_OK) == (model.erase(sin) > 0));
+            else if (model.count(sin))
+                assert(status[i] == STATIC_EXISTS);
+            else if (model.size() == avl.capacity())
+            {
+                assert(status[i] == STATIC_FULL);
+                fullSeen++;
+            }
+            else
+            {
+                assert(status[i] == STATIC_OK);
+                EmployeeInfo empl = createEmployee(sin);
+                empl.age = i;
+                model.insert(make_pair(sin, empl));
+            }
+            assert(heights[i] < staticAVLMaxHeight(avl.capacity()));
+        }
+        assert(fullSeen > 0 && avl.size() == model.size());
+        for (int sin = 0; sin < 8000; sin++)
+        {
+            const EmployeeInfo *e = avl.find(sin);
+            assert((e != NULL) == (model.count(sin) > 0));
+            if (e != NULL)
+                assert(e->age == model[sin].age);
+        }
+        avl.clear();
+        assert(avl.size() == 0 && !avl.full() && avl.find(model.begin()->first) == NULL);
+        cout << "[AVL] Static AVL test passed (" << fullSeen << " inserts refused as full).\n";
+        cout << "[AVL] Static AVL Correctness Test Completed.\n\n";
+    }
+
+    // Helper for Test 34: worst and tail latency of each operation, in
+    // microseconds.
+    void reportWorstCase(const char *label, vector<double> &lat)
+    {
+        sort(lat.begin(), lat.end());
+        size_t n = lat.size();
+        cout << "[AVL] " << label << ": p50 " << lat[n / 2] << ", p99.99 " << lat[n - 1 - n / 10000] << ", max "
+             << lat[n - 1] << " us\n";
+    }
+
+    // Test 34: Worst-case (WCET-style) latency of StaticAVL against AVL for
+    // the same operations on a nearly full tree: each operation is timed on
+    // its own and the maximum over all of them is reported.
+    void testStaticWorstCaseAVL(int operations)
+    {
+        const size_t capacity = 1 << 20;
+        cout << "[AVL] Static AVL Worst-Case Latency Test with " << capacity << " slots and " << operations
+             << " operations Started...\n";
+        static StaticAVL<capacity> fixed;
+        AVL heap;
+        fixed.clear();
+        // Fill to 7/8 of the capacity, then churn with random inserts and
+        // removes of keys twice the capacity apart
+        srand(42);
+        for (size_t i = 0; i < capacity / 8 * 7; i++)
+        {
+            EmployeeInfo empl = createEmployee(rand() % (capacity * 2));
+            fixed.insert(empl);
+            heap.insert(empl);
+        }
+        vector<pair<bool, int> > ops(operations);
+        vector<int> probes(operations);
+        for (int i = 0; i < operations; i++)
+        {
+            ops[i] = make_pair(rand() % 2 == 0, (int)(rand() % (capacity * 2)));
+            probes[i] = rand() % (capacity * 2);
+        }
+        vector<double> insertFixed, removeFixed, findFixed, insertHeap, removeHeap, findHeap;
+        Timer timer;
+        long found = 0; // Both trees hold the same keys, so this stays 0
+        for (int i = 0; i < operations; i++)
+        {
+            EmployeeInfo empl = createEmployee(ops[i].second);
+            vector<double> &fixedLat = ops[i].first ? insertFixed : removeFixed;
+            vector<double> &heapLat = ops[i].first ? insertHeap : removeHeap;
+            timer.reset();
+            timer.start();
+            if (ops[i].first)
+                fixed.insert(empl);
+            else
+                fixed.remove(empl.sin);
+            timer.stop();
+            fixedLat.push_back(timer.currtime() * 1e6);
+            timer.reset();
+            timer.start();
+            if (ops[i].first)
+                heap.insert(empl);
+            else
+                heap.remove(empl.sin);
+            timer.stop();
+            heapLat.push_back(timer.currtime() * 1e6);
+            timer.reset();
+            timer.start();
+            found += fixed.find(probes[i]) != NULL;
+            timer.stop();
+            findFixed.push_back(timer.currtime() * 1e6);
+            timer.reset();
+            timer.start();
+            found -= heap.Find(heap.GetRoot(), probes[i]) != NULL;
+            timer.stop();
+            findHeap.push_back(timer.currtime() * 1e6);
+        }
+        assert(found == 0);
+        cout << "[AVL] Height " << fixed.treeHeight() << ", bound " << staticAVLMaxHeight(capacity) << "\n";
+        reportWorstCase("StaticAVL insert", insertFixed);
+        reportWorstCase("AVL insert      ", insertHeap);
+        reportWorstCase("StaticAVL remove", removeFixed);
+        reportWorstCase("AVL remove      ", removeHeap);
+        reportWorstCase("StaticAVL find  ", findFixed);
+        reportWorstCase("AVL Find        ", findHeap);
+        fixed.clear();
+        heap.makeEmpty(heap.GetRoot());
+        cout << "[AVL] Static AVL Worst-Case Latency Test Completed.\n\n";
+    }
+
+    // Helper for Test 35: random churn on a generic tree of employees
+    // against std::map.
+    template <class Tree>
+    void churnGeneric(unsigned seed)
+    {
+        Tree tree;
+        map<int, EmployeeInfo> model;
+        srand(seed);
+        for (int i = 0; i < 200000; i++)
+        {
+            int sin = rand() % 5000;
+            if (rand() % 2)
+            {
+                EmployeeInfo empl = createEmployee(sin);
+                empl.age = i;
+                assert(tree.insert(empl) == (model.count(sin) == 0));
+                model.insert(make_pair(sin, empl));
+            }
+            else
+                assert(tree.remove(sin) == (model.erase(sin) > 0));
+        }
+        assert(tree.size() == model.size() && tree.treeHeight() < staticAVLMaxHeight(model.size()));
+        map<int, EmployeeInfo>::iterator it = model.begin();
+        tree.forEach([&](const EmployeeInfo &e) {
+            assert(it != model.end() && e.sin == it->first && e.age == it->second.age);
+            ++it;
+        });
+        assert(it == model.end());
+        tree.clear();
+        assert(tree.size() == 0 && tree.find(model.begin()->first) == NULL);
+    }
+
+    // A move-only payload with its own key, for Test 35.
+    struct Badge
+    {
+        unique_ptr<string> holder;
+        int id;
+        Badge(int id) : holder(new string("holder " + to_string(id))), id(id)
+        {
+        }
+    };
+
+    struct BadgeId
+    {
+        int operator()(const Badge &b) const
+        {
+            return b.id;
+        }
+    };
+
+    template <class NodePolicy>
+    void churnBadges()
+    {
+        AVLTree<int, Badge, greater<int>, NodePolicy, BadgeId> badges;
+        set<int> model;
+        for (int i = 0; i < 50000; i++)
+        {
+            int id = rand() % 3000;
+            if (rand() % 3)
+            {
+                assert(badges.emplace(id) == model.insert(id).second);
+                const Badge *b = badges.find(id);
+                assert(b != NULL && *b->holder == "holder " + to_string(id));
+            }
+            else
+                assert(badges.remove(id) == (model.erase(id) > 0));
+        }
+        set<int>::reverse_iterator it = model.rbegin(); // greater<int> orders descending
+        badges.forEach([&](const Badge &b) {
+            assert(b.id == *it && *b.holder == "holder " + to_string(b.id));
+            ++it;
+        });
+        assert(it == model.rend());
+        Badge extra(-1);
+        assert(badges.insert(std::move(extra)) && badges.find(-1) != NULL);
+    }
+
+    // Test 35: The generic AVLTree with each node layout, a move-only
+    // payload, a reversed comparator and string keys.
+    void testGenericTreeAVL()
+    {
+        cout << "[AVL] Generic Tree Correctness Test Started...\n";
+        churnGeneric<EmployeeTree>(43);
+        churnGeneric<CompactEmployeeTree>(43);
+        churnGeneric<AVLTree<int, EmployeeInfo, less<int>, FixedNodes<5000>, SinKey> >(43); // Keys are below 5000
+        churnBadges<PointerNodes>();
+        churnBadges<IndexNodes>();
+        churnBadges<FixedNodes<3000> >();
+        AVLTree<string, string> names;
+        assert(names.insert("carol") && names.insert("alice") && names.emplace(3, 'b') && !names.insert("alice"));
+        vector<string> order;
+        names.forEach([&](const string &name) { order.push_back(name); });
+        assert(order.size() == 3 && order[0] == "alice" && order[1] == "bbb" && order[2] == "carol");
+        cout << "[AVL] Generic tree test passed.\n";
+        cout << "[AVL] Generic Tree Correctness Test Completed.\n\n";
+    }
+
+    // Helper for Test 36: ns per insert, Find and remove of keys in random
+    // order, and heap bytes per record.
+    template <class Insert, class Find, class Remove, class Clear>
+    void timeGeneric(const char *name, const vector<int> &keys, Insert insert, Find find, Remove remove, Clear clear)
+    {
+        Timer timer;
+        long heapBefore = heapInUse();
+        timer.start();
+        for (size_t i = 0; i < keys.size(); i++)
+            insert(createEmployee(keys[i]));
+        timer.stop();
+        double insertNs = timer.currtime() * 1e9 / keys.size();
+        double bytes = (double)(heapInUse() - heapBefore) / keys.size();
+        long found = 0;
+        timer.reset();
+        timer.start();
+        for (size_t i = 0; i < keys.size(); i++)
+            found += find(keys[keys.size() - 1 - i]);
+        timer.stop();
+        assert(found == (long)keys.size());
+        double findNs = timer.currtime() * 1e9 / keys.size();
+        timer.reset();
+        timer.start();
+        for (size_t i = 0; i < keys.size(); i++)
+            remove(keys[i]);
+        timer.stop();
+        double removeNs = timer.currtime() * 1e9 / keys.size();
+        clear();
+#if defined(__GLIBC__)
+        malloc_trim(0); // Hand the freed nodes back, so the next tree does not start on a fragmented heap
+#endif
+        cout << "[AVL] " << name << ": insert " << insertNs << " ns, find " << findNs << " ns, remove " << removeNs
+             << " ns, " << bytes << " bytes/record\n";
+    }
+
+    // Test 36: AVL against the generic tree instantiated for the same table,
+    // with pointer and 32-bit index nodes.
+    void testGenericTreeSpeedAVL(int numElements)
+    {
+        cout << "[AVL] Generic Tree Speed Test with " << numElements << " elements Started...\n";
+        vector<int> keys(numElements);
+        for (int i = 0; i < numElements; i++)
+            keys[i] = i;
+        mt19937 rng(44);
+        shuffle(keys.begin(), keys.end(), rng);
+        AVL avl;
+        EmployeeTree tree;
+        CompactEmployeeTree compact;
+        timeGeneric("AVL                ", keys, [&](const EmployeeInfo &e) { avl.insert(e); },
+                    [&](int sin) { return avl.Find(avl.GetRoot(), sin) != NULL; }, [&](int sin) { avl.remove(sin); },
+                    [&]() { avl.makeEmpty(avl.GetRoot()); });
+        timeGeneric("EmployeeTree       ", keys, [&](const EmployeeInfo &e) { tree.insert(e); },
+                    [&](int sin) { return tree.find(sin) != NULL; }, [&](int sin) { tree.remove(sin); },
+                    [&]() { tree.clear(); });
+        timeGeneric("CompactEmployeeTree", keys, [&](const EmployeeInfo &e) { compact.insert(e); },
+                    [&](int sin) { return compact.find(sin) != NULL; }, [&](int sin) { compact.remove(sin); },
+                    [&]() { compact.clear(); });
+        cout << "[AVL] Generic Tree Speed Test Completed.\n\n";
+    }
+
+    // Test 37: LatencyHistogram percentiles against the exact order
+    // statistics, merging, and recording without allocating.
+    void testLatencyHistogramAVL()
+    {
+        cout << "[AVL] Latency Histogram Test Started...\n";
+        // Samples spread evenly over the orders of magnitude from 1 ns to
+        // about 1 s
+        static LatencyHistogram all, halves[2];
+        all.reset();
+        halves[0].reset();
+        halves[1].reset();
+        const int samples = 2000000;
+        vector<int64_t> values(samples);
+        mt19937_64 rng(45);
+        uniform_real_distribution<double> magnitude(0, 20.7);
+        for (int i = 0; i < samples; i++)
+            values[i] = (int64_t)exp(magnitude(rng));
+        long heapBefore = heapInUse();
+        for (int i = 0; i < samples; i++)
+        {
+            all.record(values[i]);
+            halves[i % 2].record(values[i]);
+        }
+        assert(heapInUse() == heapBefore);
+        halves[0].merge(halves[1]);
+        sort(values.begin(), values.end());
+        const double qs[] = {0, 0.1, 0.5, 0.9, 0.99, 0.999, 0.9999, 1};
+        for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++)
+        {
+            int64_t exact = values[min((size_t)samples - 1, (size_t)(qs[i] * samples))];
+            int64_t estimate = all.percentile(qs[i]);
+            // Exact below 256 ns, within a bucket's width (1/128) above
+            assert(exact < 256 ? estimate == exact : llabs(estimate - exact) <= exact / 128);
+            assert(halves[0].percentile(qs[i]) == estimate);
+        }
+        assert(all.count() == (uint64_t)samples && halves[0].count() == all.count());
+        assert(all.min() == values.front() && all.max() == values.back());
+        all.print(cout, "[AVL] Log-uniform samples");
+        all.reset();
+        all.record(-5); // A clock going backwards counts as 0
+        assert(all.count() == 1 && all.percentile(0.5) == 0);
+        all.reset();
+        assert(all.count() == 0 && all.percentile(0.99) == 0);
+        cout << "[AVL] Latency histogram test passed.\n";
+        cout << "[AVL] Latency Histogram Test Completed.\n\n";
+    }
+
+    // Helper for Test 38: Find latency of random keys on tree, in
+    // histograms (one per thread, merged).
+    void timeFinds(AVL &tree, int numElements, int threads, LatencyHistogram &lat)
+    {
+        vector<LatencyHistogram *> local(threads);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++)
+        {
+            local[t] = new LatencyHistogram(); // 35 KB each, too big for a thread's stack frame
+            workers.push_back(thread([&, t]() {
+                mt19937 rng(46 + t);
+                uniform_int_distribution<int> pick(0, numElements - 1);
+                for (int i = 0; i < 1000000; i++)
+                {
+                    int sin = pick(rng);
+                    uint64_t start = Timer::ticks();
+                    node *found = tree.Find(tree.GetRoot(), sin);
+                    local[t]->record(Timer::ticksToNs(Timer::ticks() - start));
+                    assert(found != NULL);
+                }
+            }));
+        }
+        lat.reset();
+        for (int t = 0; t < threads; t++)
+        {
+            workers[t].join();
+            lat.merge(*local[t]);
+            delete local[t];
+        }
+    }
+
+    // Test 38: The cost of reading each clock, what is left of an empty
+    // interval after subtracting it, and Find latency measured with both.
+    void testClockOverheadAVL(int numElements)
+    {
+        cout << "[AVL] Clock Overhead Test with " << numElements << " elements Started...\n";
+        static LatencyHistogram lat;
+        AVL avl;
+        for (int i = 0; i < numElements; i++)
+            avl.insert(createEmployee(i));
+        for (int tsc = 0; tsc < 2; tsc++)
+        {
+            if (!Timer::useTsc(tsc == 1))
+            {
+                cout << "[AVL] No invariant TSC on this machine, only the system clock was measured.\n";
+                break;
+            }
+            const char *name = tsc ? "rdtsc         " : "clock_gettime ";
+            lat.reset();
+            for (int i = 0; i < 1000000; i++)
+            {
+                uint64_t start = Timer::ticks();
+                lat.record(Timer::ticksToNs(Timer::ticks() - start));
+            }
+            cout << "[AVL] " << name << ": " << Timer::overheadNs() << " ns per pair of readings, subtracted\n";
+            lat.print(cout, (string("[AVL] ") + name + ": empty interval").c_str());
+            timeFinds(avl, numElements, 1, lat);
+            lat.print(cout, (string("[AVL] ") + name + ": Find, 1 thread  ").c_str());
+            timeFinds(avl, numElements, 4, lat);
+            lat.print(cout, (string("[AVL] ") + name + ": Find, 4 threads ").c_str());
+            assert(lat.count() == 4000000);
+        }
+        Timer::useTsc(false);
+        Timer timer;
+        timer.start();
+        timer.stop();
+        cout << "[AVL] Timer start()/stop() pair: " << Timer::timerOverheadNs() << " ns, subtracted by elapsedNs(); empty interval "
+             << timer.elapsedNs() << " ns\n";
+        avl.makeEmpty(avl.GetRoot());
+        cout << "[AVL] Clock Overhead Test Completed.\n\n";
+    }
+
+    // Test 39: The generators and distributions of the workload module, and
+    // AVL and std::map answering the same operation streams alike.
+    void testWorkloadGeneratorAVL()
+    {
+        cout << "[AVL] Workload Generator Test Started...\n";
+        Xoshiro256 a(7), b(7), c(8);
+        bool differs = false;
+        for (int i = 0; i < 1000; i++)
+        {
+            uint64_t x = a.next();
+            assert(x == b.next());
+            differs |= x != c.next();
+            assert(a.below(10) < 10 && b.below(10) < 10);
+            double u = a.unit();
+            assert(u >= 0 && u < 1 && u == b.unit());
+        }
+        assert(differs);
+
+        // Uniform: every tenth of the range within 3% of its share
+        const int draws = 1000000, n = 1000;
+        vector<int> hits(n);
+        KeyChooser uniform(DIST_UNIFORM, n);
+        for (int i = 0; i < draws; i++)
+            hits[uniform.next(a)]++;
+        for (int d = 0; d < 10; d++)
+        {
+            long tenth = 0;
+            for (int k = d * n / 10; k < (d + 1) * n / 10; k++)
+                tenth += hits[k];
+            assert(fabs(tenth - draws / 10.0) < draws / 10.0 * 0.03);
+        }
+
+        // Latest is Zipfian over age: the newest record has probability
+        // 1/zeta(n), the next one 1/2^theta of that
+        double zeta = 0;
+        for (int i = 1; i <= n; i++)
+            zeta += 1 / pow(i, 0.99);
+        KeyChooser latest(DIST_LATEST, n, 0.99);
+        fill(hits.begin(), hits.end(), 0);
+        for (int i = 0; i < draws; i++)
+            hits[latest.next(a)]++;
+        assert(fabs(hits[n - 1] - draws / zeta) < draws / zeta * 0.05);
+        assert(fabs((double)hits[n - 1] / hits[n - 2] - pow(2, 0.99)) < 0.1);
+        // After inserts the newest record is the hottest again
+        latest.grow(2 * n);
+        vector<int> grown(2 * n);
+        for (int i = 0; i < draws; i++)
+            grown[latest.next(a)]++;
+        assert(max_element(grown.begin(), grown.end()) - grown.begin() == 2 * n - 1);
+
+        // Zipfian: the same popularity, scattered over the keys
+        KeyChooser zipfian(DIST_ZIPFIAN, n, 0.99);
+        fill(hits.begin(), hits.end(), 0);
+        for (int i = 0; i < draws; i++)
+            hits[zipfian.next(a)]++;
+        int hottest = max_element(hits.begin(), hits.end()) - hits.begin();
+        assert(hits[hottest] > draws / zeta * 0.95);
+        assert(hottest != 0 && hottest != n - 1);
+
+        // Hotspot: 80% of the draws in the first 20% of the records
+        KeyChooser hotspot(DIST_HOTSPOT, n, 0.99, 0.2, 0.8);
+        long hot = 0;
+        for (int i = 0; i < draws; i++)
+            hot += hotspot.next(a) < (uint64_t)n / 5;
+        assert(fabs(hot - draws * 0.8) < draws * 0.01);
+
+        // Every YCSB mix, plus one with removes, gives the same answers on
+        // both engines, in the proportions asked for
+        static WorkloadResult onAVL, onMap;
+        WorkloadSpec spec;
+        workloadDefaults(spec);
+        spec.records = 20000;
+        spec.operations = 200000;
+        assert(!ycsbWorkload('G', spec));
+        for (int w = 0; w < 7; w++)
+        {
+            if (w < 6)
+                assert(ycsbWorkload('A' + w, spec));
+            else
+            {
+                for (int op = 0; op < OP_TYPES; op++)
+                    spec.mix[op] = 1;
+                spec.dist = DIST_HOTSPOT;
+            }
+            TreeEngine<AVL> avl("avl");
+            MapEngine m;
+            loadWorkload(spec, avl);
+            loadWorkload(spec, m);
+            runWorkload(spec, avl, onAVL);
+            runWorkload(spec, m, onMap);
+            double total = 0;
+            for (int op = 0; op < OP_TYPES; op++)
+                total += spec.mix[op];
+            for (int op = 0; op < OP_TYPES; op++)
+            {
+                assert(onAVL.ops[op].count == onMap.ops[op].count && onAVL.ops[op].hits == onMap.ops[op].hits);
+                assert(fabs(onAVL.ops[op].count - spec.operations * spec.mix[op] / total) < spec.operations * 0.01);
+            }
+            for (int i = 0; i < 1000; i++)
+            {
+                int start = (int)a.below(spec.records + spec.records / 10);
+                assert(avl.scan(start, 100) == m.scan(start, 100));
+            }
+        }
+        // The last mix removes records, so some of its reads miss
+        assert(onAVL.ops[OP_REMOVE].count > 0 && onAVL.ops[OP_READ].hits < onAVL.ops[OP_READ].count);
+        cout << "[AVL] Workload generator test passed.\n";
+        cout << "[AVL] Workload Generator Test Completed.\n\n";
+    }
+
+    // Test 40: YCSB core workloads A-F on AVL and std::map, throughput and
+    // latency per operation type.
+    void testYcsbWorkloadsAVL(int records)
+    {
+        cout << "[AVL] YCSB Workloads Test with " << records << " records Started...\n";
+        static WorkloadResult result;
+        WorkloadSpec spec;
+        workloadDefaults(spec);
+        spec.records = records;
+        spec.operations = records;
+        for (char w = 'A'; w <= 'F'; w++)
+        {
+            ycsbWorkload(w, spec);
+            for (int e = 0; e < 2; e++)
+            {
+                WorkloadEngine *engine = makeEngine(e == 0 ? "avl" : "map");
+                loadWorkload(spec, *engine);
+                runWorkload(spec, *engine, result);
+                for (int op = 0; op < OP_TYPES; op++)
+                    if (op != OP_REMOVE)
+                        assert(result.ops[op].hits == result.ops[op].count);
+                printWorkload(cout, string("[AVL] Workload ") + w + ", " + engine->name(), result);
+                delete engine;
+            }
+        }
+        cout << "[AVL] YCSB Workloads Test Completed.\n\n";
+    }
+
+    // Test 41: Hardware events per search for the smallest and the largest
+    // key on every engine, to explain the time a search takes. Without a PMU
+    // (most containers and VMs) the counters must do nothing, harmlessly.
+    void testPerfCountersAVL(int numElements)
+    {
+        cout << "[AVL] Hardware Counter Test with " << numElements << " elements Started...\n";
+        PerfCounters counters;
+        PerfSample sample;
+        if (!counters.available())
+        {
+            counters.start();
+            counters.stop();
+            assert(!counters.read(sample) && sample.samples == 0);
+            cout << "[AVL] Hardware counters unavailable (" << counters.unavailableReason() << "), nothing counted.\n";
+            cout << "[AVL] Hardware Counter Test Completed.\n\n";
+            return;
+        }
+        if (!counters.unavailableReason().empty())
+            cout << "[AVL] Some hardware counters unavailable (" << counters.unavailableReason() << ").\n";
+        const int lookups = 100000;
+        vector<vector<string> > table = {{"engine", "key", "ns"}};
+        for (int e = 0; e < PERF_EVENTS; e++)
+            table[0].push_back(perfEventName((PerfEvent)e));
+        table[0].push_back("IPC");
+        forEachEngine([&](auto &engine) {
+            for (int i = 0; i < numElements; i++)
+                engine.insert(createEmployee(i));
+            int keys[] = {0, numElements - 1};
+            for (int key : keys)
+            {
+                Timer timer;
+                long found = 0;
+                counters.start();
+                timer.start();
+                for (int i = 0; i < lookups; i++)
+                    found += engine.read(key);
+                timer.stop();
+                counters.stop();
+                assert(found == lookups && counters.read(sample) && sample.samples == 1);
+                vector<string> row = {engine.name(), to_string(key), cell(timer.elapsedNs() / lookups)};
+                for (int e = 0; e < PERF_EVENTS; e++)
+                    row.push_back(sample.counted[e] ? cell(sample.value[e] / lookups) : "-");
+                bool ipc = sample.counted[PERF_CYCLES] && sample.counted[PERF_INSTRUCTIONS] && sample.value[PERF_CYCLES] > 0;
+                row.push_back(ipc ? cell(sample.value[PERF_INSTRUCTIONS] / sample.value[PERF_CYCLES]) : "-");
+                assert(!sample.counted[PERF_INSTRUCTIONS] || sample.value[PERF_INSTRUCTIONS] > lookups);
+                table.push_back(row);
+            }
+            engine.clear();
+        });
+        printComparison("Events per search", table, "[AVL]");
+        cout << "[AVL] Hardware Counter Test Completed.\n\n";
+    }
+
+    // Test 42: Search time against tree size, from 1024 records up to
+    // maxRecords in steps of 4x, with the caches warm, TLB-cold and cold
+    // (see CacheEvictor). Warm is the mean over lookups searches for random
+    // keys, after as many untimed ones; the cold modes are the median of
+    // coldProbes searches, each after its own sweep. Where the tree outgrows
+    // L1, L2 and the last-level cache the warm time should step up towards
+    // the cold one.
+    void testCacheCrossoverAVL(int maxRecords, int lookups, int coldProbes)
+    {
+        cout << "[AVL] Cache Crossover Test up to " << maxRecords << " records Started...\n";
+        cout << "[AVL] Caches:";
+        for (int level = 1; level <= lastCacheLevel(); level++)
+            cout << " L" << level << " " << cacheSize(level) / 1024 << " KB";
+        cout << (lastCacheLevel() == 0 ? " unknown" : "") << "\n";
+        CacheEvictor evictor;
+        assert(evictor.bufferBytes() > 0);
+        static LatencyHistogram lat;
+        vector<vector<string> > table = {{"records", "working set KB", "fits in", "warm ns", "tlb-cold ns", "cold ns"}};
+        vector<double> warmNs, coldNs;
+        vector<string> fits;
+        vector<int> sizes;
+        TreeEngine<AVL> tree("avl");
+        mt19937 rng(42);
+        int built = 0;
+        for (int size = 1024; size <= maxRecords; size *= 4)
+        {
+            // Grow the tree to size, each new stretch of keys in random order
+            // so that neighbouring keys are not neighbours in memory
+            vector<int> fresh;
+            for (int key = built; key < size; key++)
+                fresh.push_back(key);
+            shuffle(fresh.begin(), fresh.end(), rng);
+            for (int key : fresh)
+                tree.insert(createEmployee(key));
+            built = size;
+            uniform_int_distribution<int> pick(0, size - 1);
+            vector<int> keys(lookups);
+            for (int &key : keys)
+                key = pick(rng);
+            long found = 0;
+            for (int key : keys)
+                found += tree.read(key);
+            Timer timer;
+            timer.start();
+            for (int key : keys)
+                found += tree.read(key);
+            timer.stop();
+            assert(found == 2L * lookups);
+            long bytes = tree.liveBytes();
+            vector<string> row = {to_string(size), cell(bytes / 1024.0), cacheLevelHolding(bytes),
+                                  cell(timer.elapsedNs() / lookups)};
+            warmNs.push_back(timer.elapsedNs() / lookups);
+            for (int mode = CACHE_TLB_COLD; mode <= CACHE_COLD; mode++)
+            {
+                lat.reset();
+                for (int i = 0; i < coldProbes; i++)
+                {
+                    evictor.prepare((CacheMode)mode);
+                    uint64_t start = Timer::ticks();
+                    bool result = tree.read(keys[i % lookups]);
+                    lat.record(Timer::ticksToNs(Timer::ticks() - start));
+                    assert(result);
+                }
+                row.push_back(cell(lat.percentile(0.5)));
+            }
+            coldNs.push_back(lat.percentile(0.5));
+            fits.push_back(row[2]);
+            sizes.push_back(size);
+            table.push_back(row);
+        }
+        printComparison("Search time by working set", table, "[AVL]");
+        // Where the smallest cache the tree fits in changes
+        for (size_t i = 1; i < sizes.size(); i++)
+            if (fits[i] != fits[i - 1])
+                cout << "[AVL] " << fits[i - 1] << " -> " << fits[i] << " between " << sizes[i - 1] << " and " << sizes[i]
+                     << " records: warm search " << cell(warmNs[i - 1]) << " -> " << cell(warmNs[i]) << " ns (cold "
+                     << cell(coldNs[i]) << " ns)\n";
+        // Nothing cached must never be faster than everything cached
+        if (!sizes.empty())
+            assert(coldNs.back() > warmNs.back());
+        tree.clear();
+        cout << "[AVL] Cache Crossover Test Completed.\n\n";
+    }
+
+    // Test 43: Baselines and regression checks: the Mann-Whitney test
+    // against values worked out by hand, a baseline file written, merged
+    // and read back, and results compared with it that are slower, the
+    // same and faster.
+    void testBaselineRegressionAVL()
+    {
+        cout << "[AVL] Baseline Regression Test Started...\n";
+        vector<double> low = {1, 2, 3, 4, 5}, high = {6, 7, 8, 9, 10}, mixed = {1.5, 2.5, 6.5, 7.5, 8.5};
+        // All five above: 1 of the C(10, 5) = 252 orders is that extreme
+        assert(fabs(mannWhitneyGreater(low, high) - 1 / 252.0) < 1e-12);
+        assert(fabs(mannWhitneyMinP(5, 5) - 1 / 252.0) < 1e-12);
+        assert(mannWhitneyGreater(high, low) == 1);
+        // U = 18 of 25: 39 of the 252 orders have U >= 18
+        assert(fabs(mannWhitneyGreater(low, mixed) - 39 / 252.0) < 1e-12);
+        // Large samples use the normal approximation
+        vector<double> evens, odds, shifted;
+        for (int i = 0; i < 30; i++)
+        {
+            evens.push_back(2 * i);
+            odds.push_back(2 * i + 1);
+            shifted.push_back(2 * i + 40);
+        }
+        double p = mannWhitneyGreater(evens, odds);
+        assert(p > 0.3 && p < 0.6);
+        assert(mannWhitneyGreater(evens, shifted) < 1e-6);
+        assert(mannWhitneyGreater(evens, evens) > 0.4);
+
+        const char *file = "baseline_test.txt";
+        remove(file);
+        vector<BenchResult> results(2);
+        for (int i = 0; i < 2; i++)
+        {
+            results[i].engine = i ? "map" : "avl";
+            results[i].op = "find";
+            results[i].dist = "uniform";
+            results[i].threads = 1;
+            results[i].n = 1000000;
+            for (int rep = 0; rep < 8; rep++)
+                results[i].times.push_back(0.5 + 0.01 * ((rep * 3) % 8));
+        }
+        string error;
+        Baseline baseline;
+        assert(loadBaseline(file, baseline, error) && baseline.empty());
+        assert(saveBaseline(file, results, error));
+        // A second save replaces avl's entry and keeps map's
+        vector<BenchResult> avlOnly(1, results[0]);
+        avlOnly[0].times.assign(6, 0.25);
+        assert(saveBaseline(file, avlOnly, error));
+        assert(loadBaseline(file, baseline, error) && baseline.size() == 2);
+        assert(baseline["avl find uniform 1 1000000"].size() == 6);
+        assert(baseline["map find uniform 1 1000000"] == results[1].times);
+        assert(saveBaseline(file, results, error) && loadBaseline(file, baseline, error));
+
+        // map 20% slower, avl unchanged, and a wavl result with no entry
+        vector<BenchResult> later(results);
+        for (double &t : later[1].times)
+            t *= 1.2;
+        later.push_back(results[0]);
+        later[2].engine = "wavl";
+        vector<BaselineComparison> comparisons;
+        compareBaseline(baseline, later, 0.05, 0.05, comparisons);
+        assert(comparisons.size() == 3);
+        assert(comparisons[0].found && !comparisons[0].regressed && comparisons[0].change == 0);
+        assert(comparisons[1].found && comparisons[1].regressed && comparisons[1].effect > 0.9);
+        assert(fabs(comparisons[1].change - 0.2) < 1e-9 && comparisons[1].p < 0.001);
+        assert(!comparisons[2].found && !comparisons[2].regressed);
+        cout << "[AVL] map 20% slower: p " << comparisons[1].p << ", Cliff's delta " << comparisons[1].effect << "\n";
+        // Slower by less than the threshold, or faster, is not a regression
+        comparisons.clear();
+        compareBaseline(baseline, later, 0.25, 0.05, comparisons);
+        assert(!comparisons[1].regressed);
+        for (double &t : later[1].times)
+            t /= 1.44;
+        comparisons.clear();
+        compareBaseline(baseline, later, 0.05, 0.05, comparisons);
+        assert(!comparisons[1].regressed && comparisons[1].effect == -1);
+        // A malformed line is an error, not an empty baseline
+        ofstream(file) << "avl find uniform 1 1000000 fast\n";
+        assert(!loadBaseline(file, baseline, error) && !error.empty());
+        remove(file);
+        cout << "[AVL] Baseline Regression Test Completed.\n\n";
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Main Function: Run all tests with pauses between groups.
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+// main: runs the test suite, or the benchmark runner with "bench"
+// ---------------------------------------------------------------------------
+
+// Multiplies the element counts and durations the suite passes to the tests
+// (--scale), e.g. 0.1 for a quick run.
+static double suiteScale = 1;
+
+static int scaled(long n)
+{
+    return (int)max(1.0, n * suiteScale);
+}
+
+// The suite, in the order it runs.
+typedef struct SuiteTest {
+    const char *group; // heading printed before the group's first test
+    const char *name;
+    void (*run)(DatabaseTestSuite &suite);
+} SuiteTest;
+
+static const SuiteTest suiteTests[] = {
+    {"Engine Comparison", "Insertion", [](DatabaseTestSuite &suite) { suite.testInsertion(); }},
+    {"Engine Comparison", "Deletion", [](DatabaseTestSuite &suite) { suite.testDeletion(); }},
+    {"Engine Comparison", "MaxSize", [](DatabaseTestSuite &suite) { suite.testMaxSize(scaled(50)); }},
+    {"Engine Comparison", "Load", [](DatabaseTestSuite &suite) { suite.testLoad(scaled(50000)); }},
+    {"Engine Comparison", "SearchSpeed", [](DatabaseTestSuite &suite) { suite.testSearchSpeed(scaled(100000)); }},
+    {"Engine Comparison", "MemoryLeak", [](DatabaseTestSuite &suite) { suite.testMemoryLeak(scaled(100)); }},
+    {"AVL Tree", "WriteBufferAVL", [](DatabaseTestSuite &suite) { suite.testWriteBufferAVL(); }},
+    {"AVL Tree", "WriteBufferSpeedAVL", [](DatabaseTestSuite &suite) { suite.testWriteBufferSpeedAVL(scaled(1000000)); }},
+    {"AVL Tree", "BalancePolicies", [](DatabaseTestSuite &suite) { suite.testBalancePolicies(); }},
+    {"AVL Tree", "ChurnRotations", [](DatabaseTestSuite &suite) { suite.testChurnRotations(scaled(200000), scaled(200000)); }},
+    {"AVL Tree", "SplayTree", [](DatabaseTestSuite &suite) { suite.testSplayTree(); }},
+    {"AVL Tree", "SkewedAccess", [](DatabaseTestSuite &suite) { suite.testSkewedAccess(scaled(1000000), scaled(1000000)); }},
+    {"AVL Tree", "TopMirrorAVL", [](DatabaseTestSuite &suite) { suite.testTopMirrorAVL(); }},
+    {"AVL Tree", "TopMirrorSpeedAVL", [](DatabaseTestSuite &suite) { suite.testTopMirrorSpeedAVL(scaled(10000000), scaled(1000000)); }},
+    {"AVL Tree", "CompactAVL", [](DatabaseTestSuite &suite) { suite.testCompactAVL(); }},
+    {"AVL Tree", "CompactScanAVL", [](DatabaseTestSuite &suite) { suite.testCompactScanAVL(scaled(2000000), scaled(2000000)); }},
+    {"AVL Tree", "SmallModeAVL", [](DatabaseTestSuite &suite) { suite.testSmallModeAVL(); }},
+    {"AVL Tree", "SmallModeSpeedAVL", [](DatabaseTestSuite &suite) { suite.testSmallModeSpeedAVL(scaled(10000), scaled(2000000)); }},
+    {"AVL Tree", "SnapshotAVL", [](DatabaseTestSuite &suite) { suite.testSnapshotAVL(); }},
+    {"AVL Tree", "SnapshotOpenSpeedAVL", [](DatabaseTestSuite &suite) { suite.testSnapshotOpenSpeedAVL(scaled(15000000), scaled(1000000)); }},
+    {"AVL Tree", "WriteAheadLogAVL", [](DatabaseTestSuite &suite) { suite.testWriteAheadLogAVL(); }},
+    {"AVL Tree", "GroupCommitAVL", [](DatabaseTestSuite &suite) { suite.testGroupCommitAVL(2.0 * suiteScale); }},
+    {"AVL Tree", "CheckpointAVL", [](DatabaseTestSuite &suite) { suite.testCheckpointAVL(); }},
+    {"AVL Tree", "CheckpointStallsAVL", [](DatabaseTestSuite &suite) { suite.testCheckpointStallsAVL(scaled(15000000)); }},
+    {"AVL Tree", "ExportAVL", [](DatabaseTestSuite &suite) { suite.testExportAVL(); }},
+    {"AVL Tree", "ExportSpeedAVL", [](DatabaseTestSuite &suite) { suite.testExportSpeedAVL(scaled(15000000)); }},
+    {"AVL Tree", "ImportAVL", [](DatabaseTestSuite &suite) { suite.testImportAVL(); }},
+    {"AVL Tree", "ImportSpeedAVL", [](DatabaseTestSuite &suite) { suite.testImportSpeedAVL(scaled(50000000)); }},
+    {"AVL Tree", "TieringAVL", [](DatabaseTestSuite &suite) { suite.testTieringAVL(); }},
+    {"AVL Tree", "TieringSpeedAVL", [](DatabaseTestSuite &suite) { suite.testTieringSpeedAVL(scaled(10000000), scaled(64)); }},
+    {"AVL Tree", "AsyncWriterAVL", [](DatabaseTestSuite &suite) { suite.testAsyncWriterAVL(); }},
+    {"AVL Tree", "AsyncWriterSpeedAVL", [](DatabaseTestSuite &suite) { suite.testAsyncWriterSpeedAVL(scaled(2048)); }},
+    {"AVL Tree", "StaticAVL", [](DatabaseTestSuite &suite) { suite.testStaticAVL(); }},
+    {"AVL Tree", "StaticWorstCaseAVL", [](DatabaseTestSuite &suite) { suite.testStaticWorstCaseAVL(scaled(1000000)); }},
+    {"AVL Tree", "GenericTreeAVL", [](DatabaseTestSuite &suite) { suite.testGenericTreeAVL(); }},
+    {"AVL Tree", "GenericTreeSpeedAVL", [](DatabaseTestSuite &suite) { suite.testGenericTreeSpeedAVL(scaled(1000000)); }},
+    {"AVL Tree", "LatencyHistogramAVL", [](DatabaseTestSuite &suite) { suite.testLatencyHistogramAVL(); }},
+    {"AVL Tree", "ClockOverheadAVL", [](DatabaseTestSuite &suite) { suite.testClockOverheadAVL(scaled(1000000)); }},
+    {"AVL Tree", "WorkloadGeneratorAVL", [](DatabaseTestSuite &suite) { suite.testWorkloadGeneratorAVL(); }},
+    {"AVL Tree", "YcsbWorkloadsAVL", [](DatabaseTestSuite &suite) { suite.testYcsbWorkloadsAVL(scaled(1000000)); }},
+    {"AVL Tree", "PerfCountersAVL", [](DatabaseTestSuite &suite) { suite.testPerfCountersAVL(scaled(1000000)); }},
+    {"AVL Tree", "CacheCrossoverAVL", [](DatabaseTestSuite &suite) { suite.testCacheCrossoverAVL(scaled(1 << 24), scaled(1000000), 50); }},
+    {"AVL Tree", "BaselineRegressionAVL", [](DatabaseTestSuite &suite) { suite.testBaselineRegressionAVL(); }},
+};
+
+static bool selected(const SuiteTest &test, const vector<string> &patterns)
+{
+    if (patterns.empty())
+        return true;
+    for (size_t i = 0; i < patterns.size(); i++)
+        if (strstr(test.name, patterns[i].c_str()) != NULL)
+            return true;
+    return false;
+}
+
+static void usage(ostream &out)
+{
+    out << "usage: avlTree [--list] [--pause] [--scale F] [--isolate] [--cpu C] [TEST...]\n"
+        << "       avlTree bench [options]   (see avlTree bench --help)\n"
+        << "Runs every test whose name contains one of the TEST arguments, or all\n"
+        << "of them, without stopping. --pause waits for Enter after each test;\n"
+        << "--scale multiplies the sizes the tests run with. --isolate runs each\n"
+        << "test in a fresh child process, carries on after a failed one and ends\n"
+        << "with a summary; --cpu pins the tests to CPU C.\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return benchMain(argc - 1, argv + 1);
+
+    bool pause = false, isolate = false;
+    int cpu = -1;
+    vector<string> patterns;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--pause")
+            pause = true;
+        else if (arg == "--scale" && i + 1 < argc && atof(argv[i + 1]) > 0)
+            suiteScale = atof(argv[++i]);
+        else if (arg == "--isolate")
+            isolate = true;
+        else if (arg == "--cpu" && i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+            cpu = atoi(argv[++i]);
+        else if (arg == "--list")
+        {
+            for (size_t t = 0; t < sizeof(suiteTests) / sizeof(suiteTests[0]); t++)
+                cout << suiteTests[t].name << "\n";
+            return 0;
+        }
+        else if (arg == "--help")
+        {
+            usage(cout);
+            return 0;
+        }
+        else if (arg[0] == '-')
+        {
+            usage(cerr);
+            return 2;
+        }
+        else
+            patterns.push_back(arg);
+    }
+
+    DatabaseTestSuite suite;
+    if (cpu >= 0 && !isolate && !pinToCpu(cpu))
+        cerr << "Cannot pin to CPU " << cpu << ", running unpinned\n";
+
+    cout << "=============================================\n";
+    cout << "Starting Database Performance Tests\n";
+    cout << "=============================================\n\n";
+
+    // --isolate: one row per test, printed at the end
+    vector<vector<string> > summary = {{"test", "result", "seconds", "user s", "system s", "peak RSS MB"}};
+    int failed = 0;
+
+    const char *group = NULL;
+    for (size_t t = 0; t < sizeof(suiteTests) / sizeof(suiteTests[0]); t++)
+    {
+        if (!selected(suiteTests[t], patterns))
+            continue;
+        if (group == NULL || strcmp(group, suiteTests[t].group) != 0)
+        {
+            cout << (group == NULL ? "" : "\n") << "==== Running " << suiteTests[t].group << " Tests ====\n\n";
+            group = suiteTests[t].group;
+        }
+        if (!isolate)
+            suiteTests[t].run(suite);
+        else
+        {
+            // The child sends back how long the test itself took, without
+            // the fork and exit around it
+            IsolatedRun run;
+            string error;
+            bool started = runIsolated(
+                [&]() {
+                    Timer timer;
+                    timer.start();
+                    suiteTests[t].run(suite);
+                    timer.stop();
+                    return to_string(timer.currtime());
+                },
+                cpu, run, error);
+            bool passed = started && run.exited && run.status == 0;
+            failed += !passed;
+            if (!started)
+                cerr << suiteTests[t].name << ": " << error << "\n";
+            else if (!passed)
+                cerr << suiteTests[t].name << ": child process ended with " << describeExit(run) << "\n\n";
+            summary.push_back({suiteTests[t].name, passed ? "passed" : started ? describeExit(run) : "not started",
+                               passed ? DatabaseTestSuite::cell(atof(run.output.c_str())) : "-",
+                               DatabaseTestSuite::cell(run.userSeconds), DatabaseTestSuite::cell(run.systemSeconds),
+                               DatabaseTestSuite::cell(run.peakRssKB / 1024.0)});
+        }
+        if (pause)
+        {
+            cout << "Press Enter to continue...\n";
+            getchar();
+        }
+    }
+
+    if (isolate)
+    {
+        suite.printComparison("Isolated runs", summary, "[run]");
+        cout << "\n";
+    }
 
     cout << "=============================================\n";
-    cout << "All tests completed.\n";
+    if (failed > 0)
+        cout << failed << " test" << (failed > 1 ? "s" : "") << " failed.\n";
+    else
+        cout << "All tests completed.\n";
     cout << "=============================================\n\n";
 
-    return 0;
+    return failed > 0 ? 1 : 0;
 }
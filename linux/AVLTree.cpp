@@ -1,24 +1,106 @@
 // AVLTree.cpp: AVL Tree Implementation in C++   */
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <climits>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <AVLTree.h>
+#include <AsyncWriter.h>
+#include <MemoryAccount.h>
+#include <WriteAheadLog.h>
 
 using namespace std;
 
-// extern ofstream outfile;
-ofstream outfile;
+// A running background checkpoint (see BasicAVL::startCheckpoint).
+struct CheckpointState
+{
+	mutex lock;	// held by each batch of the walk and by writes while it runs
+	thread worker;
+	string file;
+	size_t batch;
+	uint64_t lsn;
+	long long cursor;	// every key up to here has been written out
+	bool walkDone;
+	// What the tree held at the start for keys above the cursor written since
+	// (first is false if the key was absent)
+	map<int, pair<bool, EmployeeInfo> > preimage;
+	vector<float> stalls;	// microseconds each write waited, owner thread only
+	size_t captured;
+	size_t records;
+	double seconds;
+	bool ok;
+	atomic<bool> finished;
+};
+
+void *node::operator new(size_t size)
+{
+	void *p = ::operator new(size);
+	nodeMemory.allocated(size);
+	return p;
+}
+
+void *node::operator new[](size_t size)
+{
+	void *p = ::operator new[](size);
+	nodeMemory.allocated(size);
+	return p;
+}
+
+void node::operator delete(void *p, size_t size)
+{
+	nodeMemory.freed(size);
+	::operator delete(p);
+}
+
+void node::operator delete[](void *p, size_t size)
+{
+	nodeMemory.freed(size);
+	::operator delete[](p);
+}
 
-void AVL::makeEmpty(node *t)
+template <class Balance>
+void BasicAVL<Balance>::makeEmpty(node *t)
 {
+	if (t == root)
+	{ // Buffered writes belong to the tree being emptied; merged later they
+		// would bring its records back
+		vector<BufferEntry>().swap(log);
+		vector<BufferEntry>().swap(run);
+	}
+	if (t == NULL && t == root)
+	{ // A small tree or a snapshot has no nodes, only records
+		vector<EmployeeInfo>().swap(smallRecs);
+		vector<int>().swap(smallKeys);
+		closeSnapshot();
+	}
 	if (t == NULL)
 		return;
+	if (t->mirror <= TIER_STUB)
+		tierRelease(t); // Drop the spilled subtree without reading it back
 	makeEmpty(t->left);
 	makeEmpty(t->right);
-	delete t;
+	mirrorForget(t);
+	if (t == root)
+		setRoot(NULL); // The tree can be used again
+	freeNode(t);
 }
 
-int AVL::max(int a, int b)
+template <class Balance>
+int BasicAVL<Balance>::max(int a, int b)
 {
 	if (a > b)
 		return a;
@@ -26,7 +108,8 @@ int AVL::max(int a, int b)
 		return b;
 }
 
-int AVL::min(int a, int b)
+template <class Balance>
+int BasicAVL<Balance>::min(int a, int b)
 {
 	if (a < b)
 		return a;
@@ -34,266 +117,2379 @@ int AVL::min(int a, int b)
 		return b;
 }
 
-node *AVL::insert(EmployeeInfo empl, node *t)
+// Every heap node is made here; regionAlloc hands out the others.
+template <class Balance>
+node *BasicAVL<Balance>::newNode()
 {
-	if (t == NULL)
-	{
-		t = new node;
-		t->empl.salary = empl.salary;
-		t->empl.age = empl.age;
-		t->empl.emplNumber = empl.emplNumber;
-		t->empl.sin = empl.sin;
-		t->height = 0;
-		t->left = t->right = NULL;
-	}
-	else if (empl.sin < t->empl.sin)
-	{ // Go down the left tree
-		t->left = insert(empl, t->left);
-		if (height(t->left) - height(t->right) == 2)
-		{ // Left is higher than right by two
-			if (empl.sin < t->left->empl.sin)
-				t = singleRightRotate(t); // will go down the left subtree, do right rotate
-			else
-				t = doubleRightRotate(t); // will go down the right subtree, do left-right rotate
-		}
-	}
-	else if (empl.sin > t->empl.sin)
-	{ // Go down the right tree
-		t->right = insert(empl, t->right);
-		if (height(t->right) - height(t->left) == 2)
-		{ // Right is higher than left by two
-			if (empl.sin > t->right->empl.sin)
-				t = singleLeftRotate(t); // Will go down the right subtree, do left rotate
-			else
-				t = doubleLeftRotate(t); // Will go down the left subtree, do right-left rotate
-		}
-	}
-
-	t->height = max(height(t->left), height(t->right)) + 1;
+	node *t = new node;
+	nodeCount++;
+	if (memory != NULL)
+		memory->allocated(sizeof(node));
 	return t;
 }
 
-node *AVL::singleRightRotate(node *&t)
-{	//        8
-	//    4             12
-	// 2     6     10        14
-	// 1 3   5 7   9  11    13  15
-	node *u = t->left;
-	//          8
-	//    4(U)          12
-	// 2     6     10        14
-	// 1 3   5 7   9  11    13  15
-	t->left = u->right;
-	//          8
-	//    6          12
-	// 5     7     10        14
-	//            9  11    13  15
-	//---------------------------
-	//    4(U)
-	// 2     6
-	// 1 3   5 7
-	u->right = t;
-	//          4
-	//    2           8
-	// 1     3    6         12
-	//           5 7    10     14
-	//                 9  11 13  15
-	t->height = max(height(t->left), height(t->right)) + 1;
-	u->height = max(height(u->left), t->height) + 1;
-	return u;
-}
-
-node *AVL::singleLeftRotate(node *&t)
-{	//        8
-	//    4             12
-	// 2     6     10        14
-	// 1 3   5 7   9  11    13  15
-	node *u = t->right;
-	//          8
-	//    4             12(U)
-	// 2     6     10        14
-	// 1 3   5 7   9  11    13  15
-	t->right = u->left;
-	//          8
-	//    4        10
-	// 2     6   9   11
-	// 1 3   5 7
-	//-------------------------
-	//                  12(U)
-	//             10        14
-	//            9  11    13  15
-	u->left = t;
-	//              12
-	//       8              14
-	//   4      10     13        15
-	// 2   6   9  11
-	// 1 3 5 7
-	t->height = max(height(t->left), height(t->right)) + 1;
-	u->height = max(height(t->right), t->height) + 1;
-	return u;
-}
-
-node *AVL::doubleLeftRotate(node *&t)
-{ // Right rotate the right node, then left rotate the current node
-	t->right = singleRightRotate(t->right);
-	return singleLeftRotate(t);
+template <class Balance>
+node *BasicAVL<Balance>::insert(EmployeeInfo empl, node *t)
+{
+	Hooks hooks = {*this};
+	return insert(empl, t, hooks);
 }
 
-node *AVL::doubleRightRotate(node *&t)
-{ // Left rotate the left node, then right rotate the current node
-	t->left = singleLeftRotate(t->left);
-	return singleRightRotate(t);
+template <class Balance>
+template <class H>
+node *BasicAVL<Balance>::insert(EmployeeInfo empl, node *t, H &hooks)
+{
+	bool inserted = false;
+	auto make = [&]() {
+		node *n = newNode();
+		n->empl = empl;
+		n->height = 0;
+		n->mirror = -1;
+		n->left = n->right = NULL;
+		return n;
+	};
+	return insertAt(empl.sin, t, make, inserted, hooks);
 }
 
-node *AVL::findMin(node *t)
+template <class Balance>
+node *BasicAVL<Balance>::findMin(node *t)
 {
 	if (t == NULL)
 		return NULL;
-	else if (t->left == NULL)
+	tierVisit(t);
+	if (t->left == NULL)
 		return t;
 	else
 		return findMin(t->left);
 }
 
-node *AVL::findMax(node *t)
+template <class Balance>
+node *BasicAVL<Balance>::findMax(node *t)
 {
 	if (t == NULL)
 		return NULL;
-	else if (t->right == NULL)
+	tierVisit(t);
+	if (t->right == NULL)
 		return t;
 	else
 		return findMax(t->right);
 }
 
-node *AVL::remove(int sin, node *t)
+template <class Balance>
+node *BasicAVL<Balance>::remove(int sin, node *t)
+{
+	Hooks hooks = {*this};
+	return remove(sin, t, hooks);
+}
+
+template <class Balance>
+template <class H>
+node *BasicAVL<Balance>::remove(int sin, node *t, H &hooks)
+{
+	bool removed = false;
+	return removeAt(sin, t, removed, hooks);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::Hooks::visit(node *t)
+{
+	tree.tierVisit(t);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::Hooks::open(node *t)
+{
+	tree.tierOpen(t);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::Hooks::relink(node *t, node *&link, node *child)
+{
+	tree.relink(t, link, child);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::Hooks::moved(node *t)
+{
+	if (t->mirror >= 0)
+		tree.mirrorTouch(t->mirror); // The mirrored key changed
+}
+
+template <class Balance>
+void BasicAVL<Balance>::Hooks::rotated()
+{
+	tree.rotations++;
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::Hooks::afterInsert(node *t)
+{
+	// The subtree below t grew: let the balance policy repair t
+	tree.tierOpen(t->left);
+	tree.tierOpen(t->right);
+	return Balance::afterInsert(tree, *this, t);
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::Hooks::afterRemove(node *t)
+{
+	// The subtree below t shrank: let the balance policy repair t
+	tree.tierOpen(t->left);
+	tree.tierOpen(t->right);
+	return Balance::afterRemove(tree, *this, t);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::Hooks::destroy(node *t)
+{
+	tree.mirrorForget(t);
+	tree.freeNode(t);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::PlainHooks::visit(node *)
+{
+}
+
+template <class Balance>
+void BasicAVL<Balance>::PlainHooks::open(node *)
+{
+}
+
+template <class Balance>
+void BasicAVL<Balance>::PlainHooks::relink(node *, node *&link, node *child)
+{
+	link = child;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::PlainHooks::moved(node *)
+{
+}
+
+template <class Balance>
+void BasicAVL<Balance>::PlainHooks::rotated()
+{
+	tree.rotations++;
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::PlainHooks::afterInsert(node *t)
+{
+	return Balance::afterInsert(tree, *this, t);
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::PlainHooks::afterRemove(node *t)
+{
+	return Balance::afterRemove(tree, *this, t);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::PlainHooks::destroy(node *t)
 {
-	node *temp;
+	tree.freeNode(t);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::updateModes()
+{
+	plain = bufferThreshold == 0 && mirrorLevels == 0 && smallThreshold == 0 && snapHeader == NULL &&
+			wal == NULL && ckpt == NULL && tierFd < 0;
+}
 
-	// Element not found
+template <class Balance>
+int BasicAVL<Balance>::getBalance(node *t)
+{
 	if (t == NULL)
-		return NULL;
+		return 0;
+	tierOpen(t);
+	return height(t->left) - height(t->right);
+}
+
+template <class Balance>
+BasicAVL<Balance>::BasicAVL(MemoryAccount *account)
+{
+	root = NULL;
+	memory = account;
+	bufferThreshold = 0;
+	rotations = 0;
+	mirrorLevels = 0;
+	mirrorKeys = NULL;
+	fillBase = NULL;
+	compactActive = false;
+	compactCursor = 0;
+	smallThreshold = 0;
+	nodeCount = 0;
+	snapHeader = NULL;
+	snapNodes = NULL;
+	snapBytes = 0;
+	wal = NULL;
+	appliedLsn = 0;
+	ckpt = NULL;
+	tierFd = -1;
+	tierBudget = 0;
+	tierTick = 0;
+	tierTouched = 0;
+	tierPages = 0;
+	tierSpilled = 0;
+	updateModes();
+}
 
-	// Searching for element
-	else if (sin < t->empl.sin)
-		t->left = remove(sin, t->left);
-	else if (sin > t->empl.sin)
-		t->right = remove(sin, t->right);
+template <class Balance>
+BasicAVL<Balance>::~BasicAVL()
+{
+	// The checkpoint thread reads the nodes freed below
+	if (ckpt != NULL)
+		finishCheckpoint();
+	makeEmpty(root);
+	disableTiering(); // Closes the page file, nothing is left to read back
+	closeSnapshot();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::insert(EmployeeInfo empl)
+{
+	if (plain)
+	{ // None of the checks below applies
+		PlainHooks hooks = {*this};
+		root = insert(empl, root, hooks);
+		return;
+	}
+	if (snapHeader != NULL)
+		return; // Read-only
+	if (wal != NULL)
+	{ // Durable before it becomes visible
+		uint64_t lsn = wal->append(LOG_INSERT, empl);
+		if (!wal->commit(lsn))
+			return;
+		appliedLsn = lsn;
+	}
+	if (ckpt != NULL)
+		checkpointBegin(empl.sin);
+	if (tierFd >= 0)
+		tierBegin();
+	if (bufferThreshold > 0 && ckpt == NULL)
+		bufferWrite(empl, BUFFER_INSERT);
+	else if (smallActive())
+		smallInsert(empl);
+	else
+		setRoot(insert(empl, root));
+	if (ckpt != NULL)
+		checkpointEnd();
+}
 
-	// Element found
-	// With 2 children
-	else if (t->left && t->right)
+template <class Balance>
+void BasicAVL<Balance>::remove(int sin)
+{
+	if (plain)
+	{
+		PlainHooks hooks = {*this};
+		root = remove(sin, root, hooks);
+		return;
+	}
+	if (snapHeader != NULL)
+		return; // Read-only
+	if (wal != NULL)
+	{ // Durable before it becomes visible
+		EmployeeInfo empl;
+		empl.salary = empl.age = empl.emplNumber = 0;
+		empl.sin = sin;
+		uint64_t lsn = wal->append(LOG_REMOVE, empl);
+		if (!wal->commit(lsn))
+			return;
+		appliedLsn = lsn;
+	}
+	if (ckpt != NULL)
+		checkpointBegin(sin);
+	if (tierFd >= 0)
+		tierBegin();
+	if (bufferThreshold > 0 && ckpt == NULL)
 	{
-		temp = findMin(t->right);
-		t->empl.sin = temp->empl.sin;
-		t->right = remove(t->empl.sin, t->right);
+		EmployeeInfo empl;
+		empl.salary = empl.age = empl.emplNumber = 0;
+		empl.sin = sin;
+		bufferWrite(empl, BUFFER_REMOVE);
 	}
-	// With one or zero child
+	else if (smallActive())
+		smallRemove(sin);
 	else
 	{
-		temp = t;
-		if (t->left == NULL)
-			t = t->right;
-		else if (t->right == NULL)
-			t = t->left;
-		delete temp;
+		setRoot(remove(sin, root));
+		if (nodeCount <= smallThreshold / 2 && smallActive() == false && smallThreshold > 0
+			&& bufferThreshold == 0 && mirrorLevels == 0)
+			toSmall();
 	}
-	if (t == NULL)
-		return t;
+	if (ckpt != NULL)
+		checkpointEnd();
+}
 
-	t->height = max(height(t->left), height(t->right)) + 1;
+template <class Balance>
+void BasicAVL<Balance>::display(char file[]) {
+    exportTo(file, EXPORT_TEXT);
+}
 
-	// If node is unbalanced
-	// If left node is deleted, right case
-	if (height(t->left) - height(t->right) == 2)
+template <class Balance>
+node *BasicAVL<Balance>::GetRoot()
+{
+	return root;
+}
+template <class Balance>
+node *BasicAVL<Balance>::Find(node *node, int sin)
+{
+	if (plain)
 	{
-		// right right case
-		if (height(t->left->left) - height(t->left->right) == 1)
-			return singleLeftRotate(t);
-		// right left case
-		else
-			return doubleLeftRotate(t);
+		PlainHooks hooks = {*this};
+		return findAt(node, sin, hooks);
+	}
+	if (node == NULL && node == root && snapHeader != NULL)
+		return snapshotFind(sin);
+	if (node == NULL && node == root && !smallRecs.empty())
+		return smallFind(sin);
+	if (node == root && bufferedCount() > 0)
+		return bufferedFind(sin);
+	if (node == root && mirrorLevels > 0)
+		return mirrorFind(sin);
+	if (node == root && tierFd >= 0)
+		tierBegin();
+	Hooks hooks = {*this};
+	return findAt(node, sin, hooks);
+}
+
+template <class Balance>
+unsigned long BasicAVL<Balance>::getRotationCount()
+{
+	return rotations;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::resetRotationCount()
+{
+	rotations = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Top-levels mirror
+// ---------------------------------------------------------------------------
+
+// Slot of the left (dir 0) or right (dir 1) child of a mirror slot. Positions
+// 7..14 are the bottom level of a block and continue in a child block.
+static int mirrorChild(int slot, int dir)
+{
+	int block = slot / 16, i = slot % 16;
+	if (i < 7)
+		return block * 16 + 2 * i + 1 + dir;
+	return (block * 16 + 1 + 2 * (i - 7) + dir) * 16;
+}
+
+template <class Balance>
+int BasicAVL<Balance>::mirrorParent(int slot)
+{
+	int block = slot / 16, i = slot % 16;
+	if (i > 0)
+		return block * 16 + (i - 1) / 2;
+	if (block == 0)
+		return -1;
+	return (block - 1) / 16 * 16 + 7 + (block - 1) % 16 / 2;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::enableTopMirror(int levels)
+{
+	disableTiering();
+	toNodes();
+	disableTopMirror();
+	levels = (levels + 3) / 4 * 4;
+	mirrorLevels = levels < 4 ? 4 : (levels > 20 ? 20 : levels);
+	updateModes();
+	size_t blocks = 0;
+	for (int b = 0, width = 1; b < mirrorLevels / 4; b++, width *= 16)
+		blocks += width;
+	mirrorStore.assign(blocks * 16 + 16, 0);
+	mirrorKeys = (int *)(((uintptr_t)&mirrorStore[0] + 63) & ~(uintptr_t)63);
+	mirrorNodes.assign(blocks * 16, NULL);
+	slotDirty.assign(blocks * 16, 0);
+	mirrorTouch(0);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::disableTopMirror()
+{
+	if (mirrorLevels == 0)
+		return;
+	clearMirror(0, 0);
+	mirrorLevels = 0;
+	updateModes();
+	mirrorKeys = NULL;
+	vector<int>().swap(mirrorStore);
+	vector<node *>().swap(mirrorNodes);
+	vector<char>().swap(slotDirty);
+	dirtySlots.clear();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::setRoot(node *t)
+{
+	if (t != root)
+	{
+		root = t;
+		mirrorTouch(0);
 	}
-	// If right node is deleted, left case
-	else if (height(t->right) - height(t->left) == 2)
+}
+
+template <class Balance>
+void BasicAVL<Balance>::relink(node *t, node *&link, node *child)
+{
+	if (link != child)
 	{
-		// left left case
-		if (height(t->right->right) - height(t->right->left) == 1)
-			return singleRightRotate(t);
-		// left right case
-		else
-			return doubleRightRotate(t);
+		link = child;
+		if (t->mirror >= 0)
+			mirrorTouch(t->mirror);
+	}
+}
+
+template <class Balance>
+void BasicAVL<Balance>::mirrorTouch(int slot)
+{
+	if (mirrorLevels > 0 && !slotDirty[slot])
+	{
+		slotDirty[slot] = 1;
+		dirtySlots.push_back(slot);
 	}
-	return t;
 }
 
-int AVL::height(node *t)
+// Called before a node is freed, so the mirror never points at freed memory.
+// Its parent's link changes as well, which re-reads that part of the mirror.
+template <class Balance>
+void BasicAVL<Balance>::mirrorForget(node *t)
 {
-	return (t == NULL ? -1 : t->height);
+	if (t->mirror >= 0)
+	{
+		mirrorNodes[t->mirror] = NULL;
+		t->mirror = -1;
+	}
 }
 
-int AVL::getBalance(node *t)
+template <class Balance>
+void BasicAVL<Balance>::clearMirror(int slot, int depth)
 {
-	if (t == NULL)
-		return 0;
-	else
-		return height(t->left) - height(t->right);
+	int *mask = &mirrorKeys[slot / 16 * 16 + 15];
+	if (!(*mask >> slot % 16 & 1))
+		return; // Empty slots only have empty slots below them
+	*mask &= ~(1 << slot % 16);
+	if (mirrorNodes[slot] != NULL)
+	{
+		mirrorNodes[slot]->mirror = -1;
+		mirrorNodes[slot] = NULL;
+	}
+	if (depth + 1 < mirrorLevels)
+	{
+		clearMirror(mirrorChild(slot, 0), depth + 1);
+		clearMirror(mirrorChild(slot, 1), depth + 1);
+	}
 }
 
-void AVL::inorder(node *t)
+template <class Balance>
+void BasicAVL<Balance>::fillMirror(int slot, node *t, int depth)
 {
 	if (t == NULL)
 		return;
-	inorder(t->left);
-	outfile << " height:" << t->height << " sin:" << t->empl.sin << " employee number:" << t->empl.emplNumber << " salary:" << t->empl.salary << " age:" << t->empl.age << endl;
-	inorder(t->right);
+	mirrorKeys[slot] = t->empl.sin;
+	mirrorKeys[slot / 16 * 16 + 15] |= 1 << slot % 16;
+	mirrorNodes[slot] = t;
+	t->mirror = slot;
+	if (depth + 1 < mirrorLevels)
+	{
+		fillMirror(mirrorChild(slot, 0), t->left, depth + 1);
+		fillMirror(mirrorChild(slot, 1), t->right, depth + 1);
+	}
+}
+
+template <class Balance>
+void BasicAVL<Balance>::refreshMirror()
+{
+	for (size_t j = 0; j < dirtySlots.size(); j++)
+	{
+		int slot = dirtySlots[j];
+		// A dirty ancestor re-reads this slot as well
+		bool covered = false;
+		int depth = 0;
+		for (int p = mirrorParent(slot); p >= 0; p = mirrorParent(p))
+		{
+			depth++;
+			covered = covered || slotDirty[p];
+		}
+		if (covered)
+			continue;
+		// The parent is clean, so its link to this position is current
+		node *t = root;
+		int parent = mirrorParent(slot);
+		if (parent >= 0)
+		{
+			node *p = mirrorNodes[parent];
+			t = p == NULL ? NULL : (mirrorChild(parent, 0) == slot ? p->left : p->right);
+		}
+		clearMirror(slot, depth);
+		fillMirror(slot, t, depth);
+	}
+	for (size_t j = 0; j < dirtySlots.size(); j++)
+		slotDirty[dirtySlots[j]] = 0;
+	dirtySlots.clear();
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::mirrorFind(int sin)
+{
+	refreshMirror();
+	int slot = 0, dir = 0;
+	for (int b = 0, block = 0; b < mirrorLevels / 4; b++)
+	{
+		const int *keys = mirrorKeys + block * 16;
+		int mask = keys[15];
+		int i = 0;
+		for (int d = 0; d < 4; d++)
+		{
+			if (!(mask >> i & 1))
+				return NULL; // Empty subtree
+			if (sin == keys[i])
+				return mirrorNodes[block * 16 + i];
+			dir = sin > keys[i];
+			if (d < 3)
+				i = 2 * i + 1 + dir;
+		}
+		slot = block * 16 + i;
+		block = block * 16 + 1 + 2 * (i - 7) + dir;
+	}
+	// Below the mirror: continue by pointer chasing
+	node *t = mirrorNodes[slot];
+	t = dir ? t->right : t->left;
+	while (t != NULL && t->empl.sin != sin)
+		t = sin < t->empl.sin ? t->left : t->right;
+	return t;
+}
+
+// ---------------------------------------------------------------------------
+// Small trees
+// ---------------------------------------------------------------------------
+
+template <class Balance>
+void BasicAVL<Balance>::enableSmallMode(size_t threshold)
+{
+	disableTiering();
+	smallThreshold = threshold > 0 ? threshold : 1;
+	updateModes();
+	if (root != NULL && nodeCount <= smallThreshold / 2 && bufferThreshold == 0 && mirrorLevels == 0)
+		toSmall();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::disableSmallMode()
+{
+	toNodes();
+	smallThreshold = 0;
+	updateModes();
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::smallActive()
+{
+	return smallThreshold > 0 && root == NULL && bufferThreshold == 0 && mirrorLevels == 0 && ckpt == NULL;
+}
+
+// Number of records with a smaller sin. Branch-free so the compiler can
+// vectorize it; for a few dozen keys it beats a binary search.
+template <class Balance>
+size_t BasicAVL<Balance>::smallIndex(int sin)
+{
+	const int *keys = smallKeys.data();
+	size_t n = smallKeys.size(), i = 0;
+	for (size_t j = 0; j < n; j++)
+		i += keys[j] < sin;
+	return i;
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::smallFind(int sin)
+{
+	size_t i = smallIndex(sin);
+	if (i == smallKeys.size() || smallKeys[i] != sin)
+		return NULL;
+	hitCopy.empl = smallRecs[i];
+	hitCopy.left = hitCopy.right = NULL;
+	hitCopy.height = 0;
+	hitCopy.mirror = -1;
+	return &hitCopy;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::smallInsert(EmployeeInfo empl)
+{
+	size_t i = smallIndex(empl.sin);
+	if (i < smallKeys.size() && smallKeys[i] == empl.sin)
+		return; // Duplicate sin, as in insert()
+	if (smallKeys.size() >= smallThreshold)
+	{ // Outgrown: switch to nodes
+		toNodes();
+		setRoot(insert(empl, root));
+		return;
+	}
+	smallRecs.insert(smallRecs.begin() + i, empl);
+	smallKeys.insert(smallKeys.begin() + i, empl.sin);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::smallRemove(int sin)
+{
+	size_t i = smallIndex(sin);
+	if (i < smallKeys.size() && smallKeys[i] == sin)
+	{
+		smallRecs.erase(smallRecs.begin() + i);
+		smallKeys.erase(smallKeys.begin() + i);
+	}
+}
+
+template <class Balance>
+void BasicAVL<Balance>::toNodes()
+{
+	if (smallRecs.empty())
+		return;
+	vector<node *> nodes(smallRecs.size());
+	for (size_t i = 0; i < smallRecs.size(); i++)
+	{
+		nodes[i] = newNode();
+		nodes[i]->empl = smallRecs[i];
+		nodes[i]->mirror = -1;
+	}
+	setRoot(buildBalanced(nodes, 0, (int)nodes.size() - 1));
+	vector<EmployeeInfo>().swap(smallRecs);
+	vector<int>().swap(smallKeys);
 }
 
-AVL::AVL()
+template <class Balance>
+void BasicAVL<Balance>::toSmall()
 {
+	if (ckpt != NULL)
+		return; // The checkpoint walk needs the nodes
+	vector<node *> nodes;
+	collect(root, nodes);
+	smallRecs.resize(nodes.size());
+	smallKeys.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		smallRecs[i] = nodes[i]->empl;
+		smallKeys[i] = nodes[i]->empl.sin;
+		freeNode(nodes[i]);
+	}
 	root = NULL;
 }
 
-void AVL::insert(EmployeeInfo empl)
+// ---------------------------------------------------------------------------
+// Binary snapshots
+// ---------------------------------------------------------------------------
+
+static const char SNAPSHOT_MAGIC[8] = "AVLSNAP";
+
+static uint32_t crc32cTable[256];
+
+static void crc32cInit()
 {
-	root = insert(empl, root);
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++)
+			c = (c >> 1) ^ (0x82F63B78 & (0 - (c & 1)));
+		crc32cTable[i] = c;
+	}
 }
 
-void AVL::remove(int sin)
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const unsigned char *p, size_t n)
 {
-	root = remove(sin, root);
+	for (; n >= 8; p += 8, n -= 8)
+	{
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = (uint32_t)__builtin_ia32_crc32di(crc, v);
+	}
+	for (; n > 0; p++, n--)
+		crc = __builtin_ia32_crc32qi(crc, *p);
+	return crc;
 }
+#endif
 
-void AVL::display(char file[]) {
-    outfile.open(file);
-    inorder(root);
-    outfile << endl;
-    outfile.close();
+// Uses the SSE4.2 instruction when the CPU has it.
+uint32_t crc32c(uint32_t crc, const void *data, size_t n)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	crc = ~crc;
+#if defined(__GNUC__) && defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2"))
+		return ~crc32cHardware(crc, p, n);
+#endif
+	static const bool tableReady = (crc32cInit(), true); // thread-safe once
+	(void)tableReady;
+	for (; n > 0; p++, n--)
+		crc = crc32cTable[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+	return ~crc;
 }
 
-node *AVL::GetRoot()
+static uint32_t snapshotHeaderCrc(const SnapshotHeader &h)
 {
-	return root;
+	return crc32c(0, &h, offsetof(SnapshotHeader, headerCrc));
 }
-node *AVL::Find(node *node, int sin)
+
+// Writes the n records of recs (sorted by sin) as a snapshot file.
+static bool writeSnapshot(const char *file, const EmployeeInfo *recs, size_t n, uint64_t lsn)
 {
-	if (node == NULL)
+	// Written to a temporary name and renamed, so a crash never leaves a
+	// half-written snapshot under the real name.
+	string tmp = string(file) + ".tmp";
+	AsyncWriter out;
+	if (!out.open(tmp.c_str()))
+		return false;
+	SnapshotHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+	h.version = SNAPSHOT_VERSION;
+	h.nodeSize = sizeof(SnapshotNode);
+	h.count = n;
+	h.lsn = lsn;
+	out.write(&h, sizeof(h));
+
+	// Lay the balanced tree over recs out level by level: ranges are queued in
+	// BFS order and a record's index is its range's position in the queue.
+	vector<pair<int, int> > ranges;
+	ranges.reserve(n);
+	if (n > 0)
+		ranges.push_back(make_pair(0, (int)n - 1));
+	vector<SnapshotNode> chunk;
+	chunk.reserve(65536);
+	for (size_t i = 0; i < ranges.size(); i++)
 	{
-		/* Element is not found */
-		return NULL;
+		int lo = ranges[i].first, hi = ranges[i].second;
+		int mid = lo + (hi - lo) / 2;
+		SnapshotNode rec;
+		rec.empl = recs[mid];
+		rec.left = rec.right = -1;
+		if (lo < mid)
+		{
+			rec.left = (int32_t)ranges.size();
+			ranges.push_back(make_pair(lo, mid - 1));
+		}
+		if (mid < hi)
+		{
+			rec.right = (int32_t)ranges.size();
+			ranges.push_back(make_pair(mid + 1, hi));
+		}
+		chunk.push_back(rec);
+		if (chunk.size() == chunk.capacity() || i + 1 == ranges.size())
+		{
+			h.dataCrc = crc32c(h.dataCrc, chunk.data(), chunk.size() * sizeof(SnapshotNode));
+			out.write(chunk.data(), chunk.size() * sizeof(SnapshotNode));
+			chunk.clear();
+		}
 	}
-	if (sin > node->empl.sin)
+	h.headerCrc = snapshotHeaderCrc(h);
+	bool ok = out.writeAt(0, &h, sizeof(h));
+	ok = out.close() && ok;
+	if (!ok || rename(tmp.c_str(), file) != 0)
 	{
-		/* Search in the right sub tree. */
-		return Find(node->right, sin);
+		unlink(tmp.c_str());
+		return false;
 	}
-	else if (sin < node->empl.sin)
+	return true;
+}
+
+
+template <class Balance>
+bool BasicAVL<Balance>::saveSnapshot(const char *file)
+{
+	flushWriteBuffer();
+	tierLoadAll(root);
+	vector<EmployeeInfo> recs;
+	if (snapHeader != NULL)
+		snapshotRecords(recs);
+	else if (root != NULL)
 	{
-		/* Search in the left sub tree. */
-		return Find(node->left, sin);
+		vector<node *> nodes;
+		collect(root, nodes);
+		recs.resize(nodes.size());
+		for (size_t i = 0; i < nodes.size(); i++)
+			recs[i] = nodes[i]->empl;
 	}
 	else
+		recs = smallRecs;
+	return writeSnapshot(file, recs.data(), recs.size(), appliedLsn);
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::openSnapshot(const char *file, bool verify)
+{
+	if (root != NULL || !smallRecs.empty() || bufferedCount() > 0 || snapHeader != NULL)
+		return false;
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SnapshotHeader))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	const SnapshotHeader *h = (const SnapshotHeader *)map;
+	const SnapshotNode *nodes = (const SnapshotNode *)(h + 1);
+	bool ok = memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) == 0
+		&& h->version == SNAPSHOT_VERSION && h->nodeSize == sizeof(SnapshotNode)
+		&& h->headerCrc == snapshotHeaderCrc(*h) && h->count <= INT32_MAX
+		&& (size_t)st.st_size == sizeof(SnapshotHeader) + h->count * sizeof(SnapshotNode);
+	if (ok && verify)
+		ok = h->dataCrc == crc32c(0, nodes, h->count * sizeof(SnapshotNode));
+	if (!ok)
+	{
+		munmap(map, st.st_size);
+		return false;
+	}
+	// Lookups touch one record per level, readahead would only waste I/O
+	madvise(map, st.st_size, MADV_RANDOM);
+	snapHeader = h;
+	snapNodes = nodes;
+	snapBytes = st.st_size;
+	updateModes();
+	appliedLsn = h->lsn;
+	return true;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::closeSnapshot()
+{
+	if (snapHeader == NULL)
+		return;
+	munmap((void *)snapHeader, snapBytes);
+	snapHeader = NULL;
+	snapNodes = NULL;
+	snapBytes = 0;
+	updateModes();
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::snapshotOpen()
+{
+	return snapHeader != NULL;
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::snapshotFind(int sin)
+{
+	// Indices are range-checked and the descent is bounded by the height of
+	// a balanced tree, so an unverified file cannot send us out of the mapping.
+	uint64_t count = snapHeader->count;
+	int64_t i = count > 0 ? 0 : -1;
+	for (int depth = 0; i >= 0 && (uint64_t)i < count && depth < 64; depth++)
 	{
-		/* Element Found */
-		return node;
+		const SnapshotNode &n = snapNodes[i];
+		if (sin == n.empl.sin)
+		{
+			hitCopy.empl = n.empl;
+			hitCopy.left = hitCopy.right = NULL;
+			hitCopy.height = 0;
+			hitCopy.mirror = -1;
+			return &hitCopy;
+		}
+		i = sin < n.empl.sin ? n.left : n.right;
 	}
-}
\ No newline at end of file
+	return NULL;
+}
+
+// The snapshot's records in key order, appended to out.
+template <class Balance>
+void BasicAVL<Balance>::snapshotRecords(vector<EmployeeInfo> &out)
+{
+	uint64_t count = snapHeader->count;
+	vector<int32_t> stack;
+	int32_t i = count > 0 ? 0 : -1;
+	while ((i >= 0 && (uint64_t)i < count) || !stack.empty())
+	{
+		if (i >= 0 && (uint64_t)i < count && stack.size() < 64)
+		{
+			stack.push_back(i);
+			i = snapNodes[i].left;
+			continue;
+		}
+		i = stack.back();
+		stack.pop_back();
+		out.push_back(snapNodes[i].empl);
+		i = snapNodes[i].right;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Export
+// ---------------------------------------------------------------------------
+
+static const char EXPORT_MAGIC[8] = "AVLRECS";
+static const uint32_t EXPORT_VERSION = 1;
+static const int EXPORT_SPLIT_DEPTH = 10;	// up to 1024 subtrees per export
+static const size_t EXPORT_FLAT_PIECE = 16384;	// records per piece of a flat run
+
+// A unit of export work, in key order: a whole subtree, a single node, or a
+// run of records of a small tree or snapshot.
+struct ExportPiece
+{
+	node *t;
+	bool single;
+	const EmployeeInfo *recs;
+	size_t n;
+};
+
+static void splitForExport(node *t, int depth, vector<ExportPiece> &out)
+{
+	if (t == NULL)
+		return;
+	if (depth == 0)
+	{
+		ExportPiece p = {t, false, NULL, 0};
+		out.push_back(p);
+		return;
+	}
+	splitForExport(t->left, depth - 1, out);
+	ExportPiece p = {t, true, NULL, 0};
+	out.push_back(p);
+	splitForExport(t->right, depth - 1, out);
+}
+
+static char *appendText(char *p, const char *s)
+{
+	while (*s)
+		*p++ = *s++;
+	return p;
+}
+
+static char *appendInt(char *p, int v)
+{
+	return to_chars(p, p + 12, v).ptr;
+}
+
+static void formatRecord(string &out, const EmployeeInfo &e, int height, ExportFormat format)
+{
+	char buf[160];
+	char *p = buf;
+	switch (format)
+	{
+	case EXPORT_CSV:
+		p = appendInt(p, e.sin);
+		*p++ = ',';
+		p = appendInt(p, e.emplNumber);
+		*p++ = ',';
+		p = appendInt(p, e.salary);
+		*p++ = ',';
+		p = appendInt(p, e.age);
+		*p++ = '\n';
+		break;
+	case EXPORT_JSONL:
+		p = appendInt(appendText(p, "{\"sin\":"), e.sin);
+		p = appendInt(appendText(p, ",\"emplNumber\":"), e.emplNumber);
+		p = appendInt(appendText(p, ",\"salary\":"), e.salary);
+		p = appendInt(appendText(p, ",\"age\":"), e.age);
+		p = appendText(p, "}\n");
+		break;
+	case EXPORT_BINARY:
+		memcpy(p, &e, sizeof(e));
+		p += sizeof(e);
+		break;
+	case EXPORT_TEXT:
+		p = appendInt(appendText(p, " height:"), height);
+		p = appendInt(appendText(p, " sin:"), e.sin);
+		p = appendInt(appendText(p, " employee number:"), e.emplNumber);
+		p = appendInt(appendText(p, " salary:"), e.salary);
+		p = appendInt(appendText(p, " age:"), e.age);
+		*p++ = '\n';
+		break;
+	}
+	out.append(buf, p - buf);
+}
+
+static void formatSubtree(node *t, string &out, ExportFormat format)
+{
+	if (t == NULL)
+		return;
+	formatSubtree(t->left, out, format);
+	formatRecord(out, t->empl, t->height, format);
+	formatSubtree(t->right, out, format);
+}
+
+static void formatPiece(const ExportPiece &p, string &out, ExportFormat format)
+{
+	if (p.recs != NULL)
+		for (size_t i = 0; i < p.n; i++)
+			formatRecord(out, p.recs[i], 0, format);
+	else if (p.single)
+		formatRecord(out, p.t->empl, p.t->height, format);
+	else
+		formatSubtree(p.t, out, format);
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::exportTo(const char *file, ExportFormat format, int threads)
+{
+	flushWriteBuffer();
+	tierLoadAll(root);
+	AsyncWriter out;
+	if (!out.open(file))
+		return false;
+	if (format == EXPORT_BINARY)
+	{
+		uint32_t recordSize = sizeof(EmployeeInfo);
+		out.write(EXPORT_MAGIC, sizeof(EXPORT_MAGIC));
+		out.write(&EXPORT_VERSION, sizeof(EXPORT_VERSION));
+		out.write(&recordSize, sizeof(recordSize));
+	}
+	else if (format == EXPORT_CSV)
+		out.write(string("sin,emplNumber,salary,age\n"));
+
+	vector<ExportPiece> pieces;
+	vector<EmployeeInfo> flat;
+	if (root != NULL)
+		splitForExport(root, EXPORT_SPLIT_DEPTH, pieces);
+	else
+	{
+		if (snapHeader != NULL)
+			snapshotRecords(flat);
+		const vector<EmployeeInfo> &recs = snapHeader != NULL ? flat : smallRecs;
+		for (size_t i = 0; i < recs.size(); i += EXPORT_FLAT_PIECE)
+		{
+			ExportPiece p = {NULL, false, &recs[i], std::min(EXPORT_FLAT_PIECE, recs.size() - i)};
+			pieces.push_back(p);
+		}
+	}
+
+	// Workers format pieces into chunks, at most window pieces ahead of the
+	// writer, and this thread writes the chunks in order
+	if (threads <= 0)
+		threads = std::max(1u, thread::hardware_concurrency());
+	size_t window = threads * 4;
+	vector<string> chunks(pieces.size());
+	vector<char> ready(pieces.size(), 0);
+	size_t next = 0, written = 0;
+	mutex lock;
+	condition_variable changed;
+	vector<thread> workers;
+	for (int w = 0; w < threads; w++)
+		workers.push_back(thread([&]() {
+			unique_lock<mutex> guard(lock);
+			while (true)
+			{
+				while (next < pieces.size() && next >= written + window)
+					changed.wait(guard);
+				if (next >= pieces.size())
+					return;
+				size_t i = next++;
+				guard.unlock();
+				string chunk;
+				formatPiece(pieces[i], chunk, format);
+				guard.lock();
+				chunks[i].swap(chunk);
+				ready[i] = 1;
+				changed.notify_all();
+			}
+		}));
+	for (size_t i = 0; i < pieces.size(); i++)
+	{
+		string chunk;
+		{
+			unique_lock<mutex> guard(lock);
+			while (!ready[i])
+				changed.wait(guard);
+			chunk.swap(chunks[i]);
+			written = i + 1;
+			changed.notify_all();
+		}
+		out.write(chunk);
+	}
+	for (size_t w = 0; w < workers.size(); w++)
+		workers[w].join();
+	if (format == EXPORT_TEXT)
+		out.write(string("\n"));
+	return out.close();
+}
+
+// ---------------------------------------------------------------------------
+// Import
+// ---------------------------------------------------------------------------
+
+static const size_t IMPORT_CHUNK_BYTES = 32 << 20;	// upper bound on a parse chunk
+
+// Parses a decimal int at p, taking eight digits at a time with SWAR
+// arithmetic on a 64-bit word. Returns the position after the number, or
+// NULL if there is none or it does not fit in an int.
+static const char *parseInt(const char *p, const char *end, int &out)
+{
+	bool negative = p < end && *p == '-';
+	p += negative;
+	const char *start = p;
+	uint64_t v = 0;
+	if (end - p >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, p, 8);
+		uint64_t d = word - 0x3030303030303030ULL;
+		// Top bit of each byte that is not a digit (bytes after the first
+		// such one may be wrong, but only the first matters)
+		uint64_t nonDigit = ((d + 0x7676767676767676ULL) | d) & 0x8080808080808080ULL;
+		int len = nonDigit == 0 ? 8 : __builtin_ctzll(nonDigit) / 8;
+		if (len > 0)
+		{
+			d <<= 8 * (8 - len); // Pad with leading zeros
+			d = d * 10 + (d >> 8);
+			d = (((d & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+				 (((d >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+			v = d;
+			p += len;
+		}
+		if (len < 8)
+		{
+			out = negative ? -(int)v : (int)v;
+			return p > start ? p : NULL;
+		}
+	}
+	while (p < end && (unsigned)(*p - '0') < 10)
+	{
+		v = v * 10 + (*p++ - '0');
+		if (v > (uint64_t)INT_MAX + 1)
+			return NULL;
+	}
+	if (p == start || v > (uint64_t)INT_MAX + negative)
+		return NULL;
+	out = (int)(negative ? -(int64_t)v : (int64_t)v);
+	return p;
+}
+
+// A range of the input and the records parsed from it, sorted by sin.
+struct ImportChunk
+{
+	const char *begin;
+	const char *end;
+	vector<EmployeeInfo> recs;
+	bool ok;
+};
+
+// Parses the CSV lines of c (sin,emplNumber,salary,age). A line that does
+// not start with a number (the header) is skipped when it is the file's first.
+static void parseCsvChunk(ImportChunk &c, const char *fileBegin)
+{
+	const char *p = c.begin;
+	if (p == fileBegin && p < c.end && *p != '-' && (unsigned)(*p - '0') >= 10)
+		while (p < c.end && *p++ != '\n')
+			;
+	c.ok = true;
+	while (p < c.end)
+	{
+		if (*p == '\n' || *p == '\r')
+		{ // Blank line
+			p++;
+			continue;
+		}
+		EmployeeInfo e;
+		int *fields[] = {&e.sin, &e.emplNumber, &e.salary, &e.age};
+		for (int f = 0; f < 4 && p != NULL; f++)
+		{
+			if (f > 0)
+				p = p < c.end && *p == ',' ? p + 1 : NULL;
+			if (p != NULL)
+				p = parseInt(p, c.end, *fields[f]);
+		}
+		if (p != NULL && p < c.end && *p == '\r')
+			p++;
+		if (p == NULL || (p < c.end && *p != '\n'))
+		{
+			c.ok = false;
+			return;
+		}
+		p++;
+		c.recs.push_back(e);
+	}
+}
+
+static bool recordLess(const EmployeeInfo &a, const EmployeeInfo &b)
+{
+	return a.sin < b.sin;
+}
+
+static void parseChunk(ImportChunk &c, const char *fileBegin, ExportFormat format)
+{
+	if (format == EXPORT_CSV)
+		parseCsvChunk(c, fileBegin);
+	else
+	{
+		size_t n = (c.end - c.begin) / sizeof(EmployeeInfo);
+		c.recs.resize(n);
+		memcpy(c.recs.data(), c.begin, n * sizeof(EmployeeInfo));
+		c.ok = true;
+	}
+	// Stable, so the first of several records with one sin stays first
+	stable_sort(c.recs.begin(), c.recs.end(), recordLess);
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::importFrom(const char *file, ExportFormat format, int threads)
+{
+	if (snapHeader != NULL || (format != EXPORT_CSV && format != EXPORT_BINARY))
+		return false;
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		st.st_size = -1;
+	if (st.st_size <= 0)
+	{ // Nothing to map; an empty CSV holds no records, a binary file needs its header
+		close(fd);
+		return st.st_size == 0 && format == EXPORT_CSV;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	const char *begin = (const char *)map, *end = begin + st.st_size;
+	if (format == EXPORT_BINARY)
+	{
+		uint32_t version, recordSize;
+		const size_t header = sizeof(EXPORT_MAGIC) + 2 * sizeof(uint32_t);
+		bool ok = (size_t)st.st_size >= header && memcmp(begin, EXPORT_MAGIC, sizeof(EXPORT_MAGIC)) == 0;
+		if (ok)
+		{
+			memcpy(&version, begin + sizeof(EXPORT_MAGIC), sizeof(version));
+			memcpy(&recordSize, begin + sizeof(EXPORT_MAGIC) + sizeof(version), sizeof(recordSize));
+			ok = version == EXPORT_VERSION && recordSize == sizeof(EmployeeInfo) &&
+				 (st.st_size - header) % sizeof(EmployeeInfo) == 0;
+		}
+		if (!ok)
+		{
+			munmap(map, st.st_size);
+			return false;
+		}
+		begin += header;
+	}
+
+	// Cut the input into chunks on record boundaries
+	if (threads <= 0)
+		threads = std::max(1u, thread::hardware_concurrency());
+	size_t bytes = end - begin;
+	size_t count = std::max((size_t)threads * 4, bytes / IMPORT_CHUNK_BYTES + 1);
+	vector<ImportChunk> chunks;
+	const char *p = begin;
+	for (size_t k = 1; k <= count && p < end; k++)
+	{
+		const char *cut = k == count ? end : begin + bytes / count * k;
+		if (format == EXPORT_BINARY)
+			cut = begin + (cut - begin) / sizeof(EmployeeInfo) * sizeof(EmployeeInfo);
+		else
+			while (cut < end && cut[-1] != '\n')
+				cut++;
+		if (cut <= p)
+			continue;
+		ImportChunk c;
+		c.begin = p;
+		c.end = cut;
+		c.ok = false;
+		chunks.push_back(c);
+		p = cut;
+	}
+
+	// Parse and sort the chunks in parallel
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	for (int w = 0; w < threads; w++)
+		workers.push_back(thread([&]() {
+			for (size_t i = next++; i < chunks.size(); i = next++)
+				parseChunk(chunks[i], (const char *)map, format);
+		}));
+	for (size_t w = 0; w < workers.size(); w++)
+		workers[w].join();
+	munmap(map, st.st_size);
+	for (size_t i = 0; i < chunks.size(); i++)
+		if (!chunks[i].ok)
+			return false;
+
+	// Merge the sorted chunks; on equal sins the record from the earlier
+	// chunk wins, as it would with insert(). An empty tree is built directly
+	// from the merged stream, in key order into fresh regions, in O(n).
+	bool bulk = root == NULL && smallRecs.empty() && bufferedCount() == 0 && regions.empty() && wal == NULL &&
+				ckpt == NULL;
+	vector<node *> blocks;
+	long built = 0;
+	typedef pair<int, size_t> Head; // sin, chunk
+	priority_queue<Head, vector<Head>, greater<Head> > heads;
+	vector<size_t> pos(chunks.size(), 0);
+	for (size_t c = 0; c < chunks.size(); c++)
+		if (!chunks[c].recs.empty())
+			heads.push(Head(chunks[c].recs[0].sin, c));
+	while (!heads.empty())
+	{
+		size_t c = heads.top().second;
+		heads.pop();
+		EmployeeInfo e = chunks[c].recs[pos[c]++];
+		if (pos[c] < chunks[c].recs.size())
+			heads.push(Head(chunks[c].recs[pos[c]].sin, c));
+		else
+			vector<EmployeeInfo>().swap(chunks[c].recs); // Done with it
+		if (!bulk)
+			insert(e);
+		else if (built == 0 || e.sin != blocks.back()[(built - 1) % REGION_NODES].empl.sin)
+		{
+			node *t = regionAlloc();
+			if (built % REGION_NODES == 0)
+				blocks.push_back(t);
+			t->empl = e;
+			t->mirror = -1;
+			built++;
+		}
+	}
+	if (bulk && built > 0)
+	{
+		setRoot(linkRegions(blocks, 0, built - 1));
+		if (smallThreshold > 0 && nodeCount <= smallThreshold && bufferThreshold == 0 && mirrorLevels == 0)
+			toSmall();
+	}
+	return true;
+}
+
+// Links the built nodes, held in key order in consecutive regions, into a
+// balanced tree.
+template <class Balance>
+node *BasicAVL<Balance>::linkRegions(vector<node *> &blocks, long lo, long hi)
+{
+	if (lo > hi)
+		return NULL;
+	long mid = lo + (hi - lo) / 2;
+	node *t = blocks[mid / REGION_NODES] + mid % REGION_NODES;
+	t->left = linkRegions(blocks, lo, mid - 1);
+	t->right = linkRegions(blocks, mid + 1, hi);
+	t->height = max(height(t->left), height(t->right)) + 1;
+	return t;
+}
+
+// ---------------------------------------------------------------------------
+// Write-ahead log
+// ---------------------------------------------------------------------------
+
+template <class Balance>
+void BasicAVL<Balance>::attachLog(WriteAheadLog *log)
+{
+	wal = log;
+	updateModes();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::detachLog()
+{
+	wal = NULL;
+	updateModes();
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::recover(const char *snapshotFile, const char *logFile)
+{
+	if (root != NULL || !smallRecs.empty() || bufferedCount() > 0 || snapHeader != NULL || wal != NULL)
+		return false;
+	appliedLsn = 0;
+	if (snapshotFile != NULL && access(snapshotFile, F_OK) == 0)
+	{ // Load the records as one sorted run; toNodes() builds a balanced tree
+		if (!openSnapshot(snapshotFile, true))
+			return false;
+		snapshotRecords(smallRecs);
+		closeSnapshot();
+		smallKeys.resize(smallRecs.size());
+		for (size_t i = 0; i < smallRecs.size(); i++)
+			smallKeys[i] = smallRecs[i].sin;
+		if (!smallActive() || smallRecs.size() > smallThreshold)
+			toNodes();
+	}
+	LogReader reader;
+	LogEntry e;
+	if (logFile != NULL && reader.open(logFile))
+		while (reader.next(e))
+		{
+			if (e.lsn <= appliedLsn)
+				continue; // Already in the snapshot
+			if (e.op == LOG_INSERT)
+				insert(e.empl);
+			else
+				remove(e.empl.sin);
+			appliedLsn = e.lsn;
+		}
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Background checkpoints
+// ---------------------------------------------------------------------------
+
+template <class Balance>
+bool BasicAVL<Balance>::startCheckpoint(const char *file, size_t batch)
+{
+	if (ckpt != NULL || snapHeader != NULL)
+		return false;
+	// The walk reads nodes only: empty the buffer and leave small mode, and
+	// keep it that way until the checkpoint is finished; bring back spilled
+	// subtrees too, eviction is suspended until then
+	flushWriteBuffer();
+	tierLoadAll(root);
+	toNodes();
+	ckpt = new CheckpointState;
+	updateModes();
+	ckpt->file = file;
+	ckpt->batch = batch > 0 ? batch : 1;
+	ckpt->lsn = appliedLsn;
+	ckpt->cursor = LLONG_MIN;
+	ckpt->walkDone = false;
+	ckpt->captured = 0;
+	ckpt->records = 0;
+	ckpt->seconds = 0;
+	ckpt->ok = false;
+	ckpt->finished = false;
+	ckpt->worker = thread(&BasicAVL<Balance>::checkpointRun, this);
+	return true;
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::checkpointRunning()
+{
+	return ckpt != NULL && !ckpt->finished;
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::finishCheckpoint(CheckpointStats *stats)
+{
+	if (ckpt == NULL)
+		return false;
+	ckpt->worker.join();
+	if (stats != NULL)
+	{
+		vector<float> &v = ckpt->stalls;
+		sort(v.begin(), v.end());
+		stats->records = ckpt->records;
+		stats->captured = ckpt->captured;
+		stats->writes = v.size();
+		stats->seconds = ckpt->seconds;
+		stats->stallP50 = v.empty() ? 0 : v[v.size() / 2];
+		stats->stallP99 = v.empty() ? 0 : v[v.size() * 99 / 100];
+		stats->stallP999 = v.empty() ? 0 : v[v.size() * 999 / 1000];
+		stats->stallMax = v.empty() ? 0 : v.back();
+	}
+	bool ok = ckpt->ok;
+	delete ckpt;
+	ckpt = NULL;
+	updateModes();
+	return ok;
+}
+
+// Called by insert/remove while a checkpoint runs: waits for the walk's
+// current batch, then saves the key's start-time state if the walk has not
+// written it yet. The lock is held until checkpointEnd().
+template <class Balance>
+void BasicAVL<Balance>::checkpointBegin(int sin)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	ckpt->lock.lock();
+	if (!ckpt->walkDone && sin > ckpt->cursor && ckpt->preimage.count(sin) == 0)
+	{
+		node *t = Find(root, sin);
+		ckpt->preimage[sin] = t != NULL ? make_pair(true, t->empl) : make_pair(false, EmployeeInfo());
+		ckpt->captured++;
+	}
+	ckpt->stalls.push_back(chrono::duration<float, micro>(chrono::steady_clock::now() - start).count());
+}
+
+template <class Balance>
+void BasicAVL<Balance>::checkpointEnd()
+{
+	ckpt->lock.unlock();
+}
+
+// The checkpoint thread. Streams the start-time records in key order to a
+// side file, batch by batch, then lays them out as a snapshot.
+template <class Balance>
+void BasicAVL<Balance>::checkpointRun()
+{
+	CheckpointState &c = *ckpt;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	string sorted = c.file + ".sorted";
+	AsyncWriter out;
+	bool opened = out.open(sorted.c_str());
+	vector<EmployeeInfo> recs, merged;
+	vector<pair<int, pair<bool, EmployeeInfo> > > pulled;
+	vector<node *> stack;
+	bool done = false, ok = opened;
+	while (!done && ok)
+	{
+		recs.clear();
+		pulled.clear();
+		merged.clear();
+		{
+			lock_guard<mutex> guard(c.lock);
+			// Resume the in-order walk at the first key above the cursor
+			stack.clear();
+			for (node *t = root; t != NULL;)
+			{
+				if (t->empl.sin > c.cursor)
+				{
+					stack.push_back(t);
+					t = t->left;
+				}
+				else
+					t = t->right;
+			}
+			while (!stack.empty() && recs.size() < c.batch)
+			{
+				node *t = stack.back();
+				stack.pop_back();
+				recs.push_back(t->empl);
+				for (t = t->right; t != NULL; t = t->left)
+					stack.push_back(t);
+			}
+			done = stack.empty();
+			long long last = done ? LLONG_MAX : recs.back().sin;
+			// Pre-images up to last are final now: no write can add one
+			while (!c.preimage.empty() && c.preimage.begin()->first <= last)
+			{
+				pulled.push_back(*c.preimage.begin());
+				c.preimage.erase(c.preimage.begin());
+			}
+			c.cursor = last;
+			c.walkDone = done;
+		}
+		// A pre-image replaces whatever the tree holds now for its key
+		size_t i = 0, j = 0;
+		while (i < recs.size() || j < pulled.size())
+		{
+			if (j == pulled.size() || (i < recs.size() && recs[i].sin < pulled[j].first))
+				merged.push_back(recs[i++]);
+			else
+			{
+				if (i < recs.size() && recs[i].sin == pulled[j].first)
+					i++;
+				if (pulled[j].second.first)
+					merged.push_back(pulled[j].second.second);
+				j++;
+			}
+		}
+		ok = out.write(merged.data(), merged.size() * sizeof(EmployeeInfo));
+		c.records += merged.size();
+	}
+	if (!done)
+	{ // The side file cannot be opened or written: give up, and stop the
+		// writers from saving pre-images for a walk that will not finish
+		lock_guard<mutex> guard(c.lock);
+		c.walkDone = true;
+		c.preimage.clear();
+	}
+	ok = out.close() && ok;
+	if (ok)
+	{
+		size_t bytes = c.records * sizeof(EmployeeInfo);
+		void *map = NULL;
+		int fd = open(sorted.c_str(), O_RDONLY);
+		if (fd >= 0 && bytes > 0)
+			map = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (fd >= 0)
+			close(fd);
+		if (map == MAP_FAILED || (bytes > 0 && map == NULL))
+			ok = false;
+		else
+		{
+			ok = writeSnapshot(c.file.c_str(), (const EmployeeInfo *)map, c.records, c.lsn);
+			if (map != NULL)
+				munmap(map, bytes);
+		}
+	}
+	if (opened)
+		unlink(sorted.c_str());
+	c.ok = ok;
+	c.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	c.finished = true;
+}
+
+// ---------------------------------------------------------------------------
+// Tiered storage
+// ---------------------------------------------------------------------------
+
+// A spilled subtree as stored in its page: a uint32 record count, then the
+// records in preorder, the stub's own record first.
+struct TierRecord
+{
+	EmployeeInfo empl;
+	int32_t meta;	// height, plus TIER_HAS_LEFT / TIER_HAS_RIGHT
+};
+
+static const int32_t TIER_HAS_LEFT = 1 << 16;
+static const int32_t TIER_HAS_RIGHT = 1 << 17;
+
+template <class Balance>
+bool BasicAVL<Balance>::enableTiering(const char *pageFile, size_t budgetBytes)
+{
+	if (tierFd >= 0 || snapHeader != NULL || ckpt != NULL || bufferThreshold > 0 || mirrorLevels > 0 ||
+		smallThreshold > 0)
+		return false;
+	toNodes();
+	tierFd = open(pageFile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (tierFd < 0)
+		return false;
+	// Nameless from here on, so the file goes with the descriptor, even if
+	// the process crashes
+	unlink(pageFile);
+	updateModes();
+	tierFile = pageFile;
+	tierBudget = std::max(budgetBytes / sizeof(node), (size_t)1024);
+	tierPages = 0;
+	tierSpilled = 0;
+	tierEvict();
+	return true;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::disableTiering()
+{
+	if (tierFd < 0)
+		return;
+	tierLoadAll(root);
+	close(tierFd);
+	tierFd = -1;
+	updateModes();
+	tierLastUse.clear();
+	tierFreePages.clear();
+	tierPageRecords.clear();
+}
+
+template <class Balance>
+size_t BasicAVL<Balance>::residentNodes()
+{
+	return nodeCount;
+}
+
+template <class Balance>
+size_t BasicAVL<Balance>::spilledRecords()
+{
+	return tierSpilled;
+}
+
+// Start of a public operation: a new recency tick, and eviction down to the
+// budget. Evicting here rather than after the operation keeps the node
+// Find() returned valid until the next call.
+template <class Balance>
+void BasicAVL<Balance>::tierBegin()
+{
+	tierTick++;
+	if (nodeCount > tierBudget && ckpt == NULL)
+		tierEvict();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::tierOpen(node *t)
+{
+	if (t != NULL && t->mirror <= TIER_STUB)
+		tierFault(t);
+}
+
+// Called for each node an operation descends through: faults the node's
+// subtree in and records the first subtree of at most TIER_UNIT_HEIGHT on
+// the path as used.
+template <class Balance>
+void BasicAVL<Balance>::tierVisit(node *t)
+{
+	if (tierFd < 0)
+		return;
+	tierOpen(t);
+	if (t->height <= TIER_UNIT_HEIGHT && tierTouched != tierTick)
+	{
+		tierLastUse[t] = tierTick;
+		tierTouched = tierTick;
+	}
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::tierBuild(const TierRecord *recs, size_t &i)
+{
+	const TierRecord &r = recs[i++];
+	node *t = newNode();
+	t->empl = r.empl;
+	t->height = r.meta & 0xFFFF;
+	t->mirror = -1;
+	t->left = (r.meta & TIER_HAS_LEFT) ? tierBuild(recs, i) : NULL;
+	t->right = (r.meta & TIER_HAS_RIGHT) ? tierBuild(recs, i) : NULL;
+	return t;
+}
+
+// Reads stub t's page back and rebuilds the subtree below t. The tree has
+// no way to report an I/O error from here, so a failed read is fatal.
+template <class Balance>
+void BasicAVL<Balance>::tierFault(node *t)
+{
+	uint32_t page = TIER_STUB - t->mirror;
+	char buf[TIER_PAGE];
+	if (pread(tierFd, buf, TIER_PAGE, (off_t)page * TIER_PAGE) != (ssize_t)TIER_PAGE)
+	{
+		cerr << "AVL: cannot read page " << page << " of " << tierFile << endl;
+		abort();
+	}
+	uint32_t count;
+	memcpy(&count, buf, sizeof(count));
+	const TierRecord *recs = (const TierRecord *)(buf + sizeof(count));
+	size_t i = 1;
+	t->left = (recs[0].meta & TIER_HAS_LEFT) ? tierBuild(recs, i) : NULL;
+	t->right = (recs[0].meta & TIER_HAS_RIGHT) ? tierBuild(recs, i) : NULL;
+	t->mirror = -1;
+	tierRelease(page);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::tierRelease(uint32_t page)
+{
+	tierSpilled -= tierPageRecords[page];
+	tierPageRecords[page] = 0;
+	tierFreePages.push_back(page);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::tierRelease(node *t)
+{
+	tierRelease((uint32_t)(TIER_STUB - t->mirror));
+	t->mirror = -1;
+}
+
+// Preorder of the subtree at t into recs; false if it holds a stub below t
+// or does not fit in a page.
+static bool tierSerialize(node *t, bool top, vector<TierRecord> &recs, size_t capacity)
+{
+	if ((!top && t->mirror <= -2) || recs.size() == capacity)
+		return false;
+	TierRecord r;
+	r.empl = t->empl;
+	r.meta = t->height | (t->left ? TIER_HAS_LEFT : 0) | (t->right ? TIER_HAS_RIGHT : 0);
+	recs.push_back(r);
+	return (t->left == NULL || tierSerialize(t->left, false, recs, capacity)) &&
+		   (t->right == NULL || tierSerialize(t->right, false, recs, capacity));
+}
+
+// Writes the subtree below t to a page and frees it, leaving t as a stub.
+template <class Balance>
+bool BasicAVL<Balance>::tierSpill(node *t)
+{
+	const size_t capacity = (TIER_PAGE - sizeof(uint32_t)) / sizeof(TierRecord);
+	vector<TierRecord> recs;
+	if ((t->left == NULL && t->right == NULL) || !tierSerialize(t, true, recs, capacity))
+		return false;
+	char buf[TIER_PAGE] = {0};
+	uint32_t count = recs.size();
+	memcpy(buf, &count, sizeof(count));
+	memcpy(buf + sizeof(count), recs.data(), recs.size() * sizeof(TierRecord));
+	uint32_t page;
+	if (!tierFreePages.empty())
+	{
+		page = tierFreePages.back();
+		tierFreePages.pop_back();
+	}
+	else
+	{
+		page = tierPages++;
+		tierPageRecords.push_back(0);
+	}
+	if (pwrite(tierFd, buf, TIER_PAGE, (off_t)page * TIER_PAGE) != (ssize_t)TIER_PAGE)
+	{
+		tierFreePages.push_back(page);
+		return false; // Stays in memory
+	}
+	tierPageRecords[page] = count - 1;
+	tierSpilled += count - 1;
+	tierFree(t->left);
+	tierFree(t->right);
+	t->left = t->right = NULL;
+	t->mirror = TIER_STUB - (int)page;
+	return true;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::tierFree(node *t)
+{
+	if (t == NULL)
+		return;
+	tierFree(t->left);
+	tierFree(t->right);
+	freeNode(t);
+}
+
+// The topmost resident subtrees of at most TIER_UNIT_HEIGHT, the units
+// eviction chooses from.
+template <class Balance>
+void BasicAVL<Balance>::tierUnits(node *t, vector<node *> &units)
+{
+	if (t == NULL || t->mirror <= TIER_STUB)
+		return;
+	if (t->height <= TIER_UNIT_HEIGHT)
+	{
+		units.push_back(t);
+		return;
+	}
+	tierUnits(t->left, units);
+	tierUnits(t->right, units);
+}
+
+// Spills the least recently used units until the tree is a tenth below its
+// budget, so evictions come in batches rather than on every operation.
+template <class Balance>
+void BasicAVL<Balance>::tierEvict()
+{
+	if (nodeCount <= tierBudget)
+		return;
+	vector<node *> units;
+	tierUnits(root, units);
+	vector<pair<unsigned long, node *> > byAge(units.size());
+	for (size_t i = 0; i < units.size(); i++)
+	{
+		typename unordered_map<node *, unsigned long>::iterator it = tierLastUse.find(units[i]);
+		byAge[i] = make_pair(it == tierLastUse.end() ? 0 : it->second, units[i]);
+	}
+	sort(byAge.begin(), byAge.end());
+	for (size_t i = 0; i < byAge.size() && nodeCount > tierBudget / 10 * 9; i++)
+		tierSpill(byAge[i].second);
+}
+
+template <class Balance>
+void BasicAVL<Balance>::tierLoadAll(node *t)
+{
+	if (t == NULL || tierFd < 0)
+		return;
+	tierOpen(t);
+	tierLoadAll(t->left);
+	tierLoadAll(t->right);
+}
+
+// ---------------------------------------------------------------------------
+// Online compaction
+// ---------------------------------------------------------------------------
+
+static bool regionBefore(node *t, const NodeRegion &r)
+{
+	return t < r.base;
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::regionAlloc()
+{
+	vector<NodeRegion>::iterator it = regions.end();
+	if (fillBase != NULL)
+	{
+		it = upper_bound(regions.begin(), regions.end(), fillBase, regionBefore) - 1;
+		if (it->used == REGION_NODES)
+		{
+			// Full: stop filling it, and release it if everything moved on
+			fillBase = NULL;
+			if (it->live == 0)
+			{
+				if (memory != NULL)
+					memory->freed(REGION_NODES * sizeof(node));
+				delete[] it->base;
+				regions.erase(it);
+			}
+			it = regions.end();
+		}
+	}
+	if (fillBase == NULL)
+	{
+		NodeRegion r;
+		r.base = new node[REGION_NODES];
+		if (memory != NULL)
+			memory->allocated(REGION_NODES * sizeof(node));
+		r.used = r.live = 0;
+		it = regions.insert(upper_bound(regions.begin(), regions.end(), r.base, regionBefore), r);
+		fillBase = r.base;
+	}
+	it->live++;
+	nodeCount++;
+	return &it->base[it->used++];
+}
+
+// Every node leaves the tree through here: heap nodes are deleted, region
+// slots are counted down and their region released once it is empty.
+template <class Balance>
+void BasicAVL<Balance>::freeNode(node *t)
+{
+	nodeCount--;
+	if (tierFd >= 0)
+		tierLastUse.erase(t);
+	if (!regions.empty())
+	{
+		vector<NodeRegion>::iterator it = upper_bound(regions.begin(), regions.end(), t, regionBefore);
+		if (it != regions.begin() && t < (it - 1)->base + REGION_NODES)
+		{
+			--it;
+			if (--it->live == 0)
+			{
+				if (it->base == fillBase)
+					fillBase = NULL;
+				if (memory != NULL)
+					memory->freed(REGION_NODES * sizeof(node));
+				delete[] it->base;
+				regions.erase(it);
+			}
+			return;
+		}
+	}
+	if (memory != NULL)
+		memory->freed(sizeof(node));
+	delete t;
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::compact(size_t budget)
+{
+	if (root == NULL || tierFd >= 0)
+		return true; // Empty, a small tree that is contiguous already, or tiered
+	unique_lock<mutex> guard;
+	if (ckpt != NULL)
+		guard = unique_lock<mutex>(ckpt->lock); // Moves nodes the walk may read
+	// In-order walk from the pass's position. Each frame remembers the link
+	// that points at its node, so relocating the node only rewrites that link.
+	// The walk never outlives this call, so the tree may change between calls.
+	struct Frame
+	{
+		node *t;
+		node **link;
+	};
+	vector<Frame> stack;
+	node **link = &root;
+	while (*link != NULL)
+	{
+		node *t = *link;
+		if (!compactActive || t->empl.sin > compactCursor)
+		{
+			Frame f = {t, link};
+			stack.push_back(f);
+			link = &t->left;
+		}
+		else
+			link = &t->right;
+	}
+	compactActive = true;
+
+	for (; budget > 0 && !stack.empty(); budget--)
+	{
+		Frame f = stack.back();
+		stack.pop_back();
+		node *t = regionAlloc();
+		*t = *f.t;
+		if (t->mirror >= 0)
+			mirrorNodes[t->mirror] = t;
+		freeNode(f.t);
+		*f.link = t;
+		compactCursor = t->empl.sin;
+		// Continue with the leftmost path of the right subtree
+		for (link = &t->right; *link != NULL; link = &(*link)->left)
+		{
+			Frame g = {*link, link};
+			stack.push_back(g);
+		}
+	}
+	if (stack.empty())
+	{
+		compactActive = false;
+		return true;
+	}
+	return false;
+}
+
+// ---------------------------------------------------------------------------
+// Balance policies
+// ---------------------------------------------------------------------------
+
+// Strict AVL: heights of siblings differ by at most one. Inserts and removes
+// use the generic tree's repair; a remove may rotate at every level on the way
+// up.
+template <class Tree, class Hooks>
+node *AVLBalance::afterInsert(Tree &tree, Hooks &hooks, node *t)
+{
+	return tree.rebalance(t, hooks);
+}
+
+template <class Tree, class Hooks>
+node *AVLBalance::afterRemove(Tree &tree, Hooks &hooks, node *t)
+{
+	return tree.rebalance(t, hooks);
+}
+
+// Weak AVL (Haeupler, Sen & Tarjan, "Rank-Balanced Trees"). The rank of a
+// missing child is -1 and a child whose rank is r - k below its parent's rank
+// r is a "k-child". Valid trees only have 1- and 2-children and rank-0 leaves.
+// The rotation helpers recompute heights, so ranks are set explicitly after
+// every rotation.
+template <class Tree, class Hooks>
+node *WAVLBalance::afterInsert(Tree &tree, Hooks &hooks, node *t)
+{
+	int r = tree.height(t);
+	if (tree.height(t->left) == r)
+	{ // The left child is a 0-child
+		node *x = t->left;
+		if (r - tree.height(t->right) == 1)
+			t->height = r + 1; // 0,1 node: promote and keep going up
+		else if (r - tree.height(x->left) == 1)
+		{ // 0,2 node and x's outer child is a 1-child: right rotate
+			tree.rotateRight(t, hooks);
+			x->height = r;
+			t->height = r - 1;
+			return x;
+		}
+		else
+		{ // 0,2 node and x's inner child is a 1-child: left-right rotate
+			node *y = x->right;
+			tree.rotateLeftRight(t, hooks);
+			y->height = r;
+			x->height = r - 1;
+			t->height = r - 1;
+			return y;
+		}
+	}
+	else if (tree.height(t->right) == r)
+	{ // The right child is a 0-child
+		node *x = t->right;
+		if (r - tree.height(t->left) == 1)
+			t->height = r + 1;
+		else if (r - tree.height(x->right) == 1)
+		{
+			tree.rotateLeft(t, hooks);
+			x->height = r;
+			t->height = r - 1;
+			return x;
+		}
+		else
+		{
+			node *y = x->left;
+			tree.rotateRightLeft(t, hooks);
+			y->height = r;
+			x->height = r - 1;
+			t->height = r - 1;
+			return y;
+		}
+	}
+	return t;
+}
+
+template <class Tree, class Hooks>
+node *WAVLBalance::afterRemove(Tree &tree, Hooks &hooks, node *t)
+{
+	// A leaf must have rank 0: a 2,2 leaf left behind by a removal is demoted
+	if (t->left == NULL && t->right == NULL)
+	{
+		t->height = 0;
+		return t;
+	}
+	int r = tree.height(t);
+	if (r - tree.height(t->left) == 3)
+	{ // The left child is a 3-child; y is its sibling
+		node *y = t->right;
+		if (r - tree.height(y) == 2)
+			t->height = r - 1; // Demote t, its parent may need repair next
+		else if (tree.height(y) - tree.height(y->left) == 2 && tree.height(y) - tree.height(y->right) == 2)
+		{ // y is a 2,2 node: demote both
+			t->height = r - 1;
+			y->height = r - 2;
+		}
+		else if (tree.height(y) - tree.height(y->right) == 1)
+		{ // y's outer child is a 1-child: left rotate, the subtree keeps rank r
+			tree.rotateLeft(t, hooks);
+			y->height = r;
+			t->height = (t->left == NULL && t->right == NULL) ? 0 : r - 1;
+			return y;
+		}
+		else
+		{ // y's inner child v is a 1-child: right-left rotate
+			node *v = y->left;
+			tree.rotateRightLeft(t, hooks);
+			v->height = r;
+			y->height = r - 2;
+			t->height = r - 2;
+			return v;
+		}
+	}
+	else if (r - tree.height(t->right) == 3)
+	{ // The right child is a 3-child; y is its sibling
+		node *y = t->left;
+		if (r - tree.height(y) == 2)
+			t->height = r - 1;
+		else if (tree.height(y) - tree.height(y->left) == 2 && tree.height(y) - tree.height(y->right) == 2)
+		{
+			t->height = r - 1;
+			y->height = r - 2;
+		}
+		else if (tree.height(y) - tree.height(y->left) == 1)
+		{
+			tree.rotateRight(t, hooks);
+			y->height = r;
+			t->height = (t->left == NULL && t->right == NULL) ? 0 : r - 1;
+			return y;
+		}
+		else
+		{
+			node *v = y->right;
+			tree.rotateLeftRight(t, hooks);
+			v->height = r;
+			y->height = r - 2;
+			t->height = r - 2;
+			return v;
+		}
+	}
+	return t;
+}
+
+// ---------------------------------------------------------------------------
+// Write buffer
+// ---------------------------------------------------------------------------
+
+static bool entryLess(const BufferEntry &a, const BufferEntry &b)
+{
+	return a.rec.empl.sin < b.rec.empl.sin;
+}
+
+// Fold a newer write to the same sin into the net effect of the older ones.
+static void combine(BufferEntry &older, const BufferEntry &newer)
+{
+	if (newer.op == BUFFER_REMOVE)
+		older = newer;
+	else if (older.op == BUFFER_REMOVE)
+	{ // Removed and inserted again: the new record replaces the tree's one
+		older.rec = newer.rec;
+		older.op = BUFFER_REPLACE;
+	}
+	// Otherwise the older record wins, just as insert() ignores duplicate sins
+}
+
+template <class Balance>
+void BasicAVL<Balance>::enableWriteBuffer(size_t threshold)
+{
+	disableTiering();
+	toNodes();
+	bufferThreshold = threshold > 0 ? threshold : 1;
+	updateModes();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::disableWriteBuffer()
+{
+	flushWriteBuffer();
+	bufferThreshold = 0;
+	updateModes();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::flushWriteBuffer()
+{
+	foldLog();
+	mergeRun();
+}
+
+template <class Balance>
+size_t BasicAVL<Balance>::bufferedCount()
+{
+	return log.size() + run.size();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::bufferWrite(EmployeeInfo empl, BufferOp op)
+{
+	BufferEntry e;
+	e.rec.empl = empl;
+	e.rec.left = e.rec.right = NULL;
+	e.rec.height = 0;
+	e.rec.mirror = -1;
+	e.op = op;
+	log.push_back(e);
+	if (log.size() >= WRITE_LOG_LIMIT)
+	{
+		foldLog();
+		if (run.size() >= bufferThreshold)
+			mergeRun();
+	}
+}
+
+template <class Balance>
+void BasicAVL<Balance>::foldLog()
+{
+	if (log.empty())
+		return;
+	// Stable sort keeps writes to the same sin in arrival order
+	stable_sort(log.begin(), log.end(), entryLess);
+	vector<BufferEntry> merged;
+	merged.reserve(run.size() + log.size());
+	size_t i = 0, j = 0;
+	while (i < run.size() || j < log.size())
+	{
+		if (j == log.size() || (i < run.size() && run[i].rec.empl.sin < log[j].rec.empl.sin))
+		{
+			merged.push_back(run[i++]);
+			continue;
+		}
+		int sin = log[j].rec.empl.sin;
+		BufferEntry e = (i < run.size() && run[i].rec.empl.sin == sin) ? run[i++] : log[j++];
+		for (; j < log.size() && log[j].rec.empl.sin == sin; j++)
+			combine(e, log[j]);
+		merged.push_back(e);
+	}
+	run.swap(merged);
+	log.clear();
+}
+
+template <class Balance>
+void BasicAVL<Balance>::mergeRun()
+{
+	if (run.empty())
+		return;
+
+	// When the batch is large compared to the tree (e.g. a bulk load into an
+	// empty tree) rebuild the whole tree from the merged sorted sequence:
+	// O(n + b) work and no rotations at all.
+	int h = height(root);
+	if (h < 30 && ((size_t)1 << (h + 1)) <= run.size() * 8)
+	{
+		// Every link changes, so drop the mirror and re-read it afterwards
+		if (mirrorLevels > 0)
+			clearMirror(0, 0);
+		vector<node *> nodes;
+		collect(root, nodes);
+		vector<node *> merged;
+		merged.reserve(nodes.size() + run.size());
+		size_t i = 0;
+		for (size_t j = 0; j < run.size(); j++)
+		{
+			BufferEntry &e = run[j];
+			while (i < nodes.size() && nodes[i]->empl.sin < e.rec.empl.sin)
+				merged.push_back(nodes[i++]);
+			node *t = NULL;
+			if (i < nodes.size() && nodes[i]->empl.sin == e.rec.empl.sin)
+				t = nodes[i++];
+			if (e.op == BUFFER_REMOVE)
+			{
+				if (t != NULL)
+					freeNode(t);
+				continue;
+			}
+			if (t == NULL)
+			{
+				t = newNode();
+				t->empl = e.rec.empl;
+				t->mirror = -1;
+			}
+			else if (e.op == BUFFER_REPLACE)
+				t->empl = e.rec.empl;
+			merged.push_back(t);
+		}
+		while (i < nodes.size())
+			merged.push_back(nodes[i++]);
+		root = buildBalanced(merged, 0, (int)merged.size() - 1);
+		mirrorTouch(0);
+	}
+	// Otherwise apply the batch in key order; consecutive descents share most
+	// of their path, so the top of the tree stays cache resident.
+	else
+	{
+		for (size_t j = 0; j < run.size(); j++)
+		{
+			BufferEntry &e = run[j];
+			if (e.op != BUFFER_INSERT)
+				setRoot(remove(e.rec.empl.sin, root));
+			if (e.op != BUFFER_REMOVE)
+				setRoot(insert(e.rec.empl, root));
+		}
+	}
+	run.clear();
+}
+
+template <class Balance>
+bool BasicAVL<Balance>::bufferLookup(int sin, BufferOp &op, node *&rec)
+{
+	BufferEntry e = BufferEntry();
+	bool found = false;
+	BufferEntry key;
+	key.rec.empl.sin = sin;
+	vector<BufferEntry>::iterator it = lower_bound(run.begin(), run.end(), key, entryLess);
+	if (it != run.end() && it->rec.empl.sin == sin)
+	{
+		e = *it;
+		rec = &it->rec;
+		found = true;
+	}
+	// Apply the not yet folded writes in arrival order
+	for (size_t j = 0; j < log.size(); j++)
+	{
+		if (log[j].rec.empl.sin != sin)
+			continue;
+		if (!found)
+		{
+			e = log[j];
+			rec = &log[j].rec;
+			found = true;
+			continue;
+		}
+		BufferOp before = e.op;
+		combine(e, log[j]);
+		if (e.op != before && e.op != BUFFER_REMOVE)
+			rec = &log[j].rec;
+	}
+	if (found)
+		op = e.op;
+	return found;
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::bufferedFind(int sin)
+{
+	BufferOp op;
+	node *rec;
+	if (!bufferLookup(sin, op, rec))
+		return treeFind(sin);
+	if (op == BUFFER_REMOVE)
+		return NULL;
+	if (op == BUFFER_REPLACE)
+		return rec;
+	// A buffered insert only takes effect if the tree lacks the sin
+	node *t = treeFind(sin);
+	return t != NULL ? t : rec;
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::treeFind(int sin)
+{
+	if (mirrorLevels > 0)
+		return mirrorFind(sin);
+	node *t = root;
+	while (t != NULL && t->empl.sin != sin)
+		t = sin < t->empl.sin ? t->left : t->right;
+	return t;
+}
+
+template <class Balance>
+void BasicAVL<Balance>::collect(node *t, vector<node *> &out)
+{
+	if (t == NULL)
+		return;
+	collect(t->left, out);
+	out.push_back(t);
+	collect(t->right, out);
+}
+
+template <class Balance>
+node *BasicAVL<Balance>::buildBalanced(vector<node *> &nodes, int lo, int hi)
+{
+	if (lo > hi)
+		return NULL;
+	int mid = lo + (hi - lo) / 2;
+	node *t = nodes[mid];
+	t->left = buildBalanced(nodes, lo, mid - 1);
+	t->right = buildBalanced(nodes, mid + 1, hi);
+	t->height = max(height(t->left), height(t->right)) + 1;
+	return t;
+}
+
+template class BasicAVL<AVLBalance>;
+template class BasicAVL<WAVLBalance>;
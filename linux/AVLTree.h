@@ -7,6 +7,10 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -22,23 +26,361 @@ typedef struct node {
 	node* left;
 	node* right;
 	int height;
+	int mirror;	// slot in the top-levels mirror, -1 if not mirrored (fits in the padding)
+
+	// Every node and node array is counted in nodeMemory (MemoryAccount.h);
+	// trees count their own in their account as well
+	static void* operator new(size_t size);
+	static void* operator new[](size_t size);
+	static void operator delete(void* p, size_t size);
+	static void operator delete[](void* p, size_t size);
 }node;
 
-class AVL
+#include "GenericAVL.h"
+
+// AVLTree's key extractor for EmployeeInfo.
+struct SinKey
+{
+	int operator()(const EmployeeInfo &e) const
+	{
+		return e.sin;
+	}
+};
+
+// PointerNodes for EmployeeInfo: the nodes are AVL's own, so AVL, WAVL and
+// EmployeeTree share one layout.
+template <>
+class PointerNodes::Pool<EmployeeInfo>
 {
-	node* root;
+public:
+	typedef ::node Node;
+	typedef node* Ref;
+	static constexpr Ref NIL = NULL;
+
+	static EmployeeInfo &value(node &n)
+	{
+		return n.empl;
+	}
+
+	node &at(Ref r)
+	{
+		return *r;
+	}
+
+	const node &at(Ref r) const
+	{
+		return *r;
+	}
+
+	template <class... Args>
+	Ref make(Args &&...args)
+	{
+		node* t = new node;
+		t->empl = EmployeeInfo{std::forward<Args>(args)...};
+		t->left = t->right = NULL;
+		t->height = 0;
+		t->mirror = -1;
+		return t;
+	}
+
+	void destroy(Ref r)
+	{
+		delete r;
+	}
+
+	bool releaseAll()
+	{
+		return false;
+	}
+};
+
+// EmployeeInfo keyed by sin, the table AVL holds, with either node layout.
+typedef AVLTree<int, EmployeeInfo, std::less<int>, PointerNodes, SinKey> EmployeeTree;
+typedef AVLTree<int, EmployeeInfo, std::less<int>, IndexNodes, SinKey> CompactEmployeeTree;
+
+// A write absorbed by the optional write buffer (see AVL::enableWriteBuffer).
+// Each entry holds the net effect of every buffered insert/remove on one sin.
+enum BufferOp {
+	BUFFER_INSERT,	// insert rec unless the tree already holds the sin
+	BUFFER_REPLACE,	// drop whatever the tree holds for the sin, then insert rec
+	BUFFER_REMOVE	// tombstone: the sin is deleted
+};
+
+typedef struct BufferEntry {
+	node rec;	// only rec.empl is used; Find hands out &rec for buffered records
+	BufferOp op;
+}BufferEntry;
+
+// A contiguous chunk of nodes filled by BasicAVL::compact(). Slots are handed
+// out in order and never reused; the chunk is released once none of its
+// slots holds a tree node any more.
+typedef struct NodeRegion {
+	node* base;
+	size_t used;	// slots handed out
+	size_t live;	// slots still holding a tree node
+}NodeRegion;
+
+// CRC32C (Castagnoli). Chain calls by passing the previous result as crc;
+// start with 0.
+uint32_t crc32c(uint32_t crc, const void* data, size_t n);
+
+class WriteAheadLog;
+
+// Binary snapshot file (see BasicAVL::saveSnapshot): a SnapshotHeader followed
+// by count SnapshotNode records in BFS order, root first. Children are record
+// indices rather than pointers, so the file can be mapped at any address.
+// Fields are in host byte order.
+static const uint32_t SNAPSHOT_VERSION = 2;
+
+typedef struct SnapshotHeader {
+	char magic[8];	// "AVLSNAP"
+	uint32_t version;
+	uint32_t nodeSize;	// sizeof(SnapshotNode) of the writer
+	uint64_t count;
+	uint64_t lsn;	// last write-ahead log entry applied to the tree
+	uint32_t dataCrc;	// CRC32C of the records
+	uint32_t headerCrc;	// CRC32C of the header fields above
+}SnapshotHeader;
+
+typedef struct SnapshotNode {
+	EmployeeInfo empl;
+	int32_t left;	// record index, -1 if none
+	int32_t right;
+}SnapshotNode;
+
+// Output formats of BasicAVL::exportTo. CSV has a header line and the
+// columns sin,emplNumber,salary,age; JSON Lines has one object per record
+// with the same names. BINARY is the 8-byte magic "AVLRECS", a uint32
+// version and a uint32 record size, followed by the EmployeeInfo records as
+// laid out in memory. TEXT is the display() format. Records are in key order.
+enum ExportFormat {
+	EXPORT_CSV,
+	EXPORT_JSONL,
+	EXPORT_BINARY,
+	EXPORT_TEXT
+};
+
+// Outcome of a background checkpoint (see BasicAVL::startCheckpoint).
+typedef struct CheckpointStats {
+	size_t records;	// records in the checkpoint
+	size_t writes;	// inserts and removes made while it ran
+	size_t captured;	// of those, writes that had to save a pre-image
+	double seconds;	// from start until the file was complete
+	double stallP50;	// microseconds a write waited on the checkpoint
+	double stallP99;
+	double stallP999;
+	double stallMax;
+}CheckpointStats;
+
+struct CheckpointState;
+struct TierRecord;
+class MemoryAccount;
+
+// Rebalancing policies for BasicAVL. After an insert or remove changed one
+// of t's subtrees, the policy restores its invariant at t and returns the
+// root of the repaired subtree, rotating with the tree's rotateLeft and
+// rotateRight (see AVLTree in GenericAVL.h) and passing hooks on to them.
+// node::height holds the policy's rank.
+//
+// AVLBalance keeps the strict AVL height balance (the classic tree).
+// WAVLBalance keeps a weak AVL (rank-balanced) tree: every rank difference is
+// 1 or 2 and leaves have rank 0. Inserts rebalance exactly as AVLBalance does,
+// so without removals the tree keeps AVL height bounds, but a removal costs
+// at most two rotations (O(1) amortized rebalancing) instead of one per level.
+struct AVLBalance
+{
+	template <class Tree, class Hooks> static node* afterInsert(Tree& tree, Hooks& hooks, node* t);
+	template <class Tree, class Hooks> static node* afterRemove(Tree& tree, Hooks& hooks, node* t);
+};
+
+struct WAVLBalance
+{
+	template <class Tree, class Hooks> static node* afterInsert(Tree& tree, Hooks& hooks, node* t);
+	template <class Tree, class Hooks> static node* afterRemove(Tree& tree, Hooks& hooks, node* t);
+};
+
+// The generic AVLTree with PointerNodes for EmployeeInfo keyed by sin, which
+// does the searching, relinking and rotating; Hooks adds what BasicAVL keeps
+// on top of it at each step. The members are defined in AVLTree.cpp and
+// instantiated there for the policies above.
+template <class Balance>
+class BasicAVL : private AVLTree<int, EmployeeInfo, std::less<int>, PointerNodes, SinKey>
+{
+	friend Balance;
+
+	// Faults spilled subtrees in as they are reached, keeps the mirror up to
+	// date, counts rotations and rebalances by Balance.
+	struct Hooks
+	{
+		BasicAVL& tree;
+
+		void visit(node* t);
+		void open(node* t);
+		void relink(node* t, node*& link, node* child);
+		void moved(node* t);
+		void rotated();
+		node* afterInsert(node* t);
+		node* afterRemove(node* t);
+		void destroy(node* t);
+	};
+
+	// Hooks for a tree with none of the modes below on: no faulting in and
+	// no mirror, only rotation counting and Balance.
+	struct PlainHooks
+	{
+		BasicAVL& tree;
+
+		void visit(node* t);
+		void open(node* t);
+		void relink(node* t, node*& link, node* child);
+		void moved(node* t);
+		void rotated();
+		node* afterInsert(node* t);
+		node* afterRemove(node* t);
+		void destroy(node* t);
+	};
+
+	// True while no mode (write buffer, mirror, small mode, snapshot, log,
+	// checkpoint, tiering) is on, which insert, remove and Find test once to
+	// take a path with PlainHooks and none of the modes' checks. Every place
+	// that switches a mode calls updateModes().
+	bool plain;
+	void updateModes();
+	unsigned long rotations;	// single rotations done (a double rotation counts 2)
+	MemoryAccount* memory;	// also counts this tree's nodes, NULL if none
+	node* newNode();
 	int max(int a, int b);
 	int min(int a, int b);
 	node* insert(EmployeeInfo empl, node* t);
-	node* singleRightRotate(node* &t);
-	node* singleLeftRotate(node* &t);
-	node* doubleLeftRotate(node* &t);
-	node* doubleRightRotate(node* &t);
 	node* remove(int sin, node* t);
-	int height(node* t);
-	void inorder(node* t);
+	template <class H> node* insert(EmployeeInfo empl, node* t, H& hooks);
+	template <class H> node* remove(int sin, node* t, H& hooks);
+
+	// Write buffer: new writes are appended to log, which is folded into the
+	// sorted run every WRITE_LOG_LIMIT writes. Once run reaches
+	// bufferThreshold entries it is merged into the tree in key order.
+	static const size_t WRITE_LOG_LIMIT = 64;
+	vector<BufferEntry> log;
+	vector<BufferEntry> run;
+	size_t bufferThreshold;	// 0 when the buffer is disabled
+	void bufferWrite(EmployeeInfo empl, BufferOp op);
+	void foldLog();
+	void mergeRun();
+	bool bufferLookup(int sin, BufferOp& op, node*& rec);
+	node* bufferedFind(int sin);
+	node* treeFind(int sin);
+	void collect(node* t, vector<node*>& out);
+	node* buildBalanced(vector<node*>& nodes, int lo, int hi);
+
+	// Top-levels mirror: the first mirrorLevels levels of the tree copied into
+	// 64-byte blocks, each holding a 4-level subtree (15 keys in BFS order plus
+	// a bitmask of occupied positions), so a descent through them touches one
+	// cache line per 4 levels. Block b's 16 child blocks are 16b+1 .. 16b+16.
+	// mirrorNodes is parallel to mirrorKeys and maps a slot to its node.
+	// Whenever a mirrored node's key or child links change its slot is marked
+	// dirty, and the topmost dirty slots are re-read from the tree before the
+	// next mirrored lookup.
+	int mirrorLevels;	// 0 when the mirror is disabled
+	vector<int> mirrorStore;	// backing store, over-allocated for alignment
+	int* mirrorKeys;	// 64-byte aligned view into mirrorStore
+	vector<node*> mirrorNodes;
+	vector<int> dirtySlots;
+	vector<char> slotDirty;
+	void setRoot(node* t);
+	void relink(node* t, node*& link, node* child);
+	void mirrorTouch(int slot);
+	void mirrorForget(node* t);
+	void refreshMirror();
+	void clearMirror(int slot, int depth);
+	void fillMirror(int slot, node* t, int depth);
+	int mirrorParent(int slot);
+	node* mirrorFind(int sin);
+
+	// Online compaction: regions sorted by base address, the region being
+	// filled, and the in-order position the current pass has reached.
+	static const size_t REGION_NODES = 65536;
+	vector<NodeRegion> regions;
+	node* fillBase;
+	bool compactActive;
+	int compactCursor;	// sin of the last node relocated by this pass
+	node* regionAlloc();
+	void freeNode(node* t);
+	node* linkRegions(vector<node*>& blocks, long lo, long hi);
+
+	// Small-tree representation: while a tree holds at most smallThreshold
+	// records (and neither the write buffer nor the mirror is enabled) they
+	// live in smallRecs, sorted by sin, with the sins repeated in smallKeys
+	// for a branch-free linear search. root is NULL meanwhile.
+	size_t smallThreshold;	// 0 when small trees are disabled
+	size_t nodeCount;	// nodes currently linked into the tree
+	vector<EmployeeInfo> smallRecs;
+	vector<int> smallKeys;
+	node hitCopy;	// what Find() hands out for a small tree or a snapshot
+	bool smallActive();
+	size_t smallIndex(int sin);
+	node* smallFind(int sin);
+	void smallInsert(EmployeeInfo empl);
+	void smallRemove(int sin);
+	void toNodes();
+	void toSmall();
+
+	// Read-only snapshot mapping; snapHeader is NULL when none is open.
+	const SnapshotHeader* snapHeader;
+	const SnapshotNode* snapNodes;
+	size_t snapBytes;
+	node* snapshotFind(int sin);
+	void snapshotRecords(vector<EmployeeInfo>& out);
+
+	WriteAheadLog* wal;	// NULL when writes are not logged
+	uint64_t appliedLsn;	// last log entry reflected in the tree
+
+	CheckpointState* ckpt;	// NULL when no checkpoint is running
+	void checkpointBegin(int sin);
+	void checkpointEnd();
+	void checkpointRun();
+
+	// Tiered storage: while tierFd >= 0 eviction keeps about tierBudget nodes
+	// in memory by spilling cold subtrees of at most TIER_UNIT_HEIGHT (at most
+	// 127 nodes, one page) to the page file. The subtree's root stays behind
+	// as a stub with its record and height, so rebalancing above it works
+	// unchanged; its mirror field (the mirror is off meanwhile) holds
+	// TIER_STUB - page. Any walk below a stub faults the page back in first.
+	static const int TIER_STUB = -2;
+	static const int TIER_UNIT_HEIGHT = 6;
+	static const size_t TIER_PAGE = 4096;
+	int tierFd;	// -1 when tiering is disabled
+	string tierFile;
+	size_t tierBudget;	// in nodes
+	unsigned long tierTick;	// one per public operation
+	unsigned long tierTouched;	// tick of the last recency update
+	unordered_map<node*, unsigned long> tierLastUse;	// unit root -> tick
+	vector<uint32_t> tierFreePages;
+	vector<uint32_t> tierPageRecords;	// records spilled into each page
+	uint32_t tierPages;	// pages in the file
+	size_t tierSpilled;	// records living in the page file
+	void tierBegin();
+	void tierOpen(node* t);
+	void tierVisit(node* t);
+	node* tierBuild(const TierRecord* recs, size_t& i);
+	void tierFault(node* t);
+	void tierRelease(uint32_t page);
+	void tierRelease(node* t);
+	bool tierSpill(node* t);
+	void tierFree(node* t);
+	void tierUnits(node* t, vector<node*>& units);
+	void tierEvict();
+	void tierLoadAll(node* t);
 public:
-	AVL();
+	// Nodes are counted in nodeMemory, which all trees share, and in account
+	// too if one is given, which tells this tree's footprint apart.
+	explicit BasicAVL(MemoryAccount* account = NULL);
+	// Waits for a running checkpoint, then frees the tree and closes its page
+	// file and snapshot mapping.
+	~BasicAVL();
+	// Not copyable: the mirror's aligned view, a checkpoint thread, the page
+	// file and a snapshot mapping all belong to one tree.
+	BasicAVL(const BasicAVL&) = delete;
+	BasicAVL& operator=(const BasicAVL&) = delete;
 	void insert(EmployeeInfo empl);
 	void remove(int sin);
 	void display(char filename[]);
@@ -48,6 +390,123 @@ public:
 	int getBalance(node* t);
 	node* findMin(node* t);
 	node* findMax(node* t);
+
+	// Optional write buffer. Inserts and removes are absorbed by the buffer and
+	// merged into the tree in sorted batches once threshold entries are pending,
+	// turning per-record rebalancing into bulk work. Find(GetRoot(), sin)
+	// consults the buffer first; pointers it returns into the buffer are only
+	// valid until the next insert/remove. GetRoot(), findMin() and findMax() see
+	// the merged tree only, so call flushWriteBuffer() before walking it.
+	void enableWriteBuffer(size_t threshold = 4096);
+	void disableWriteBuffer();
+	void flushWriteBuffer();
+	size_t bufferedCount();
+
+	// Mirror the top levels (rounded up to a multiple of 4, at most 20) of the
+	// tree into a compact cache-aligned array that Find(GetRoot(), sin)
+	// descends before falling back to pointer chasing.
+	void enableTopMirror(int levels = 16);
+	void disableTopMirror();
+
+	// Store trees of up to threshold records as one sorted array instead of
+	// one node per record; the tree switches to nodes when it grows past the
+	// threshold and back when it shrinks to half of it. While a tree is small
+	// GetRoot() returns NULL and Find(GetRoot(), sin) returns a copy of the
+	// record that is valid until the next Find. Enabling the write buffer or
+	// the top-levels mirror switches the tree to nodes for good.
+	void enableSmallMode(size_t threshold = 64);
+	void disableSmallMode();
+
+	// Binary snapshots. saveSnapshot writes every record to file as a balanced
+	// tree and returns false if the file cannot be written. openSnapshot maps
+	// such a file read-only into an empty tree and serves Find(GetRoot(), sin)
+	// straight from the mapping, without deserializing anything. It returns
+	// false, leaving the tree as it was, if the tree is not empty or the file
+	// is missing, truncated, of another version or fails its header checksum;
+	// verify also checks the records' checksum, which reads the whole file.
+	// While a snapshot is open insert() and remove() are ignored, GetRoot()
+	// returns NULL and Find returns a copy valid until the next Find.
+	bool saveSnapshot(const char* file);
+	bool openSnapshot(const char* file, bool verify = false);
+	void closeSnapshot();
+	bool snapshotOpen();
+
+	// Writes every record to file in the given format. Subtrees are formatted
+	// into separate chunks on threads worker threads (0: one per core) and
+	// written in order with large writes. Trees can export concurrently.
+	// Returns false if the file cannot be written.
+	bool exportTo(const char* file, ExportFormat format, int threads = 0);
+
+	// Loads a CSV or binary file in the exportTo() layout (a CSV header line
+	// is optional). The file is mapped and cut into chunks that threads
+	// worker threads (0: one per core) parse and sort; the sorted chunks are
+	// then merged. An empty tree is built from the merged records in O(n);
+	// otherwise they are inserted one by one. Of several records with the
+	// same sin the first one in the file wins, as with insert(). Returns
+	// false, adding nothing, if the file cannot be read or is malformed.
+	bool importFrom(const char* file, ExportFormat format, int threads = 0);
+
+	// Durability. With a log attached every insert and remove is appended to
+	// it and committed (see WriteAheadLog) before it is applied, so it is on
+	// disk when the call returns; a write the log fails to persist is not
+	// applied. Several trees may share one log, each on its own thread.
+	// Snapshots record the last applied LSN. recover() rebuilds an empty tree
+	// from snapshotFile (if it exists) and then replays the entries of logFile
+	// newer than it, which assumes the log holds this tree's writes only.
+	// Returns false if the tree is not empty or the snapshot is corrupt.
+	// Either file name may be NULL.
+	void attachLog(WriteAheadLog* log);
+	void detachLog();
+	bool recover(const char* snapshotFile, const char* logFile);
+
+	// Background checkpoints. startCheckpoint captures the records as they
+	// are at that moment and writes them to file as a snapshot from a
+	// background thread, which walks the tree in key order a batch of nodes
+	// at a time under a lock. A write made meanwhile waits at most for the
+	// batch in progress, then saves the old state of its key if the walk has
+	// not reached it yet. The owning thread keeps using insert, remove, Find
+	// and compact as usual, but must not call makeEmpty until the checkpoint
+	// is finished. The write buffer and small mode are bypassed while it runs.
+	// Returns false if a checkpoint is running or a snapshot is open.
+	// finishCheckpoint waits for the file, fills in stats if given and
+	// returns whether the file was written.
+	bool startCheckpoint(const char* file, size_t batch = 1024);
+	bool finishCheckpoint(CheckpointStats* stats = NULL);
+	bool checkpointRunning();
+
+	// Tiered storage. Keeps the tree's nodes within budgetBytes of memory by
+	// writing the least recently used subtrees (up to 127 nodes each) to
+	// pageFile, one 4 KB page per subtree, and reading them back when an
+	// operation reaches them; so the tree can hold more records than fit in
+	// the budget. Eviction runs at the start of insert, remove and
+	// Find(GetRoot(), sin), so the budget may be overshot by what a single
+	// operation faults in. Export, snapshots and checkpoints read everything
+	// back first, and compact() does nothing while tiering is on. Returns
+	// false if the page file cannot be created, or the write buffer, top
+	// mirror or small mode is enabled (enabling any of those later disables
+	// tiering). pageFile is unlinked as soon as it is created, so it is gone
+	// once the tree is, even after a crash. disableTiering reads everything
+	// back and closes it.
+	bool enableTiering(const char* pageFile, size_t budgetBytes);
+	void disableTiering();
+	size_t residentNodes();	// nodes in memory, stubs included
+	size_t spilledRecords();	// records in the page file
+
+	// Online defragmentation. Each call relocates at most budget nodes, in key
+	// order, into contiguous regions and fixes up the links to them, so a scan
+	// walks memory sequentially once a pass is done. Inserts and removes may
+	// run between calls; nodes inserted behind the pass's position stay where
+	// they are until the next pass. Returns true when the pass has finished
+	// (the next call starts a new one). Pointers returned by Find() before a
+	// call may be invalidated by it.
+	bool compact(size_t budget);
+
+	// Rotation counter, for comparing the cost of the balance policies
+	unsigned long getRotationCount();
+	void resetRotationCount();
 };
 
+typedef BasicAVL<AVLBalance> AVL;
+typedef BasicAVL<WAVLBalance> WAVL;
+
 #endif // AVL_TREE_H
\ No newline at end of file
@@ -0,0 +1,401 @@
+#include <AsyncWriter.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// io_uring
+// ---------------------------------------------------------------------------
+
+// The rings are driven through the raw system calls, so there is no
+// dependency on liburing. The submission queue is only touched by the
+// writer's thread; the kernel publishes completions, which are read with
+// acquire and consumed with release ordering.
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+struct AsyncRing
+{
+	int fd;
+	bool fixed;	// buffers registered, so writes use IORING_OP_WRITE_FIXED
+	void *sqMap, *cqMap;
+	size_t sqMapSize, cqMapSize;
+	io_uring_sqe *sqes;
+	size_t sqesSize;
+	unsigned *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	io_uring_cqe *cqes;
+};
+
+static void ringClose(AsyncRing *r)
+{
+	if (r->sqes != NULL && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqesSize);
+	if (r->cqMap != NULL && r->cqMap != MAP_FAILED && r->cqMap != r->sqMap)
+		munmap(r->cqMap, r->cqMapSize);
+	if (r->sqMap != NULL && r->sqMap != MAP_FAILED)
+		munmap(r->sqMap, r->sqMapSize);
+	if (r->fd >= 0)
+		close(r->fd);
+	delete r;
+}
+
+// Whether the kernel implements opcode. The probe came with kernel 5.6, as
+// did IORING_OP_WRITE, so a kernel without it has neither.
+static bool ringSupports(AsyncRing *r, unsigned opcode)
+{
+	const unsigned ops = 256;
+	vector<char> space(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op), 0);
+	io_uring_probe *probe = (io_uring_probe *)space.data();
+	if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, ops) != 0)
+		return false;
+	return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+static AsyncRing *ringOpen(unsigned entries, const vector<char *> &buffers, size_t bufferSize)
+{
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	AsyncRing *r = new AsyncRing();
+	r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+	{
+		ringClose(r);
+		return NULL;
+	}
+	r->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sqMapSize = r->cqMapSize = max(r->sqMapSize, r->cqMapSize);
+	r->sqMap = mmap(NULL, r->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sqMap == MAP_FAILED)
+	{
+		ringClose(r);
+		return NULL;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cqMap = r->sqMap;
+	else
+		r->cqMap = mmap(NULL, r->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+						IORING_OFF_CQ_RING);
+	r->sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+	r->sqes = (io_uring_sqe *)mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+								   IORING_OFF_SQES);
+	if (r->cqMap == MAP_FAILED || r->sqes == MAP_FAILED)
+	{
+		ringClose(r);
+		return NULL;
+	}
+	char *sq = (char *)r->sqMap, *cq = (char *)r->cqMap;
+	r->sqTail = (unsigned *)(sq + p.sq_off.tail);
+	r->sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sqArray = (unsigned *)(sq + p.sq_off.array);
+	r->cqHead = (unsigned *)(cq + p.cq_off.head);
+	r->cqTail = (unsigned *)(cq + p.cq_off.tail);
+	r->cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	// Registering pins the buffers once instead of on every write. It can
+	// fail under a small RLIMIT_MEMLOCK; plain IORING_OP_WRITE still works
+	// where the kernel has it, otherwise every write would fail with EINVAL
+	// and the pwrite path is used instead.
+	vector<iovec> iov(buffers.size());
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		iov[i].iov_base = buffers[i];
+		iov[i].iov_len = bufferSize;
+	}
+	r->fixed = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov.data(), (unsigned)iov.size()) == 0;
+	if (!r->fixed && !ringSupports(r, IORING_OP_WRITE))
+	{
+		ringClose(r);
+		return NULL;
+	}
+	return r;
+}
+
+static void ringPrepare(AsyncRing *r, int fd, int b, const char *buf, size_t n, uint64_t offset)
+{
+	unsigned tail = *r->sqTail;
+	unsigned index = tail & *r->sqMask;
+	io_uring_sqe *sqe = &r->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = r->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = (uint32_t)n;
+	sqe->off = offset;
+	sqe->buf_index = r->fixed ? b : 0;
+	sqe->user_data = b;
+	r->sqArray[index] = index;
+	__atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int ringEnter(AsyncRing *r, unsigned submit, unsigned minComplete)
+{
+	return (int)syscall(__NR_io_uring_enter, r->fd, submit, minComplete,
+						minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Takes one completion off the ring; false if there is none.
+static bool ringComplete(AsyncRing *r, int &b, int &res)
+{
+	unsigned head = *r->cqHead;
+	if (head == __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE))
+		return false;
+	io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+	b = (int)cqe->user_data;
+	res = cqe->res;
+	__atomic_store_n(r->cqHead, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+#else
+struct AsyncRing
+{
+};
+
+static void ringClose(AsyncRing *r)
+{
+	delete r;
+}
+
+static AsyncRing *ringOpen(unsigned, const vector<char *> &, size_t)
+{
+	return NULL;
+}
+
+static void ringPrepare(AsyncRing *, int, int, const char *, size_t, uint64_t)
+{
+}
+
+static int ringEnter(AsyncRing *, unsigned, unsigned)
+{
+	return -1;
+}
+
+static bool ringComplete(AsyncRing *, int &, int &)
+{
+	return false;
+}
+#endif
+
+// Writes all n bytes at offset; false on an error.
+static bool pwriteAll(int fd, const char *buf, size_t n, uint64_t offset)
+{
+	while (n > 0)
+	{
+		ssize_t done = pwrite(fd, buf, n, (off_t)offset);
+		if (done <= 0)
+			return false;
+		buf += done;
+		n -= done;
+		offset += done;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncWriter
+// ---------------------------------------------------------------------------
+
+AsyncWriter::AsyncWriter()
+{
+	fd = -1;
+	ring = NULL;
+	current = -1;
+	offset = 0;
+	queued = 0;
+	inFlight = 0;
+	failed = false;
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	close();
+}
+
+bool AsyncWriter::open(const char *file, bool useUring)
+{
+	close();
+	fd = ::open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	buffers.resize(BUFFERS);
+	for (int b = 0; b < BUFFERS; b++)
+	{
+		if (buffers[b] == NULL)
+			buffers[b] = (char *)aligned_alloc(4096, BUFFER_SIZE);
+		if (buffers[b] == NULL)
+		{ // Out of memory: give up on the file rather than write from NULL
+			::close(fd);
+			fd = -1;
+			for (size_t i = 0; i < buffers.size(); i++)
+				::free(buffers[i]);
+			buffers.clear();
+			idle.clear();
+			return false;
+		}
+		idle.push_back(b);
+	}
+	used.assign(BUFFERS, 0);
+	offsets.assign(BUFFERS, 0);
+	if (useUring)
+		ring = ringOpen(BUFFERS * 2, buffers, BUFFER_SIZE);
+	current = -1;
+	offset = 0;
+	queued = 0;
+	inFlight = 0;
+	failed = false;
+	return true;
+}
+
+// Hands buffer b to the kernel, or writes it out right away on the pwrite
+// path.
+bool AsyncWriter::submit(int b)
+{
+	offsets[b] = offset;
+	offset += used[b];
+	if (ring == NULL)
+	{
+		failed = failed || !pwriteAll(fd, buffers[b], used[b], offsets[b]);
+		used[b] = 0;
+		idle.push_back(b);
+		return !failed;
+	}
+	ringPrepare(ring, fd, b, buffers[b], used[b], offsets[b]);
+	queued++;
+	if (queued >= BATCH)
+		enter(0);
+	return !failed;
+}
+
+// Submits the prepared writes and waits for at least minComplete
+// completions, then reaps whatever has completed. Returns false if the ring
+// stopped accepting calls; a failed write only sets failed.
+bool AsyncWriter::enter(unsigned minComplete)
+{
+	int done = ringEnter(ring, queued, minComplete);
+	if (done < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+	{
+		failed = true;
+		return false;
+	}
+	if (done > 0)
+	{
+		inFlight += done;
+		queued -= done;
+	}
+	reap();
+	return true;
+}
+
+void AsyncWriter::reap()
+{
+	int b, res;
+	while (ringComplete(ring, b, res))
+	{
+		inFlight--;
+		// A short write finishes synchronously
+		if (res < 0)
+			failed = true;
+		else if ((size_t)res < used[b])
+			failed = failed || !pwriteAll(fd, buffers[b] + res, used[b] - res, offsets[b] + res);
+		used[b] = 0;
+		idle.push_back(b);
+	}
+}
+
+// Submits the buffer being filled and waits for every write.
+bool AsyncWriter::drain()
+{
+	if (current >= 0 && used[current] > 0)
+		submit(current);
+	else if (current >= 0)
+		idle.push_back(current);
+	current = -1;
+	// A failed write still waits for the others, which read from buffers;
+	// only a ring that stopped accepting calls is given up on.
+	while (ring != NULL && (queued > 0 || inFlight > 0))
+		if (!enter(1))
+			break;
+	return !failed;
+}
+
+bool AsyncWriter::write(const void *data, size_t n)
+{
+	if (fd < 0)
+		return false;
+	const char *p = (const char *)data;
+	while (n > 0 && !failed)
+	{
+		if (current < 0)
+		{
+			while (idle.empty() && !failed)
+				if (!enter(1))
+					break;
+			if (failed)
+				break;
+			current = idle.back();
+			idle.pop_back();
+		}
+		size_t take = min(n, BUFFER_SIZE - used[current]);
+		memcpy(buffers[current] + used[current], p, take);
+		used[current] += take;
+		p += take;
+		n -= take;
+		if (used[current] == BUFFER_SIZE)
+		{
+			int b = current;
+			current = -1;
+			submit(b);
+		}
+	}
+	return !failed;
+}
+
+bool AsyncWriter::write(const string &s)
+{
+	return write(s.data(), s.size());
+}
+
+bool AsyncWriter::writeAt(uint64_t at, const void *data, size_t n)
+{
+	return fd >= 0 && drain() && pwriteAll(fd, (const char *)data, n, at);
+}
+
+bool AsyncWriter::close()
+{
+	if (fd < 0)
+		return !failed;
+	bool ok = drain();
+	if (ring != NULL)
+	{
+		ringClose(ring);
+		ring = NULL;
+	}
+	ok = ::close(fd) == 0 && ok;
+	fd = -1;
+	for (size_t b = 0; b < buffers.size(); b++)
+		::free(buffers[b]);
+	buffers.clear();
+	idle.clear();
+	failed = !ok;
+	return ok;
+}
+
+bool AsyncWriter::usingUring()
+{
+	return ring != NULL;
+}
+
+uint64_t AsyncWriter::size()
+{
+	return offset + (current >= 0 ? used[current] : 0);
+}
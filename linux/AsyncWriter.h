@@ -0,0 +1,70 @@
+// AsyncWriter.h - Header file for the asynchronous file writer
+
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct AsyncRing;
+
+// Sequential writer for the files this project produces (exports, snapshots,
+// checkpoint side files). write() copies into one of a few large buffers;
+// a full buffer is handed to the kernel and the caller carries on filling
+// the next one. On Linux the buffers are registered with an io_uring once
+// and written with IORING_OP_WRITE_FIXED, and several full buffers are
+// submitted with one io_uring_enter. Where io_uring is unavailable (old
+// kernel, seccomp filter) or not wanted, full buffers are written with
+// pwrite on the calling thread instead; the file produced is the same.
+class AsyncWriter
+{
+	int fd;
+	AsyncRing *ring;	// NULL on the pwrite path
+	vector<char *> buffers;
+	vector<size_t> used;	// bytes in each buffer
+	vector<uint64_t> offsets;	// file offset of each buffer being written
+	vector<int> idle;	// buffers ready to fill
+	int current;	// buffer being filled, -1 if none
+	uint64_t offset;	// file offset of the next buffer
+	unsigned queued;	// writes prepared but not submitted yet
+	unsigned inFlight;	// writes submitted but not completed
+	bool failed;
+	bool submit(int b);
+	bool enter(unsigned minComplete);
+	void reap();
+	bool drain();
+public:
+	static const size_t BUFFER_SIZE = 1 << 20;
+	static const int BUFFERS = 8;
+	static const unsigned BATCH = 4;	// full buffers per io_uring_enter
+
+	AsyncWriter();
+	~AsyncWriter();
+
+	// Creates or truncates file. With useUring false, or when io_uring cannot
+	// be set up, writes go through pwrite. Returns false if the file cannot be
+	// created or the buffers cannot be allocated.
+	bool open(const char *file, bool useUring = true);
+
+	// Appends n bytes. Returns false once any write has failed, or if no
+	// file is open.
+	bool write(const void *data, size_t n);
+	bool write(const string &s);
+
+	// Waits for everything appended so far, then overwrites n bytes at
+	// offset (a header patched once the body is known).
+	bool writeAt(uint64_t offset, const void *data, size_t n);
+
+	// Waits for all writes and closes the file. Returns false if any write
+	// failed.
+	bool close();
+
+	bool usingUring();
+	uint64_t size();	// bytes appended so far
+};
+
+#endif // ASYNC_WRITER_H
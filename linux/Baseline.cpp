@@ -0,0 +1,206 @@
+#include <Baseline.h>
+
+#include <algorithm>
+#include <cmath>
+#include <errno.h>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+string baselineKey(const BenchResult &r)
+{
+	return r.engine + " " + r.op + " " + r.dist + " " + to_string(r.threads) + " " + to_string(r.n);
+}
+
+bool loadBaseline(const char *file, Baseline &baseline, string &error)
+{
+	baseline.clear();
+	ifstream in(file);
+	if (!in)
+	{
+		if (errno == ENOENT)
+			return true;
+		error = string(file) + ": " + strerror(errno);
+		return false;
+	}
+	string line;
+	for (int number = 1; getline(in, line); number++)
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+		istringstream fields(line);
+		string key, field;
+		for (int i = 0; i < 5 && fields >> field; i++)
+			key += (i ? " " : "") + field;
+		vector<double> times;
+		double t;
+		while (fields >> t)
+			times.push_back(t);
+		if (!fields.eof() || times.empty())
+		{
+			error = string(file) + ":" + to_string(number) + ": malformed line";
+			return false;
+		}
+		baseline[key] = times;
+	}
+	return true;
+}
+
+bool saveBaseline(const char *file, const vector<BenchResult> &results, string &error)
+{
+	Baseline baseline;
+	if (!loadBaseline(file, baseline, error))
+		return false;
+	for (size_t i = 0; i < results.size(); i++)
+		if (!results[i].times.empty())
+			baseline[baselineKey(results[i])] = results[i].times;
+	ofstream out(file);
+	out.precision(17);
+	out << "# avlTree bench baseline: engine op dist threads n, then the seconds of each repetition\n";
+	for (Baseline::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+	{
+		out << it->first;
+		for (size_t i = 0; i < it->second.size(); i++)
+			out << " " << it->second[i];
+		out << "\n";
+	}
+	out.close();
+	if (!out)
+	{
+		error = string("cannot write ") + file;
+		return false;
+	}
+	return true;
+}
+
+// Number of ways to order m sample and n base values so that exactly u
+// (sample, base) pairs have the sample value above the base value, for
+// every u; counts[m][n][u] = counts[m-1][n][u-n] + counts[m][n-1][u]
+// depending on whether the largest value is a sample or a base value.
+static vector<double> mannWhitneyCounts(size_t m, size_t n)
+{
+	size_t cells = m * n + 1;
+	vector<vector<double> > row(n + 1, vector<double>(cells, 0)), previous(row);
+	for (size_t i = 0; i <= m; i++)
+	{
+		previous.swap(row);
+		for (size_t j = 0; j <= n; j++)
+		{
+			vector<double> &c = row[j];
+			fill(c.begin(), c.end(), 0.0);
+			if (i == 0 || j == 0)
+			{
+				c[0] = 1;
+				continue;
+			}
+			for (size_t u = 0; u < cells; u++)
+				c[u] = (u >= j ? previous[j][u - j] : 0) + row[j - 1][u];
+		}
+	}
+	return row[n];
+}
+
+double mannWhitneyGreater(const vector<double> &base, const vector<double> &sample)
+{
+	size_t m = sample.size(), n = base.size();
+	if (m == 0 || n == 0)
+		return 1;
+	// U counts the pairs with the sample above, ties as half
+	double u = 0;
+	bool ties = false;
+	for (size_t i = 0; i < m; i++)
+		for (size_t j = 0; j < n; j++)
+			if (sample[i] > base[j])
+				u += 1;
+			else if (sample[i] == base[j])
+			{
+				u += 0.5;
+				ties = true;
+			}
+	if (!ties && m * n <= 400)
+	{
+		vector<double> counts = mannWhitneyCounts(m, n);
+		double atLeast = 0, all = 0;
+		for (size_t k = 0; k < counts.size(); k++)
+		{
+			all += counts[k];
+			if (k >= u)
+				atLeast += counts[k];
+		}
+		return atLeast / all;
+	}
+	// Normal approximation; ties shrink the variance
+	vector<double> pooled(sample);
+	pooled.insert(pooled.end(), base.begin(), base.end());
+	sort(pooled.begin(), pooled.end());
+	double total = (double)pooled.size(), tieTerm = 0;
+	for (size_t i = 0; i < pooled.size();)
+	{
+		size_t j = i;
+		while (j < pooled.size() && pooled[j] == pooled[i])
+			j++;
+		double t = (double)(j - i);
+		tieTerm += t * t * t - t;
+		i = j;
+	}
+	double mean = m * n / 2.0;
+	double variance = m * n / 12.0 * (total + 1 - tieTerm / (total * (total - 1)));
+	if (variance <= 0)
+		return 1;
+	double z = (u - mean - 0.5) / sqrt(variance);
+	return 0.5 * erfc(z / sqrt(2.0));
+}
+
+double mannWhitneyMinP(size_t baseSize, size_t sampleSize)
+{
+	// One arrangement of C(m + n, n) puts every sample value on top
+	double arrangements = 1;
+	for (size_t k = 1; k <= baseSize; k++)
+		arrangements = arrangements * (sampleSize + k) / k;
+	return 1 / arrangements;
+}
+
+static double median(vector<double> values)
+{
+	sort(values.begin(), values.end());
+	size_t m = values.size();
+	return m % 2 ? values[m / 2] : (values[m / 2 - 1] + values[m / 2]) / 2;
+}
+
+void compareBaseline(const Baseline &baseline, const vector<BenchResult> &results, double threshold, double alpha,
+					 vector<BaselineComparison> &comparisons)
+{
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &r = results[i];
+		if (r.times.empty())
+			continue;
+		BaselineComparison c;
+		c.key = baselineKey(r);
+		Baseline::const_iterator it = baseline.find(c.key);
+		c.found = it != baseline.end();
+		c.baseReps = c.found ? it->second.size() : 0;
+		c.reps = r.times.size();
+		c.median = median(r.times);
+		c.baseMedian = c.change = c.effect = 0;
+		c.p = 1;
+		c.regressed = false;
+		if (c.found)
+		{
+			const vector<double> &base = it->second;
+			c.baseMedian = median(base);
+			c.change = c.baseMedian > 0 ? c.median / c.baseMedian - 1 : 0;
+			c.p = mannWhitneyGreater(base, r.times);
+			double slower = 0, faster = 0;
+			for (size_t a = 0; a < r.times.size(); a++)
+				for (size_t b = 0; b < base.size(); b++)
+				{
+					slower += r.times[a] > base[b];
+					faster += r.times[a] < base[b];
+				}
+			c.effect = (slower - faster) / (r.times.size() * base.size());
+			c.regressed = c.change > threshold && c.p < alpha;
+		}
+		comparisons.push_back(c);
+	}
+}
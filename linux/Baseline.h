@@ -0,0 +1,59 @@
+// Baseline.h - Header file for benchmark baselines and regression checks
+
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include "Benchmark.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A baseline file holds the measured repetitions of earlier bench runs,
+// one benchmark per line:
+//   <engine> <op> <dist> <threads> <n> <seconds of each repetition>...
+// Lines starting with # are comments. The first five fields are the key.
+typedef map<string, vector<double> > Baseline;
+
+// "avl find uniform 1 1000000"
+string baselineKey(const BenchResult& r);
+
+// Reads file into baseline. A file that does not exist is an empty
+// baseline; false (error says why) for one that cannot be read or parsed.
+bool loadBaseline(const char* file, Baseline& baseline, string& error);
+// Adds results to the baseline in file, replacing entries with the same
+// key and keeping the others, and writes it back.
+bool saveBaseline(const char* file, const vector<BenchResult>& results, string& error);
+
+// One-sided Mann-Whitney U test: the probability of sample ranking at
+// least this far above base if both came from the same distribution.
+// Exact for small samples without ties, otherwise the normal
+// approximation with tie and continuity corrections.
+double mannWhitneyGreater(const vector<double>& base, const vector<double>& sample);
+// The smallest p mannWhitneyGreater can return for these sample sizes;
+// with too few repetitions no difference is significant.
+double mannWhitneyMinP(size_t baseSize, size_t sampleSize);
+
+// A result compared with its baseline entry.
+typedef struct BaselineComparison {
+	string key;
+	bool found;	// false if the baseline has no entry for key
+	size_t baseReps;	// repetitions in the baseline and in the result
+	size_t reps;
+	double baseMedian;	// seconds
+	double median;
+	double change;	// median / baseMedian - 1, e.g. 0.12 for 12% slower
+	double p;	// mannWhitneyGreater(base, result)
+	double effect;	// Cliff's delta, P(slower) - P(faster) over all pairs, -1..1
+	bool regressed;	// change > threshold and p < alpha
+}BaselineComparison;
+
+// Compares every result that has repetitions with the baseline. A result
+// regressed if its median is more than threshold (a fraction) slower and
+// the slowdown is significant at alpha.
+void compareBaseline(const Baseline& baseline, const vector<BenchResult>& results, double threshold, double alpha,
+					 vector<BaselineComparison>& comparisons);
+
+#endif // BASELINE_H
@@ -0,0 +1,1036 @@
+#include <Benchmark.h>
+#include <AVLTree.h>
+#include <Baseline.h>
+#include <Isolation.h>
+#include <SplayTree.h>
+#include <timer.h>
+#include <Workload.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+// ---------------------------------------------------------------------------
+// Engines
+// ---------------------------------------------------------------------------
+
+// The runner drives the engines through their workload adapters (see
+// WorkloadEngine); benchRun is templated on the concrete adapter, so the
+// timed calls are direct.
+
+static EmployeeInfo benchRecord(int sin)
+{
+	EmployeeInfo e;
+	e.sin = sin;
+	e.emplNumber = sin;
+	e.salary = 50000 + sin % 1000;
+	e.age = 20 + sin % 40;
+	return e;
+}
+
+// ---------------------------------------------------------------------------
+// Workloads
+// ---------------------------------------------------------------------------
+
+// Keys to build a tree of n records from, and the keys an operation then
+// works on. Inserts and removes use n distinct keys (removing all of them
+// drains the tree); finds draw --probes keys from the distribution, with
+// replacement.
+typedef struct BenchKeys {
+	vector<int> build;
+	vector<int> probe;
+}BenchKeys;
+
+static void benchKeys(const BenchOptions &opt, const string &op, CacheMode cache, unsigned seed, BenchKeys &keys)
+{
+	long n = opt.n;
+	long probes = opt.probes > 0 ? opt.probes : cache == CACHE_WARM ? n : min(n, 200L);
+	mt19937 rng(seed);
+	keys.build.resize(n);
+	for (long i = 0; i < n; i++)
+		keys.build[i] = (int)i;
+	if (opt.dist != "sequential")
+		shuffle(keys.build.begin(), keys.build.end(), rng);
+	if (op != "find")
+	{
+		keys.probe = keys.build;
+		return;
+	}
+	keys.probe.resize(probes);
+	if (opt.dist == "sequential")
+		for (long i = 0; i < probes; i++)
+			keys.probe[i] = (int)(i % n);
+	else if (opt.dist == "uniform")
+	{
+		uniform_int_distribution<int> pick(0, (int)n - 1);
+		for (long i = 0; i < probes; i++)
+			keys.probe[i] = pick(rng);
+	}
+	else
+	{
+		// Zipf over ranks; rank r is key build[r], so hot keys are scattered
+		// rather than neighbours
+		vector<double> cdf(n);
+		double sum = 0;
+		for (long i = 0; i < n; i++)
+		{
+			sum += 1.0 / pow(i + 1.0, opt.theta);
+			cdf[i] = sum;
+		}
+		uniform_real_distribution<double> u(0, sum);
+		for (long i = 0; i < probes; i++)
+			keys.probe[i] = keys.build[lower_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin()];
+	}
+}
+
+// One repetition on one thread: builds the tree (untimed unless op is
+// insert), then times every operation. Latencies are appended in ns and
+// the time the operations took altogether is stored in seconds. Finds
+// with a cold cache mode are each preceded by a CacheEvictor sweep, which
+// is neither timed nor counted.
+template <class Engine>
+static void benchRun(Engine &engine, const string &op, CacheMode cache, const BenchKeys &keys, LatencyHistogram &lat,
+					 double &seconds, PerfSample &perf)
+{
+	typedef chrono::steady_clock clock;
+	if (op != "insert")
+		for (size_t i = 0; i < keys.build.size(); i++)
+			engine.insert(benchRecord(keys.build[i]));
+	CacheEvictor *evictor = op == "find" && cache != CACHE_WARM ? new CacheEvictor() : NULL;
+	const vector<int> &probe = keys.probe;
+	long found = 0;
+	int64_t coldNs = 0;
+	PerfCounters counters;
+	counters.start();
+	clock::time_point phase = clock::now();
+	for (size_t i = 0; i < probe.size(); i++)
+	{
+		if (evictor != NULL)
+		{
+			counters.stop();
+			evictor->prepare(cache);
+			counters.resume();
+		}
+		uint64_t start = Timer::ticks();
+		if (op == "insert")
+			engine.insert(benchRecord(probe[i]));
+		else if (op == "find")
+			found += engine.read(probe[i]);
+		else
+			engine.remove(probe[i]);
+		int64_t ns = Timer::ticksToNs(Timer::ticks() - start);
+		lat.record(ns);
+		coldNs += ns;
+	}
+	seconds = chrono::duration<double>(clock::now() - phase).count();
+	counters.stop();
+	if (evictor != NULL)
+	{
+		seconds = coldNs / 1e9;
+		delete evictor;
+	}
+	counters.read(perf);
+	if (op == "find" && found != (long)probe.size())
+		cerr << "benchmark: " << probe.size() - found << " finds missed\n";
+	engine.clear();
+}
+
+static bool knownEngine(const string &engine)
+{
+	WorkloadEngine *e = makeEngine(engine);
+	delete e;
+	return e != NULL;
+}
+
+// Pins the calling thread to cpu unless that is -1; says so once if it
+// cannot.
+static void benchPin(int cpu)
+{
+	static atomic<bool> warned(false);
+	if (cpu >= 0 && !pinToCpu(cpu) && !warned.exchange(true))
+		cerr << "benchmark: cannot pin to CPU " << cpu << ", running unpinned\n";
+}
+
+// Calls f with a fresh adapter of the named engine, so the code f runs
+// is compiled for the concrete adapter.
+template <class F>
+static void withEngine(const string &engine, F f)
+{
+	if (engine == "avl")
+	{
+		TreeEngine<AVL> tree("avl");
+		f(tree);
+	}
+	else if (engine == "wavl")
+	{
+		TreeEngine<WAVL> tree("wavl");
+		f(tree);
+	}
+	else if (engine == "splay")
+	{
+		TreeEngine<SplayTree> tree("splay");
+		f(tree);
+	}
+	else if (engine == "map")
+	{
+		MapEngine table;
+		f(table);
+	}
+	else if (engine == "unordered_map")
+	{
+		UnorderedMapEngine table;
+		f(table);
+	}
+	else
+	{
+		SortedVectorEngine table;
+		f(table);
+	}
+}
+
+// Runs one repetition on the calling thread, pinned to cpu first if that
+// is not -1.
+static void benchDispatch(const string &engine, const string &op, CacheMode cache, const BenchKeys &keys,
+						  LatencyHistogram &lat, double &seconds, PerfSample &perf, int cpu)
+{
+	benchPin(cpu);
+	withEngine(engine, [&](auto &e) { benchRun(e, op, cache, keys, lat, seconds, perf); });
+}
+
+// ---------------------------------------------------------------------------
+// Statistics
+// ---------------------------------------------------------------------------
+
+static void summarize(vector<double> times, const LatencyHistogram &lat, BenchResult &r)
+{
+	r.times = times;
+	sort(times.begin(), times.end());
+	size_t m = times.size();
+	r.median = m % 2 ? times[m / 2] : (times[m / 2 - 1] + times[m / 2]) / 2;
+	r.mean = 0;
+	for (size_t i = 0; i < m; i++)
+		r.mean += times[i] / m;
+	double var = 0;
+	for (size_t i = 0; i < m; i++)
+		var += (times[i] - r.mean) * (times[i] - r.mean);
+	r.stddev = m > 1 ? sqrt(var / (m - 1)) : 0;
+	r.opsPerSec = r.median > 0 ? r.n * r.threads / r.median : 0;
+	r.p50 = lat.percentile(0.50);
+	r.p99 = lat.percentile(0.99);
+	r.p999 = lat.percentile(0.999);
+	for (int e = 0; e < PERF_EVENTS; e++)
+		r.perOp[e] = -1;
+}
+
+// Events per operation from counts summed over the measured repetitions and
+// threads; an event is left out unless every one of them counted it.
+static void perfPerOp(const PerfSample &perf, int expected, double operations, BenchResult &r)
+{
+	for (int e = 0; e < PERF_EVENTS; e++)
+		r.perOp[e] = perf.samples == expected && perf.counted[e] && operations > 0 ? perf.value[e] / operations : -1;
+}
+
+// CSV column / JSON key of each event
+static const char *perfColumns[PERF_EVENTS] = {"cycles_per_op",		 "instructions_per_op", "l1d_misses_per_op",
+											   "llc_misses_per_op", "dtlb_misses_per_op",	"branch_misses_per_op"};
+
+// ---------------------------------------------------------------------------
+// Runner
+// ---------------------------------------------------------------------------
+
+void benchDefaults(BenchOptions &opt)
+{
+	opt.engines.assign(1, "avl");
+	opt.ops.clear();
+	opt.ops.push_back("insert");
+	opt.ops.push_back("find");
+	opt.ops.push_back("remove");
+	opt.caches.assign(1, "warm");
+	opt.n = 1000000;
+	opt.probes = 0;
+	opt.dist = "uniform";
+	opt.theta = 0.99;
+	opt.threads = 1;
+	opt.reps = 5;
+	opt.warmup = 1;
+	opt.seed = 42;
+	opt.clock = "tsc";
+	opt.isolate = false;
+	opt.cpu = -1;
+	opt.workload.clear();
+	opt.sweep = false;
+	opt.sweepFrom = 1000;
+	opt.sweepTo = 100000000;
+	opt.sweepSeconds = 120;
+	opt.jsonFile.clear();
+	opt.csvFile.clear();
+	opt.baselineFile.clear();
+	opt.saveBaselineFile.clear();
+	opt.threshold = 0.05;
+	opt.alpha = 0.05;
+}
+
+void benchUsage(ostream &out)
+{
+	out << "usage: avlTree bench [options]\n"
+		<< "  --engine LIST   avl, wavl, splay, map, unordered_map, sorted_vector\n"
+		<< "                  (comma separated; default avl)\n"
+		<< "  --op LIST       insert, find, remove (default all three)\n"
+		<< "  --cache LIST    warm, tlb-cold, cold: the cache state before each find\n"
+		<< "                  (default warm); cold modes evict between finds and time\n"
+		<< "                  each one alone, see CacheEvictor\n"
+		<< "  --n N           keys per tree (default 1000000)\n"
+		<< "  --probes P      finds per repetition (default n warm, 200 cold)\n"
+		<< "  --dist D        sequential, uniform or zipf (default uniform)\n"
+		<< "  --theta T       Zipf exponent (default 0.99)\n"
+		<< "  --threads T     threads, each with its own tree (default 1)\n"
+		<< "  --reps R        measured repetitions (default 5)\n"
+		<< "  --warmup W      discarded repetitions run first (default 1)\n"
+		<< "  --seed S        workload seed (default 42)\n"
+		<< "  --workload W    run YCSB core workload A-F (on n records, n operations)\n"
+		<< "                  instead of --op; reports each operation type of the mix\n"
+		<< "  --clock C       tsc or system: the clock per-operation latencies are read\n"
+		<< "                  from (default tsc, the system clock where there is none)\n"
+		<< "  --isolate       run each engine x operation (or engine x workload) in a\n"
+		<< "                  fresh child process\n"
+		<< "  --cpu C         pin thread t to CPU C + t\n"
+		<< "  --sweep         instead of the above, double n from --from to --to and\n"
+		<< "                  time insert, find, scan and remove at every size\n"
+		<< "  --from N        smallest size of the sweep (default 1000)\n"
+		<< "  --to N          largest size of the sweep (default 100000000)\n"
+		<< "  --max-seconds S an engine leaves the sweep after a size that took\n"
+		<< "                  longer than S (default 120)\n"
+		<< "  --json FILE     also write the results as JSON\n"
+		<< "  --csv FILE      also write the results (or the sweep) as CSV\n"
+		<< "  --baseline FILE compare every result with its entry in FILE and exit\n"
+		<< "                  with 3 if one regressed: its median is more than\n"
+		<< "                  --threshold slower and a Mann-Whitney test over the\n"
+		<< "                  repetitions says so at --alpha\n"
+		<< "  --save-baseline FILE  add the results to FILE, replacing their old entries\n"
+		<< "  --threshold PCT slowdown that counts as a regression (default 5)\n"
+		<< "  --alpha A       significance level (default 0.05)\n";
+}
+
+static vector<string> splitList(const string &s)
+{
+	vector<string> items;
+	size_t start = 0;
+	while (start <= s.size())
+	{
+		size_t comma = s.find(',', start);
+		if (comma == string::npos)
+			comma = s.size();
+		if (comma > start)
+			items.push_back(s.substr(start, comma - start));
+		start = comma + 1;
+	}
+	return items;
+}
+
+// Parses a number that must be at least min.
+static bool parseNumber(const char *text, double min, double &value)
+{
+	char *end;
+	value = strtod(text, &end);
+	return *text != '\0' && *end == '\0' && value >= min;
+}
+
+bool parseBenchOptions(int argc, char **argv, BenchOptions &opt, string &error)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string flag = argv[i];
+		if (flag == "--isolate" || flag == "--sweep")
+		{
+			(flag == "--isolate" ? opt.isolate : opt.sweep) = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			error = "missing value for " + flag;
+			return false;
+		}
+		const char *value = argv[++i];
+		double number = 0;
+		bool ok = true;
+		if (flag == "--engine")
+			opt.engines = splitList(value);
+		else if (flag == "--op")
+			opt.ops = splitList(value);
+		else if (flag == "--cache")
+		{
+			opt.caches = splitList(value);
+			ok = !opt.caches.empty();
+		}
+		else if (flag == "--dist")
+		{
+			opt.dist = value;
+			ok = opt.dist == "sequential" || opt.dist == "uniform" || opt.dist == "zipf";
+		}
+		else if (flag == "--clock")
+		{
+			opt.clock = value;
+			ok = opt.clock == "tsc" || opt.clock == "system";
+		}
+		else if (flag == "--workload")
+		{
+			opt.workload = value;
+			WorkloadSpec spec;
+			ok = opt.workload.size() == 1 && ycsbWorkload(opt.workload[0], spec);
+		}
+		else if (flag == "--json")
+			opt.jsonFile = value;
+		else if (flag == "--csv")
+			opt.csvFile = value;
+		else if (flag == "--baseline")
+			opt.baselineFile = value;
+		else if (flag == "--save-baseline")
+			opt.saveBaselineFile = value;
+		else if (flag == "--threshold")
+		{
+			ok = parseNumber(value, 0, opt.threshold);
+			opt.threshold /= 100;
+		}
+		else if (flag == "--alpha")
+			ok = parseNumber(value, 0, opt.alpha) && opt.alpha <= 1;
+		else if (flag == "--theta")
+			ok = parseNumber(value, 0, opt.theta);
+		else if (flag == "--max-seconds")
+			ok = parseNumber(value, 0, opt.sweepSeconds);
+		else if (flag == "--from" || flag == "--to")
+		{
+			ok = parseNumber(value, 1, number) && number <= INT32_MAX;
+			(flag == "--from" ? opt.sweepFrom : opt.sweepTo) = (long)number;
+		}
+		else if (flag == "--cpu")
+		{
+			ok = parseNumber(value, 0, number) && number < 65536 && number == (int)number;
+			opt.cpu = (int)number;
+		}
+		else if (flag == "--n" || flag == "--probes" || flag == "--threads" || flag == "--reps" || flag == "--warmup" || flag == "--seed")
+		{
+			ok = parseNumber(value, flag == "--warmup" || flag == "--seed" ? 0 : 1, number) && number <= INT32_MAX;
+			if (flag == "--n")
+				opt.n = (long)number;
+			else if (flag == "--probes")
+				opt.probes = (long)number;
+			else if (flag == "--threads")
+				opt.threads = (int)number;
+			else if (flag == "--reps")
+				opt.reps = (int)number;
+			else if (flag == "--warmup")
+				opt.warmup = (int)number;
+			else
+				opt.seed = (unsigned)number;
+		}
+		else
+		{
+			error = "unknown option " + flag;
+			return false;
+		}
+		if (!ok)
+		{
+			error = "bad value for " + flag + ": " + value;
+			return false;
+		}
+	}
+	return true;
+}
+
+static void logResult(ostream &log, const BenchResult &r)
+{
+	log << "[bench] " << r.engine << " " << r.op << " (" << r.dist << ", n " << r.n << ", " << r.threads << " thread"
+		<< (r.threads > 1 ? "s" : "") << "): median " << r.median * 1e3 << " ms, stddev " << r.stddev * 1e3 << " ms, "
+		<< r.opsPerSec << " ops/sec; latency p50 " << r.p50 << " ns, p99 " << r.p99 << " ns, p99.9 " << r.p999
+		<< " ns\n";
+	if (r.perOp[PERF_CYCLES] < 0 && r.perOp[PERF_INSTRUCTIONS] < 0)
+		return;
+	log << "[bench]   per op:";
+	for (int e = 0; e < PERF_EVENTS; e++)
+		if (r.perOp[e] >= 0)
+			log << " " << perfEventName((PerfEvent)e) << " " << r.perOp[e];
+	if (r.perOp[PERF_CYCLES] > 0 && r.perOp[PERF_INSTRUCTIONS] >= 0)
+		log << ", IPC " << r.perOp[PERF_INSTRUCTIONS] / r.perOp[PERF_CYCLES];
+	log << "\n";
+}
+
+// One repetition of a YCSB workload on one thread, on a fresh engine.
+static void workloadRun(const string &engine, const WorkloadSpec &spec, WorkloadResult *result, int cpu)
+{
+	benchPin(cpu);
+	WorkloadEngine *e = makeEngine(engine);
+	loadWorkload(spec, *e);
+	runWorkload(spec, *e, *result);
+	delete e;
+}
+
+// --workload on one engine: a result per operation type of the mix. Its
+// median is the time a repetition spent in that operation type.
+static void workloadEngine(const BenchOptions &opt, const string &engine, vector<BenchResult> &results, ostream &log)
+{
+	WorkloadSpec spec;
+	workloadDefaults(spec);
+	ycsbWorkload(opt.workload[0], spec);
+	spec.records = opt.n;
+	spec.operations = opt.n;
+	spec.theta = opt.theta;
+	vector<double> times[OP_TYPES];
+	vector<LatencyHistogram> lat(OP_TYPES);
+	uint64_t count[OP_TYPES] = {0};
+	for (int rep = 0; rep < opt.warmup + opt.reps; rep++)
+	{
+		vector<WorkloadResult *> threadResults(opt.threads);
+		vector<WorkloadSpec> threadSpecs(opt.threads, spec);
+		vector<thread> workers;
+		for (int t = 0; t < opt.threads; t++)
+		{
+			threadResults[t] = new WorkloadResult();
+			threadSpecs[t].seed = opt.seed + t;
+			workers.push_back(thread(workloadRun, cref(engine), cref(threadSpecs[t]), threadResults[t],
+									 opt.cpu < 0 ? -1 : opt.cpu + t));
+		}
+		for (int t = 0; t < opt.threads; t++)
+			workers[t].join();
+		for (int op = 0; op < OP_TYPES && rep >= opt.warmup; op++)
+		{
+			double slowest = 0;
+			for (int t = 0; t < opt.threads; t++)
+			{
+				const OpStats &s = threadResults[t]->ops[op];
+				slowest = max(slowest, s.seconds);
+				lat[op].merge(s.latency);
+				count[op] += s.count;
+			}
+			times[op].push_back(slowest);
+		}
+		for (int t = 0; t < opt.threads; t++)
+			delete threadResults[t];
+	}
+	for (int op = 0; op < OP_TYPES; op++)
+	{
+		if (count[op] == 0)
+			continue;
+		BenchResult r;
+		r.engine = engine;
+		r.op = string("ycsb-") + (char)toupper(opt.workload[0]) + "-" + opName((WorkloadOp)op);
+		r.dist = distributionName(spec.dist);
+		r.n = opt.n;
+		r.threads = opt.threads;
+		r.reps = opt.reps;
+		summarize(times[op], lat[op], r);
+		r.opsPerSec = r.median > 0 ? count[op] / opt.reps / r.median : 0;
+		results.push_back(r);
+		logResult(log, r);
+	}
+}
+
+// One engine x operation combination (x cache mode for finds): warmup and
+// measured repetitions, each thread on its own tree.
+static void benchCombination(const BenchOptions &opt, const string &engine, const string &op, CacheMode cache,
+							 vector<BenchResult> &results, ostream &log)
+{
+	// Every thread gets its own key sequence, the same for each engine and
+	// repetition
+	vector<BenchKeys> keys(opt.threads);
+	for (int t = 0; t < opt.threads; t++)
+		benchKeys(opt, op, cache, opt.seed + t, keys[t]);
+	vector<double> times;
+	LatencyHistogram lat;
+	PerfSample perf;
+	perfClear(perf);
+	for (int rep = 0; rep < opt.warmup + opt.reps; rep++)
+	{
+		// Histograms are 35 KB each, so they live on the heap
+		vector<LatencyHistogram> threadLat(opt.threads);
+		vector<double> threadSeconds(opt.threads);
+		vector<PerfSample> threadPerf(opt.threads);
+		if (opt.threads == 1)
+			benchDispatch(engine, op, cache, keys[0], threadLat[0], threadSeconds[0], threadPerf[0], opt.cpu);
+		else
+		{
+			vector<thread> workers;
+			for (int t = 0; t < opt.threads; t++)
+				workers.push_back(thread(benchDispatch, cref(engine), cref(op), cache, cref(keys[t]), ref(threadLat[t]),
+										 ref(threadSeconds[t]), ref(threadPerf[t]), opt.cpu < 0 ? -1 : opt.cpu + t));
+			for (int t = 0; t < opt.threads; t++)
+				workers[t].join();
+		}
+		if (rep < opt.warmup)
+			continue;
+		// A repetition lasts as long as its slowest thread
+		times.push_back(*max_element(threadSeconds.begin(), threadSeconds.end()));
+		for (int t = 0; t < opt.threads; t++)
+		{
+			lat.merge(threadLat[t]);
+			perfAdd(perf, threadPerf[t]);
+		}
+	}
+	BenchResult r;
+	r.engine = engine;
+	r.op = cache == CACHE_WARM ? op : op + "-" + cacheModeName(cache);
+	r.dist = opt.dist;
+	r.n = opt.n;
+	r.threads = opt.threads;
+	r.reps = opt.reps;
+	summarize(times, lat, r);
+	r.opsPerSec = r.median > 0 ? keys[0].probe.size() * opt.threads / r.median : 0;
+	perfPerOp(perf, opt.threads * opt.reps, (double)keys[0].probe.size() * opt.threads * opt.reps, r);
+	results.push_back(r);
+	logResult(log, r);
+}
+
+// ---------------------------------------------------------------------------
+// Isolation
+// ---------------------------------------------------------------------------
+
+// Results travel from an isolated child as one line each; names never hold
+// spaces.
+static string packResults(const vector<BenchResult> &results)
+{
+	ostringstream out;
+	out.precision(17);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &r = results[i];
+		out << r.engine << " " << r.op << " " << r.dist << " " << r.n << " " << r.threads << " " << r.reps << " "
+			<< r.median << " " << r.mean << " " << r.stddev << " " << r.opsPerSec << " " << r.p50 << " " << r.p99
+			<< " " << r.p999;
+		for (int e = 0; e < PERF_EVENTS; e++)
+			out << " " << r.perOp[e];
+		out << " " << r.times.size();
+		for (size_t t = 0; t < r.times.size(); t++)
+			out << " " << r.times[t];
+		out << "\n";
+	}
+	return out.str();
+}
+
+static bool unpackResults(const string &text, vector<BenchResult> &results)
+{
+	istringstream in(text);
+	string line;
+	while (getline(in, line))
+	{
+		istringstream fields(line);
+		BenchResult r;
+		if (!(fields >> r.engine >> r.op >> r.dist >> r.n >> r.threads >> r.reps >> r.median >> r.mean >> r.stddev >>
+			  r.opsPerSec >> r.p50 >> r.p99 >> r.p999))
+			return false;
+		for (int e = 0; e < PERF_EVENTS; e++)
+			if (!(fields >> r.perOp[e]))
+				return false;
+		size_t reps;
+		if (!(fields >> reps))
+			return false;
+		r.times.resize(reps);
+		for (size_t t = 0; t < reps; t++)
+			if (!(fields >> r.times[t]))
+				return false;
+		results.push_back(r);
+	}
+	return true;
+}
+
+// Runs one unit of work (a combination or an engine's workload) in this
+// process, or with --isolate in a child whose results come back over a
+// pipe. A child that fails is reported in error; its results are missing.
+template <class Unit>
+static void runUnit(const BenchOptions &opt, const string &label, Unit unit, vector<BenchResult> &results,
+					string &error, ostream &log)
+{
+	if (!opt.isolate)
+	{
+		unit(results, log);
+		return;
+	}
+	IsolatedRun run;
+	string why;
+	bool ok = runIsolated(
+		[&]() {
+			vector<BenchResult> mine;
+			unit(mine, log);
+			return packResults(mine);
+		},
+		-1, run, why);
+	if (!ok)
+		error = label + ": " + why;
+	else if (!run.exited || run.status != 0 || !unpackResults(run.output, results))
+		error = label + ": child process ended with " + describeExit(run);
+	else
+	{
+		log << "[bench] " << label << ": child process " << run.seconds << " s, peak RSS " << run.peakRssKB / 1024
+			<< " MB\n";
+		return;
+	}
+	log << "[bench] " << error << "\n";
+}
+
+bool runBenchmarks(const BenchOptions &opt, vector<BenchResult> &results, string &error, ostream &log)
+{
+	for (size_t e = 0; e < opt.engines.size(); e++)
+		if (!knownEngine(opt.engines[e]))
+		{
+			error = "unknown engine " + opt.engines[e];
+			return false;
+		}
+	for (size_t o = 0; o < opt.ops.size(); o++)
+		if (opt.ops[o] != "insert" && opt.ops[o] != "find" && opt.ops[o] != "remove")
+		{
+			error = "unknown operation " + opt.ops[o];
+			return false;
+		}
+	vector<CacheMode> caches(opt.caches.size());
+	for (size_t c = 0; c < opt.caches.size(); c++)
+	{
+		if (!parseCacheMode(opt.caches[c], caches[c]))
+		{
+			error = "unknown cache mode " + opt.caches[c];
+			return false;
+		}
+		// A sweep on one thread would evict the others' data mid-search
+		if (caches[c] != CACHE_WARM && opt.threads > 1)
+		{
+			error = "cold finds need --threads 1";
+			return false;
+		}
+	}
+	if (!opt.workload.empty() && opt.theta >= 1)
+	{
+		error = "YCSB workloads need --theta below 1";
+		return false;
+	}
+	error.clear();
+	PerfCounters probe;
+	if (!probe.available())
+		log << "[bench] Hardware counters unavailable (" << probe.unavailableReason() << "), reporting time only\n";
+	else if (!probe.unavailableReason().empty())
+		log << "[bench] Some hardware counters unavailable (" << probe.unavailableReason() << ")\n";
+	if (!Timer::useTsc(opt.clock == "tsc"))
+		log << "[bench] No invariant TSC, latencies are read from the system clock\n";
+	for (size_t e = 0; e < opt.engines.size(); e++)
+	{
+		const string &engine = opt.engines[e];
+		if (!opt.workload.empty())
+		{
+			runUnit(opt, engine + " workload " + opt.workload,
+					[&](vector<BenchResult> &out, ostream &to) { workloadEngine(opt, engine, out, to); }, results,
+					error, log);
+			continue;
+		}
+		for (size_t o = 0; o < opt.ops.size(); o++)
+		{
+			const string &op = opt.ops[o];
+			// Cache modes only apply to finds
+			for (size_t c = 0; c < (op == "find" ? caches.size() : 1); c++)
+			{
+				CacheMode cache = op == "find" ? caches[c] : CACHE_WARM;
+				string label = engine + " " + op + (cache == CACHE_WARM ? "" : string("-") + cacheModeName(cache));
+				runUnit(opt, label,
+						[&](vector<BenchResult> &out, ostream &to) { benchCombination(opt, engine, op, cache, out, to); },
+						results, error, log);
+			}
+		}
+	}
+	Timer::useTsc(false);
+	return true;
+}
+
+bool writeResultsJson(const char *file, const vector<BenchResult> &results)
+{
+	ofstream out(file);
+	out << "[\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &r = results[i];
+		out << "  {\"engine\": \"" << r.engine << "\", \"op\": \"" << r.op << "\", \"dist\": \"" << r.dist
+			<< "\", \"n\": " << r.n << ", \"threads\": " << r.threads << ", \"reps\": " << r.reps
+			<< ", \"median_s\": " << r.median << ", \"mean_s\": " << r.mean << ", \"stddev_s\": " << r.stddev
+			<< ", \"ops_per_s\": " << r.opsPerSec << ", \"p50_ns\": " << r.p50 << ", \"p99_ns\": " << r.p99
+			<< ", \"p999_ns\": " << r.p999 << ", \"times_s\": [";
+		for (size_t t = 0; t < r.times.size(); t++)
+			out << (t ? ", " : "") << r.times[t];
+		out << "]";
+		for (int e = 0; e < PERF_EVENTS; e++)
+		{
+			out << ", \"" << perfColumns[e] << "\": ";
+			if (r.perOp[e] >= 0)
+				out << r.perOp[e];
+			else
+				out << "null";
+		}
+		out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "]\n";
+	out.close();
+	return !!out;
+}
+
+bool writeResultsCsv(const char *file, const vector<BenchResult> &results)
+{
+	ofstream out(file);
+	out << "engine,op,dist,n,threads,reps,median_s,mean_s,stddev_s,ops_per_s,p50_ns,p99_ns,p999_ns";
+	for (int e = 0; e < PERF_EVENTS; e++)
+		out << "," << perfColumns[e];
+	out << "\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &r = results[i];
+		out << r.engine << "," << r.op << "," << r.dist << "," << r.n << "," << r.threads << "," << r.reps << ","
+			<< r.median << "," << r.mean << "," << r.stddev << "," << r.opsPerSec << "," << r.p50 << "," << r.p99
+			<< "," << r.p999;
+		for (int e = 0; e < PERF_EVENTS; e++)
+		{
+			out << ",";
+			if (r.perOp[e] >= 0)
+				out << r.perOp[e]; // empty where not counted
+		}
+		out << "\n";
+	}
+	out.close();
+	return !!out;
+}
+
+// ---------------------------------------------------------------------------
+// Sweep
+// ---------------------------------------------------------------------------
+
+// Median of the per-repeat times of one phase, in ns per operation
+static double sweepMedian(vector<double> ns)
+{
+	sort(ns.begin(), ns.end());
+	size_t m = ns.size();
+	return m % 2 ? ns[m / 2] : (ns[m / 2 - 1] + ns[m / 2]) / 2;
+}
+
+// One repeat of a sweep point: inserts keys.build, finds keys.probe, scans
+// 100 records from each of starts and removes keys.build again. Stores
+// each phase's ns per operation (per record visited for the scans) and
+// the live bytes of the full table.
+template <class Engine>
+static void sweepRun(Engine &engine, const BenchKeys &keys, const vector<int> &starts, double ns[4], long &bytes)
+{
+	typedef chrono::steady_clock clock;
+	const vector<int> &build = keys.build, &probe = keys.probe;
+	clock::time_point t0 = clock::now();
+	for (size_t i = 0; i < build.size(); i++)
+		engine.insert(benchRecord(build[i]));
+	clock::time_point t1 = clock::now();
+	bytes = engine.liveBytes();
+	long found = 0;
+	for (size_t i = 0; i < probe.size(); i++)
+		found += engine.read(probe[i]);
+	clock::time_point t2 = clock::now();
+	long visited = 0;
+	for (size_t i = 0; i < starts.size(); i++)
+		visited += engine.scan(starts[i], 100);
+	clock::time_point t3 = clock::now();
+	for (size_t i = 0; i < build.size(); i++)
+		engine.remove(build[i]);
+	clock::time_point t4 = clock::now();
+	if (found != (long)probe.size())
+		cerr << "sweep: " << probe.size() - found << " finds missed\n";
+	engine.clear();
+	ns[0] = chrono::duration<double, nano>(t1 - t0).count() / build.size();
+	ns[1] = chrono::duration<double, nano>(t2 - t1).count() / probe.size();
+	ns[2] = chrono::duration<double, nano>(t3 - t2).count() / max(visited, 1L);
+	ns[3] = chrono::duration<double, nano>(t4 - t3).count() / build.size();
+}
+
+bool runSweep(const BenchOptions &opt, vector<SweepPoint> &points, string &error, ostream &log)
+{
+	for (size_t e = 0; e < opt.engines.size(); e++)
+		if (!knownEngine(opt.engines[e]))
+		{
+			error = "unknown engine " + opt.engines[e];
+			return false;
+		}
+	if (opt.threads > 1 || opt.isolate || !opt.workload.empty() || !opt.jsonFile.empty() ||
+		!opt.baselineFile.empty() || !opt.saveBaselineFile.empty())
+	{
+		error = "--sweep runs one thread in this process and writes CSV only";
+		return false;
+	}
+	benchPin(opt.cpu);
+	for (size_t e = 0; e < opt.engines.size(); e++)
+	{
+		const string &engine = opt.engines[e];
+		double bytesPerRecord = 0;
+		for (long n = opt.sweepFrom; n <= opt.sweepTo; n *= 2)
+		{
+			// The keys take 8 bytes a record; allow for malloc's overhead on
+			// the table's live bytes
+			long available = availableBytes();
+			double needed = n * (bytesPerRecord * 1.5 + 8);
+			if (available > 0 && needed > available)
+			{
+				log << "[sweep] " << engine << " stops before n " << n << ": needs about " << (long)(needed / (1 << 20))
+					<< " MB, " << available / (1 << 20) << " MB available\n";
+				break;
+			}
+			BenchOptions sized = opt;
+			sized.n = n;
+			sized.probes = n;
+			BenchKeys keys;
+			benchKeys(sized, "find", CACHE_WARM, opt.seed, keys);
+			vector<int> starts(max(1L, n / 100));
+			for (size_t i = 0; i < starts.size(); i++)
+				starts[i] = keys.probe[i];
+			SweepPoint p;
+			p.engine = engine;
+			p.n = n;
+			p.repeats = (int)max(1L, (1L << 20) / n);
+			vector<double> phase[4];
+			long bytes = 0;
+			chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+			for (int r = 0; r < p.repeats; r++)
+			{
+				double ns[4];
+				withEngine(engine, [&](auto &table) { sweepRun(table, keys, starts, ns, bytes); });
+				for (int i = 0; i < 4; i++)
+					phase[i].push_back(ns[i]);
+			}
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+			p.insertNs = sweepMedian(phase[0]);
+			p.findNs = sweepMedian(phase[1]);
+			p.scanNs = sweepMedian(phase[2]);
+			p.removeNs = sweepMedian(phase[3]);
+			p.bytesPerRecord = (double)bytes / n;
+			p.fitsIn = cacheLevelHolding(bytes);
+			bytesPerRecord = p.bytesPerRecord;
+			points.push_back(p);
+			log << "[sweep] " << engine << " n " << n << ": insert " << p.insertNs << " ns, find " << p.findNs
+				<< " ns, scan " << p.scanNs << " ns/record, remove " << p.removeNs << " ns, " << p.bytesPerRecord
+				<< " B/record (" << p.fitsIn << ")\n";
+			if (seconds > opt.sweepSeconds && n * 2 <= opt.sweepTo)
+			{
+				log << "[sweep] " << engine << " stops after n " << n << ": took " << seconds << " s\n";
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+bool writeSweepCsv(const char *file, const vector<SweepPoint> &points)
+{
+	ofstream out(file);
+	out << "engine,n,repeats,insert_ns,find_ns,scan_ns_per_record,remove_ns,bytes_per_record,working_set_bytes,fits_in,"
+		   "insert_ns_per_log2n,find_ns_per_log2n\n";
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		const SweepPoint &p = points[i];
+		double log2n = log2((double)p.n);
+		out << p.engine << "," << p.n << "," << p.repeats << "," << p.insertNs << "," << p.findNs << "," << p.scanNs
+			<< "," << p.removeNs << "," << p.bytesPerRecord << "," << (long)(p.bytesPerRecord * p.n) << ","
+			<< p.fitsIn << "," << p.insertNs / log2n << "," << p.findNs / log2n << "\n";
+	}
+	out.close();
+	return !!out;
+}
+
+// Prints a line per comparison and names the regressions on stderr;
+// returns how many there were.
+static int reportBaseline(const BenchOptions &opt, const Baseline &baseline, const vector<BenchResult> &results,
+						  ostream &log)
+{
+	vector<BaselineComparison> comparisons;
+	compareBaseline(baseline, results, opt.threshold, opt.alpha, comparisons);
+	int regressions = 0;
+	for (size_t i = 0; i < comparisons.size(); i++)
+	{
+		const BaselineComparison &c = comparisons[i];
+		log << "[baseline] " << c.key << ": ";
+		if (!c.found)
+		{
+			log << "no baseline entry\n";
+			continue;
+		}
+		log << "median " << c.baseMedian * 1e3 << " ms -> " << c.median * 1e3 << " ms (" << (c.change >= 0 ? "+" : "")
+			<< c.change * 100 << "%), p " << c.p << ", effect " << c.effect;
+		if (mannWhitneyMinP(c.baseReps, c.reps) >= opt.alpha)
+			log << " (too few repetitions to reach alpha " << opt.alpha << ")";
+		log << (c.regressed ? " REGRESSION" : "") << "\n";
+		if (!c.regressed)
+			continue;
+		cerr << "bench: regression: " << c.key << " is " << c.change * 100 << "% slower (Cliff's delta " << c.effect
+			 << ", p " << c.p << ")\n";
+		regressions++;
+	}
+	log << "[baseline] " << regressions << " of " << comparisons.size() << " benchmarks regressed (threshold "
+		<< opt.threshold * 100 << "%, alpha " << opt.alpha << ")\n";
+	return regressions;
+}
+
+int benchMain(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+		{
+			benchUsage(cout);
+			return 0;
+		}
+	BenchOptions opt;
+	benchDefaults(opt);
+	vector<BenchResult> results;
+	string error;
+	if (parseBenchOptions(argc, argv, opt, error) && opt.sweep)
+	{
+		vector<SweepPoint> points;
+		if (!runSweep(opt, points, error, cout))
+		{
+			cerr << "bench: " << error << "\n";
+			benchUsage(cerr);
+			return 2;
+		}
+		if (!opt.csvFile.empty() && !writeSweepCsv(opt.csvFile.c_str(), points))
+		{
+			cerr << "bench: cannot write " << opt.csvFile << "\n";
+			return 1;
+		}
+		return 0;
+	}
+	// Read the baseline first, so a bad one does not cost a run
+	Baseline baseline;
+	if (error.empty() && !opt.baselineFile.empty() && !loadBaseline(opt.baselineFile.c_str(), baseline, error))
+	{
+		cerr << "bench: " << error << "\n";
+		return 1;
+	}
+	if (!error.empty() || !runBenchmarks(opt, results, error, cout))
+	{
+		cerr << "bench: " << error << "\n";
+		benchUsage(cerr);
+		return 2;
+	}
+	int rc = 0;
+	if (!error.empty())
+	{
+		cerr << "bench: " << error << "\n";
+		rc = 1;
+	}
+	if (!opt.jsonFile.empty() && !writeResultsJson(opt.jsonFile.c_str(), results))
+	{
+		cerr << "bench: cannot write " << opt.jsonFile << "\n";
+		rc = 1;
+	}
+	if (!opt.csvFile.empty() && !writeResultsCsv(opt.csvFile.c_str(), results))
+	{
+		cerr << "bench: cannot write " << opt.csvFile << "\n";
+		rc = 1;
+	}
+	if (!opt.baselineFile.empty() && reportBaseline(opt, baseline, results, cout) > 0)
+		rc = 3;
+	if (!opt.saveBaselineFile.empty() && !saveBaseline(opt.saveBaselineFile.c_str(), results, error))
+	{
+		cerr << "bench: " << error << "\n";
+		rc = rc ? rc : 1;
+	}
+	return rc;
+}
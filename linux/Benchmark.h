@@ -0,0 +1,118 @@
+// Benchmark.h - Header file for the non-interactive benchmark runner
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "CacheControl.h"
+#include "PerfCounters.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One benchmark invocation: every engine x operation combination is run
+// reps times after warmup discarded repetitions. See benchUsage() for the
+// command line.
+typedef struct BenchOptions {
+	vector<string> engines;	// avl, wavl, splay, map, unordered_map, sorted_vector
+	vector<string> ops;	// insert, find, remove
+	vector<string> caches;	// warm, tlb-cold, cold: cache state before each find
+	long n;	// keys per tree
+	long probes;	// finds per repetition; 0 for n when warm, 200 when cold
+	string dist;	// sequential, uniform or zipf
+	double theta;	// Zipf exponent
+	int threads;	// each thread drives its own tree; the trees are not shared
+	int reps;	// measured repetitions
+	int warmup;	// repetitions run first and left out of the statistics
+	unsigned seed;
+	string clock;	// tsc or system, see Timer::useTsc
+	bool isolate;	// run each combination in a child process (see runIsolated)
+	int cpu;	// if not -1, thread t is pinned to CPU cpu + t
+	string workload;	// YCSB core workload letter, replaces ops if set
+	bool sweep;	// run runSweep instead of the combinations
+	long sweepFrom;	// smallest and largest size of the sweep
+	long sweepTo;
+	double sweepSeconds;	// an engine leaves the sweep after a size that took longer
+	string jsonFile;	// machine-readable copies of the results, if set
+	string csvFile;
+	string baselineFile;	// compare the results with this baseline (Baseline.h)
+	string saveBaselineFile;	// and/or add them to this one
+	double threshold;	// slowdown of the median, as a fraction, that fails the run
+	double alpha;	// significance level of the Mann-Whitney test
+}BenchOptions;
+
+// Statistics of one engine x operation combination over the measured
+// repetitions.
+typedef struct BenchResult {
+	string engine;
+	string op;	// insert, find, find-tlb-cold, find-cold, remove, or
+				// ycsb-<letter>-<operation type>
+	string dist;
+	long n;
+	int threads;
+	int reps;
+	vector<double> times;	// seconds the timed operations of each measured repetition took
+	double median;
+	double mean;
+	double stddev;
+	double opsPerSec;	// operations per repetition * threads / median
+	double p50;	// latency of a single operation, ns, from a LatencyHistogram
+	double p99;
+	double p999;
+	// Hardware events per operation over the measured repetitions, -1 where
+	// not counted (no PMU, or a YCSB workload). They include the two clock
+	// reads around each operation.
+	double perOp[PERF_EVENTS];
+}BenchResult;
+
+// One size of a --sweep on one engine: each operation over the whole
+// table, in ns per operation.
+typedef struct SweepPoint {
+	string engine;
+	long n;
+	int repeats;	// small sizes are repeated until about 1M operations each
+	double insertNs;	// building the table from empty, keys in --dist order
+	double findNs;	// n lookups drawn from --dist
+	double scanNs;	// per record visited by n / 100 scans of 100 records
+	double removeNs;	// draining the table in insertion order
+	double bytesPerRecord;	// liveBytes() / n when full
+	string fitsIn;	// the smallest cache the live bytes fit in (cacheLevelHolding)
+}SweepPoint;
+
+void benchDefaults(BenchOptions& opt);
+void benchUsage(ostream& out);
+
+// Parses "--engine avl,map --op find --n 1000000 ..." (argv[0] is skipped).
+// Returns false with a message in error on an unknown flag or bad value.
+bool parseBenchOptions(int argc, char** argv, BenchOptions& opt, string& error);
+
+// Runs every combination, printing a line per result as it finishes.
+// Returns false (error says why) for an unknown engine or operation. With
+// isolate, a child process that fails leaves its results out and sets
+// error; the other combinations still run and true is returned.
+bool runBenchmarks(const BenchOptions& opt, vector<BenchResult>& results, string& error, ostream& log);
+
+bool writeResultsJson(const char* file, const vector<BenchResult>& results);
+bool writeResultsCsv(const char* file, const vector<BenchResult>& results);
+
+// --sweep: doubles n from sweepFrom up to sweepTo on every engine, printing
+// a line per point. An engine stops early when the next size would not fit
+// in the available memory, or when a size took longer than sweepSeconds.
+// Returns false (error says why) for an unknown engine or an option the
+// sweep does not support.
+bool runSweep(const BenchOptions& opt, vector<SweepPoint>& points, string& error, ostream& log);
+// One row per point. ns per operation divided by log2(n) stays flat while
+// an operation is O(log n) (O(n log n) for the table) and steps up where
+// the table outgrows a cache or the TLB's reach.
+bool writeSweepCsv(const char* file, const vector<SweepPoint>& points);
+
+// "avlTree bench ...": parses argv (argv[0] is "bench"), runs and writes the
+// requested files, then compares with and saves the baselines. Returns the
+// process exit code: 0, 1 if an isolated run failed or a file could not be
+// read or written, 2 for a bad command line, 3 if a result regressed
+// against the baseline.
+int benchMain(int argc, char** argv);
+
+#endif // BENCHMARK_H
@@ -0,0 +1,161 @@
+#include <CacheControl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+const char *cacheModeName(CacheMode mode)
+{
+	static const char *names[CACHE_MODES] = {"warm", "tlb-cold", "cold"};
+	return names[mode];
+}
+
+bool parseCacheMode(const string &name, CacheMode &mode)
+{
+	for (int m = 0; m < CACHE_MODES; m++)
+		if (name == cacheModeName((CacheMode)m))
+		{
+			mode = (CacheMode)m;
+			return true;
+		}
+	return false;
+}
+
+// Reads the first line of a sysfs file; false if there is none.
+static bool readLine(const string &path, char *text, int size)
+{
+	FILE *f = fopen(path.c_str(), "r");
+	if (f == NULL)
+		return false;
+	bool ok = fgets(text, size, f) != NULL;
+	fclose(f);
+	return ok;
+}
+
+// The data or unified cache of a level in sysfs, e.g. "48K" -> 49152
+static long sysfsCacheSize(int level)
+{
+	for (int index = 0; index < 16; index++)
+	{
+		string dir = "/sys/devices/system/cpu/cpu0/cache/index" + to_string(index) + "/";
+		char text[64];
+		if (!readLine(dir + "level", text, sizeof(text)))
+			break;
+		if (atoi(text) != level || !readLine(dir + "type", text, sizeof(text)) || strncmp(text, "Instruction", 11) == 0)
+			continue;
+		if (!readLine(dir + "size", text, sizeof(text)))
+			continue;
+		char *unit;
+		long size = strtol(text, &unit, 10);
+		if (*unit == 'K')
+			size <<= 10;
+		else if (*unit == 'M')
+			size <<= 20;
+		return size;
+	}
+	return 0;
+}
+
+long cacheSize(int level)
+{
+	static long sizes[4] = {-1, -1, -1, -1};
+	if (level < 1 || level > 3)
+		return 0;
+	if (sizes[level] < 0)
+	{
+		long size = sysfsCacheSize(level);
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+		const int names[4] = {0, _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE};
+		if (size <= 0)
+			size = sysconf(names[level]);
+#endif
+		sizes[level] = size > 0 ? size : 0;
+	}
+	return sizes[level];
+}
+
+int lastCacheLevel()
+{
+	for (int level = 3; level >= 1; level--)
+		if (cacheSize(level) > 0)
+			return level;
+	return 0;
+}
+
+string cacheLevelHolding(long bytes)
+{
+	int last = lastCacheLevel();
+	for (int level = 1; level <= last; level++)
+		if (bytes <= cacheSize(level))
+			return level == last ? "LLC" : "L" + to_string(level);
+	return "DRAM";
+}
+
+// A TLB-cold sweep touches this many pages
+static const size_t tlbPages = 16384;
+
+CacheEvictor::CacheEvictor() : sink(0)
+{
+	long lineSize = 0;
+#if defined(_SC_LEVEL1_DCACHE_LINESIZE)
+	lineSize = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+	line = lineSize > 0 ? lineSize : 64;
+	page = sysconf(_SC_PAGESIZE);
+	bytes = 2 * (size_t)cacheSize(lastCacheLevel());
+	if (bytes < tlbPages * page)
+		bytes = tlbPages * page;
+#if defined(__linux__)
+	void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	buffer = p == MAP_FAILED ? NULL : (char *)p;
+	// Huge pages would cover the TLB sweep with a handful of entries
+	if (buffer != NULL)
+		madvise(buffer, bytes, MADV_NOHUGEPAGE);
+#else
+	buffer = (char *)malloc(bytes);
+#endif
+	if (buffer == NULL)
+	{
+		bytes = 0;
+		return;
+	}
+	for (size_t i = 0; i < bytes; i += page)
+		memset(buffer + i, (int)(i / page), page);
+}
+
+CacheEvictor::~CacheEvictor()
+{
+	if (buffer == NULL)
+		return;
+#if defined(__linux__)
+	munmap(buffer, bytes);
+#else
+	free(buffer);
+#endif
+}
+
+void CacheEvictor::prepare(CacheMode mode)
+{
+	uint64_t sum = 0;
+	if (mode == CACHE_COLD)
+		for (size_t i = 0; i < bytes; i += line)
+			sum += *(volatile uint64_t *)(buffer + i);
+	else if (mode == CACHE_TLB_COLD)
+	{
+		// A different line on each page, so the lines spread over the cache
+		// sets instead of all landing in the same one
+		size_t linesPerPage = page / line;
+		for (size_t p = 0; p < tlbPages && (p + 1) * page <= bytes; p++)
+			sum += *(volatile uint64_t *)(buffer + p * page + (p * 7 % linesPerPage) * line);
+	}
+	sink += sum;
+}
+
+size_t CacheEvictor::bufferBytes() const
+{
+	return bytes;
+}
@@ -0,0 +1,68 @@
+// CacheControl.h - Header file for the cache state of search measurements
+
+#ifndef CACHE_CONTROL_H
+#define CACHE_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+// What the caches hold when a measured search starts.
+enum CacheMode {
+	CACHE_WARM,	// whatever earlier searches left there
+	CACHE_TLB_COLD,	// data caches mostly warm, TLB entries evicted
+	CACHE_COLD,	// data caches and TLB evicted
+	CACHE_MODES
+};
+
+// "warm", "tlb-cold", "cold"
+const char* cacheModeName(CacheMode mode);
+// The reverse; false for any other name.
+bool parseCacheMode(const string& name, CacheMode& mode);
+
+// Size in bytes of the level 1 data cache, the level 2 or the level 3
+// cache of CPU 0, read from /sys/devices/system/cpu/cpu0/cache or else
+// sysconf; 0 where the level does not exist or is unknown. On a VM these
+// are what the hypervisor reports, which for the last level is often the
+// whole host's cache.
+long cacheSize(int level);
+// The last level that exists (3, 2, 1), 0 if none is known.
+int lastCacheLevel();
+// "L1", "L2", "LLC" or "DRAM": the smallest cache bytes fits in. A
+// working set never gets a cache to itself, so this is where it could
+// live, not where it does.
+string cacheLevelHolding(long bytes);
+
+// Brings the caches into a CacheMode before each cold search by sweeping a
+// buffer of its own:
+//  - cold reads one word of every cache line of a buffer twice the size of
+//    the last-level cache (at least 64 MB), so the lines of whatever was
+//    searched before are replaced, and so are the TLB entries;
+//  - tlb-cold reads one line of each of 16384 pages, more than any second
+//    level TLB holds, but only 1 MB of data. It also evicts L1 and some of
+//    L2, but leaves the last-level cache warm.
+// The buffer is allocated and faulted in once by the constructor (a page
+// that was never written reads as the shared zero page and would evict
+// nothing). A sweep of a large buffer takes tens of milliseconds, so cold
+// searches are measured one at a time, with the sweep left out.
+class CacheEvictor
+{
+	char* buffer;
+	size_t bytes;
+	size_t line;
+	size_t page;
+	uint64_t sink;	// what the sweeps read, so they are not optimized away
+public:
+	CacheEvictor();
+	~CacheEvictor();
+	CacheEvictor(const CacheEvictor&) = delete;
+	CacheEvictor& operator=(const CacheEvictor&) = delete;
+
+	// Sweeps as mode requires; does nothing for CACHE_WARM.
+	void prepare(CacheMode mode);
+	size_t bufferBytes() const;
+};
+
+#endif // CACHE_CONTROL_H
@@ -0,0 +1,677 @@
+// GenericAVL.h - AVL tree generic over key, payload, ordering and node layout
+
+#ifndef GENERIC_AVL_H
+#define GENERIC_AVL_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Key extractors: how AVLTree gets the key out of a stored value.
+template <class Key>
+struct IdentityKey
+{
+	const Key &operator()(const Key &v) const
+	{
+		return v;
+	}
+};
+
+// Node layout policies. A policy's Pool<Value> owns the nodes; Ref names a
+// node (NIL is none), at() reaches it, value() the value in it and
+// make()/destroy() create and free one. References returned by at() stay
+// valid until the node is destroyed.
+
+// Heap-allocated nodes linked by pointers. For EmployeeInfo the node is
+// AVL's own (see AVLTree.h).
+struct PointerNodes
+{
+	template <class Value>
+	class Pool
+	{
+	public:
+		struct Node
+		{
+			Value value;
+			Node *left;
+			Node *right;
+			int height;
+
+			template <class... Args>
+			Node(Args &&...args) : value(std::forward<Args>(args)...), left(NULL), right(NULL), height(0)
+			{
+			}
+		};
+		typedef Node *Ref;
+		static constexpr Ref NIL = NULL;
+
+		static Value &value(Node &n)
+		{
+			return n.value;
+		}
+
+		Node &at(Ref r)
+		{
+			return *r;
+		}
+
+		const Node &at(Ref r) const
+		{
+			return *r;
+		}
+
+		template <class... Args>
+		Ref make(Args &&...args)
+		{
+			return new Node(std::forward<Args>(args)...);
+		}
+
+		void destroy(Ref r)
+		{
+			delete r;
+		}
+
+		// Frees every node without visiting them; false if the caller has to
+		// destroy them one by one.
+		bool releaseAll()
+		{
+			return false;
+		}
+	};
+};
+
+// Nodes in 4096-slot chunks addressed by 32-bit indices: two children cost 8
+// bytes instead of 16, and freed slots are reused through a free list
+// threaded through the left links. Chunks never move, so at() references
+// stay valid while other nodes are added.
+struct IndexNodes
+{
+	template <class Value>
+	class Pool
+	{
+		static const uint32_t CHUNK_BITS = 12;
+		static const uint32_t CHUNK = 1u << CHUNK_BITS;
+
+	public:
+		struct Node
+		{
+			typename std::aligned_storage<sizeof(Value), alignof(Value)>::type storage;
+			uint32_t left;
+			uint32_t right;
+			int32_t height;
+
+			Value &valueRef()
+			{
+				return *reinterpret_cast<Value *>(&storage);
+			}
+		};
+		typedef uint32_t Ref;
+		static constexpr Ref NIL = UINT32_MAX;
+
+		static Value &value(Node &n)
+		{
+			return n.valueRef();
+		}
+
+	private:
+		std::vector<std::unique_ptr<Node[]> > chunks;
+		uint32_t used;	// slots handed out at least once
+		uint32_t freeList;
+
+	public:
+		Pool() : used(0), freeList(NIL)
+		{
+		}
+
+		~Pool()
+		{
+			releaseAll();
+		}
+
+		Node &at(Ref r)
+		{
+			return chunks[r >> CHUNK_BITS][r & (CHUNK - 1)];
+		}
+
+		const Node &at(Ref r) const
+		{
+			return chunks[r >> CHUNK_BITS][r & (CHUNK - 1)];
+		}
+
+		template <class... Args>
+		Ref make(Args &&...args)
+		{
+			Ref r = freeList;
+			if (r != NIL)
+				freeList = at(r).left;
+			else
+			{
+				if (used % CHUNK == 0)
+					chunks.push_back(std::unique_ptr<Node[]>(new Node[CHUNK]));
+				r = used++;
+			}
+			Node &n = at(r);
+			new (&n.storage) Value(std::forward<Args>(args)...);
+			n.left = n.right = NIL;
+			n.height = 0;
+			return r;
+		}
+
+		void destroy(Ref r)
+		{
+			Node &n = at(r);
+			if constexpr (!std::is_trivially_destructible<Value>::value)
+				n.valueRef().~Value();
+			n.left = freeList;
+			freeList = r;
+		}
+
+		// Values without destructors can be dropped chunk by chunk.
+		bool releaseAll()
+		{
+			if constexpr (!std::is_trivially_destructible<Value>::value)
+				return false;
+			chunks.clear();
+			used = 0;
+			freeList = NIL;
+			return true;
+		}
+	};
+};
+
+// Capacity nodes in an array inside the pool, addressed by 32-bit indices,
+// for trees that must not allocate after construction. make() needs a free
+// slot: the caller checks the tree's size against Capacity first.
+template <size_t Capacity>
+struct FixedNodes
+{
+	template <class Value>
+	class Pool
+	{
+		static_assert(Capacity > 0 && Capacity < UINT32_MAX, "capacity must fit a 32-bit slot index");
+
+	public:
+		struct Node
+		{
+			typename std::aligned_storage<sizeof(Value), alignof(Value)>::type storage;
+			uint32_t left;	// the next free slot while free
+			uint32_t right;
+			int32_t height;
+
+			Value &valueRef()
+			{
+				return *reinterpret_cast<Value *>(&storage);
+			}
+		};
+		typedef uint32_t Ref;
+		static constexpr Ref NIL = UINT32_MAX;
+
+		static Value &value(Node &n)
+		{
+			return n.valueRef();
+		}
+
+	private:
+		Node slots[Capacity];
+		uint32_t freeList;	// first free slot, NIL when full
+
+		void relinkAll()
+		{
+			for (size_t i = 0; i < Capacity; i++)
+				slots[i].left = i + 1 < Capacity ? (uint32_t)(i + 1) : NIL;
+			freeList = 0;
+		}
+
+	public:
+		Pool()
+		{
+			relinkAll();
+		}
+
+		Node &at(Ref r)
+		{
+			return slots[r];
+		}
+
+		const Node &at(Ref r) const
+		{
+			return slots[r];
+		}
+
+		template <class... Args>
+		Ref make(Args &&...args)
+		{
+			Ref r = freeList;
+			Node &n = slots[r];
+			freeList = n.left;
+			new (&n.storage) Value(std::forward<Args>(args)...);
+			n.left = n.right = NIL;
+			n.height = 0;
+			return r;
+		}
+
+		void destroy(Ref r)
+		{
+			Node &n = slots[r];
+			if constexpr (!std::is_trivially_destructible<Value>::value)
+				n.valueRef().~Value();
+			n.left = freeList;
+			freeList = r;
+		}
+
+		// Values without destructors are dropped by relinking every slot,
+		// O(Capacity) however few are in use.
+		bool releaseAll()
+		{
+			if constexpr (!std::is_trivially_destructible<Value>::value)
+				return false;
+			relinkAll();
+			return true;
+		}
+	};
+};
+
+// AVL tree of Values ordered by KeyOf()(value) under Compare. Values are
+// stored in the nodes and may be move-only; of several values with equal
+// keys the first one inserted is kept. StaticAVL is this tree with
+// FixedNodes, and AVL and WAVL (AVLTree.h) are this tree with PointerNodes
+// for EmployeeInfo.
+//
+// The operations are written once, on subtrees, and call a Hooks object at
+// each step; a tree built on this one passes its own to add to them (AVL
+// faults spilled subtrees in, keeps its mirror up to date and rebalances by
+// its Balance policy) instead of keeping a copy of them. A Hooks object has
+//   visit(t)                 t is reached on the way down, before its key
+//                            and links are read
+//   open(t)                  t's children are about to be read by a
+//                            rotation
+//   relink(t, link, child)   sets link, one of t's, to child
+//   moved(t)                 t's value was replaced by its successor's
+//   rotated()                a single rotation was done
+//   afterInsert(t)           a subtree of t grew (or shrank); repairs t
+//   afterRemove(t)           and returns the subtree's new root
+//   destroy(t)               frees a node that left the tree
+// The public functions use NoHooks: a plain AVL tree.
+template <class Key, class Value, class Compare = std::less<Key>, class NodePolicy = PointerNodes,
+		  class KeyOf = IdentityKey<Key> >
+class AVLTree
+{
+protected:
+	typedef typename NodePolicy::template Pool<Value> PoolType;
+	typedef typename PoolType::Ref Ref;
+	typedef typename PoolType::Node Node;
+	static constexpr Ref NIL = PoolType::NIL;
+
+	PoolType pool;
+	Ref root;
+	size_t count;	// values in the tree, as kept by the public functions
+	Compare less;
+	KeyOf keyOf;
+
+	static Value &valueOf(Node &n)
+	{
+		return PoolType::value(n);
+	}
+
+	static const Value &valueOf(const Node &n)
+	{
+		return PoolType::value(const_cast<Node &>(n));
+	}
+
+	decltype(auto) keyAt(Ref t) const
+	{
+		return keyOf(valueOf(pool.at(t)));
+	}
+
+	int height(Ref t) const
+	{
+		return t == NIL ? -1 : pool.at(t).height;
+	}
+
+	void update(Ref t)
+	{
+		Node &n = pool.at(t);
+		n.height = std::max(height(n.left), height(n.right)) + 1;
+	}
+
+	struct NoHooks
+	{
+		AVLTree &tree;
+
+		void visit(Ref)
+		{
+		}
+
+		void open(Ref)
+		{
+		}
+
+		void relink(Ref, Ref &link, Ref child)
+		{
+			link = child;
+		}
+
+		void moved(Ref)
+		{
+		}
+
+		void rotated()
+		{
+		}
+
+		Ref afterInsert(Ref t)
+		{
+			return tree.rebalance(t, *this);
+		}
+
+		Ref afterRemove(Ref t)
+		{
+			return tree.rebalance(t, *this);
+		}
+
+		void destroy(Ref t)
+		{
+			tree.pool.destroy(t);
+		}
+	};
+
+	template <class Hooks>
+	Ref rotateRight(Ref t, Hooks &hooks)
+	{
+		Ref u = pool.at(t).left;
+		hooks.open(u);
+		pool.at(t).left = pool.at(u).right;
+		pool.at(u).right = t;
+		update(t);
+		update(u);
+		hooks.rotated();
+		return u;
+	}
+
+	template <class Hooks>
+	Ref rotateLeft(Ref t, Hooks &hooks)
+	{
+		Ref u = pool.at(t).right;
+		hooks.open(u);
+		pool.at(t).right = pool.at(u).left;
+		pool.at(u).left = t;
+		update(t);
+		update(u);
+		hooks.rotated();
+		return u;
+	}
+
+	// Left rotation of t's left child, then right rotation of t.
+	template <class Hooks>
+	Ref rotateLeftRight(Ref t, Hooks &hooks)
+	{
+		pool.at(t).left = rotateLeft(pool.at(t).left, hooks);
+		return rotateRight(t, hooks);
+	}
+
+	template <class Hooks>
+	Ref rotateRightLeft(Ref t, Hooks &hooks)
+	{
+		pool.at(t).right = rotateRight(pool.at(t).right, hooks);
+		return rotateLeft(t, hooks);
+	}
+
+	// The strict AVL repair: restores the height balance at t.
+	template <class Hooks>
+	Ref rebalance(Ref t, Hooks &hooks)
+	{
+		Node &n = pool.at(t);
+		int balance = height(n.left) - height(n.right);
+		if (balance == 2)
+		{
+			if (height(pool.at(n.left).left) < height(pool.at(n.left).right))
+				return rotateLeftRight(t, hooks);
+			return rotateRight(t, hooks);
+		}
+		if (balance == -2)
+		{
+			if (height(pool.at(n.right).right) < height(pool.at(n.right).left))
+				return rotateRightLeft(t, hooks);
+			return rotateLeft(t, hooks);
+		}
+		update(t);
+		return t;
+	}
+
+	// The node holding k in the subtree t, NIL if none.
+	template <class Hooks>
+	Ref findAt(Ref t, const Key &k, Hooks &hooks)
+	{
+		while (t != NIL)
+		{
+			hooks.visit(t);
+			const Node &n = pool.at(t);
+			const Key &nk = keyOf(valueOf(n));
+			if (less(k, nk))
+				t = n.left;
+			else if (less(nk, k))
+				t = n.right;
+			else
+				return t;
+		}
+		return NIL;
+	}
+
+	// Inserts below t the node make() returns, calling make only once the
+	// key k is known to be absent; inserted tells which case it was.
+	// Returns the subtree's new root.
+	template <class Make, class Hooks>
+	Ref insertAt(const Key &k, Ref t, Make &make, bool &inserted, Hooks &hooks)
+	{
+		if (t == NIL)
+		{
+			inserted = true;
+			return make();
+		}
+		hooks.visit(t);
+		if (less(k, keyAt(t)))
+		{
+			Ref l = insertAt(k, pool.at(t).left, make, inserted, hooks);
+			hooks.relink(t, pool.at(t).left, l);
+		}
+		else if (less(keyAt(t), k))
+		{
+			Ref r = insertAt(k, pool.at(t).right, make, inserted, hooks);
+			hooks.relink(t, pool.at(t).right, r);
+		}
+		else
+			return t; // Duplicate key, nothing changed
+		return inserted ? hooks.afterInsert(t) : t;
+	}
+
+	// Removes k from the subtree t; returns its new root.
+	template <class Hooks>
+	Ref removeAt(const Key &k, Ref t, bool &removed, Hooks &hooks)
+	{
+		if (t == NIL)
+			return NIL;
+		hooks.visit(t);
+		if (less(k, keyAt(t)))
+		{
+			Ref l = removeAt(k, pool.at(t).left, removed, hooks);
+			hooks.relink(t, pool.at(t).left, l);
+		}
+		else if (less(keyAt(t), k))
+		{
+			Ref r = removeAt(k, pool.at(t).right, removed, hooks);
+			hooks.relink(t, pool.at(t).right, r);
+		}
+		else if (pool.at(t).left != NIL && pool.at(t).right != NIL)
+		{
+			// Two children: the in-order successor takes t's place
+			Ref s = NIL;
+			Ref right = unlinkMin(pool.at(t).right, s, hooks);
+			removed = true;
+			if constexpr (std::is_trivially_copyable<Value>::value)
+			{
+				// Cheap to copy: t keeps its place in the tree
+				valueOf(pool.at(t)) = valueOf(pool.at(s));
+				hooks.moved(t);
+				hooks.relink(t, pool.at(t).right, right);
+				hooks.destroy(s);
+			}
+			else
+			{
+				// Relink s in t's place instead, so values are never moved
+				// (they need not be assignable, and pointers to them from
+				// find() stay valid)
+				hooks.relink(s, pool.at(s).left, pool.at(t).left);
+				hooks.relink(s, pool.at(s).right, right);
+				pool.at(s).height = pool.at(t).height;
+				hooks.destroy(t);
+				t = s;
+			}
+		}
+		else
+		{
+			Ref child = pool.at(t).left != NIL ? pool.at(t).left : pool.at(t).right;
+			hooks.destroy(t);
+			removed = true;
+			return child;
+		}
+		return removed ? hooks.afterRemove(t) : t;
+	}
+
+	// Detaches the leftmost node below t (not freeing it) into min; returns
+	// the new subtree root.
+	template <class Hooks>
+	Ref unlinkMin(Ref t, Ref &min, Hooks &hooks)
+	{
+		hooks.visit(t);
+		if (pool.at(t).left == NIL)
+		{
+			min = t;
+			return pool.at(t).right;
+		}
+		Ref l = unlinkMin(pool.at(t).left, min, hooks);
+		hooks.relink(t, pool.at(t).left, l);
+		return hooks.afterRemove(t);
+	}
+
+	template <class Make>
+	bool insertKey(const Key &k, Make make)
+	{
+		NoHooks hooks = {*this};
+		bool inserted = false;
+		root = insertAt(k, root, make, inserted, hooks);
+		count += inserted;
+		return inserted;
+	}
+
+	void destroyAll(Ref t)
+	{
+		if (t == NIL)
+			return;
+		destroyAll(pool.at(t).left);
+		destroyAll(pool.at(t).right);
+		pool.destroy(t);
+	}
+
+	template <class F>
+	void forEach(Ref t, F &f) const
+	{
+		if (t == NIL)
+			return;
+		forEach(pool.at(t).left, f);
+		f(valueOf(pool.at(t)));
+		forEach(pool.at(t).right, f);
+	}
+
+public:
+	AVLTree() : root(NIL), count(0)
+	{
+	}
+
+	~AVLTree()
+	{
+		clear();
+	}
+
+	AVLTree(const AVLTree &) = delete;
+	AVLTree &operator=(const AVLTree &) = delete;
+
+	// Inserts a copy of value, or moves it in; false (value untouched) if
+	// its key is present. The node is only built once the key is known to
+	// be new.
+	bool insert(const Value &value)
+	{
+		return insertKey(keyOf(value), [&]() { return pool.make(value); });
+	}
+
+	bool insert(Value &&value)
+	{
+		return insertKey(keyOf(value), [&]() { return pool.make(std::move(value)); });
+	}
+
+	// Builds the value in a node from args; false (and the value is
+	// destroyed again) if its key is present.
+	template <class... Args>
+	bool emplace(Args &&...args)
+	{
+		Ref n = pool.make(std::forward<Args>(args)...);
+		if (insertKey(keyAt(n), [&]() { return n; }))
+			return true;
+		pool.destroy(n);
+		return false;
+	}
+
+	bool remove(const Key &k)
+	{
+		NoHooks hooks = {*this};
+		bool removed = false;
+		root = removeAt(k, root, removed, hooks);
+		if (removed)
+			count--;
+		return removed;
+	}
+
+	Value *find(const Key &k)
+	{
+		NoHooks hooks = {*this};
+		Ref t = findAt(root, k, hooks);
+		return t == NIL ? NULL : &valueOf(pool.at(t));
+	}
+
+	const Value *find(const Key &k) const
+	{
+		return const_cast<AVLTree *>(this)->find(k);
+	}
+
+	// Calls f(value) for each value in key order.
+	template <class F>
+	void forEach(F f) const
+	{
+		forEach(root, f);
+	}
+
+	void clear()
+	{
+		if (!pool.releaseAll())
+			destroyAll(root);
+		root = NIL;
+		count = 0;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	int treeHeight() const
+	{
+		return height(root);
+	}
+};
+
+#endif // GENERIC_AVL_H
@@ -0,0 +1,118 @@
+#include <Isolation.h>
+
+#include <chrono>
+#include <errno.h>
+#include <iostream>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+bool pinToCpu(int cpu)
+{
+#if defined(__linux__)
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+// Writes all of data to fd, retrying short writes and interruptions.
+static bool writeAll(int fd, const string &data)
+{
+	size_t done = 0;
+	while (done < data.size())
+	{
+		ssize_t n = write(fd, data.data() + done, data.size() - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+bool runIsolated(const function<string()> &body, int cpu, IsolatedRun &run, string &error)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		error = string("pipe: ") + strerror(errno);
+		return false;
+	}
+	// Whatever is buffered now would otherwise be printed by both processes
+	cout.flush();
+	cerr.flush();
+	fflush(NULL);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		error = string("fork: ") + strerror(errno);
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0)
+	{
+		close(fds[0]);
+		if (cpu >= 0 && !pinToCpu(cpu))
+			cerr << "isolation: cannot pin to CPU " << cpu << "\n";
+		string output = body();
+		cout.flush();
+		cerr.flush();
+		fflush(NULL);
+		_exit(writeAll(fds[1], output) ? 0 : 120);
+	}
+	close(fds[1]);
+	// Read until the child closes its end, so a large result cannot fill
+	// the pipe and block it
+	run.output.clear();
+	char buffer[4096];
+	for (;;)
+	{
+		ssize_t n = read(fds[0], buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		run.output.append(buffer, n);
+	}
+	close(fds[0]);
+	int status = 0;
+	struct rusage usage;
+	memset(&usage, 0, sizeof(usage));
+	while (wait4(pid, &status, 0, &usage) < 0)
+		if (errno != EINTR)
+		{
+			error = string("wait4: ") + strerror(errno);
+			return false;
+		}
+	run.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	run.exited = WIFEXITED(status);
+	run.status = run.exited ? WEXITSTATUS(status) : WTERMSIG(status);
+	run.userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+	run.systemSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	run.peakRssKB = usage.ru_maxrss;	// kilobytes on Linux
+	return true;
+}
+
+string describeExit(const IsolatedRun &run)
+{
+	if (run.exited)
+		return "exit " + to_string(run.status);
+	return "signal " + to_string(run.status) + " (" + strsignal(run.status) + ")";
+}
@@ -0,0 +1,39 @@
+// Isolation.h - Header file for running tests and benchmarks in child processes
+
+#ifndef ISOLATION_H
+#define ISOLATION_H
+
+#include <functional>
+#include <string>
+
+using namespace std;
+
+// How a child started by runIsolated ended, and what it cost.
+typedef struct IsolatedRun {
+	bool exited;	// false if a signal ended it (a failed assert aborts)
+	int status;	// exit code, or the signal number
+	double seconds;	// wall clock, fork to exit
+	double userSeconds;
+	double systemSeconds;
+	long peakRssKB;	// the child's own peak resident set
+	string output;	// what body returned, read from the pipe
+}IsolatedRun;
+
+// Runs body in a forked child and waits for it. The child starts from a
+// copy of the caller's memory but allocates, frees and faults on its own,
+// so its heap, resident set and page faults are independent of whatever
+// ran before and after it. If cpu >= 0 the child is pinned to that CPU
+// first. body's return value comes back to the parent over a pipe; the
+// child exits with code 0 after sending it. Returns false if no child
+// could be started (error says why); a child that crashed is reported in
+// run, not as a failure of runIsolated.
+bool runIsolated(const function<string()>& body, int cpu, IsolatedRun& run, string& error);
+
+// Pins the calling thread to one CPU with sched_setaffinity. Returns false
+// where that is not possible (no such CPU, or not Linux).
+bool pinToCpu(int cpu);
+
+// "exit 0", "exit 3" or "signal 6 (Aborted)".
+string describeExit(const IsolatedRun& run);
+
+#endif // ISOLATION_H
@@ -0,0 +1,68 @@
+#include <MemoryAccount.h>
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+MemoryAccount nodeMemory;
+
+int MemoryAccount::slot()
+{
+	static atomic<int> threads(0);
+	static thread_local int mine = threads.fetch_add(1, memory_order_relaxed) % SLOTS;
+	return mine;
+}
+
+long MemoryAccount::bytes() const
+{
+	long sum = 0;
+	for (int i = 0; i < SLOTS; i++)
+		sum += slots[i].bytes.load(memory_order_relaxed);
+	return sum;
+}
+
+long MemoryAccount::blocks() const
+{
+	long sum = 0;
+	for (int i = 0; i < SLOTS; i++)
+		sum += slots[i].blocks.load(memory_order_relaxed);
+	return sum;
+}
+
+long MemoryAccount::allocations() const
+{
+	long sum = 0;
+	for (int i = 0; i < SLOTS; i++)
+		sum += slots[i].allocations.load(memory_order_relaxed);
+	return sum;
+}
+
+long residentBytes()
+{
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm != NULL)
+	{
+		long size, resident;
+		int fields = fscanf(statm, "%ld %ld", &size, &resident);
+		fclose(statm);
+		if (fields == 2)
+			return resident * sysconf(_SC_PAGESIZE);
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss * 1024L;
+}
+
+long availableBytes()
+{
+	FILE *meminfo = fopen("/proc/meminfo", "r");
+	if (meminfo == NULL)
+		return -1;
+	char line[256];
+	long kb = -1;
+	while (kb < 0 && fgets(line, sizeof(line), meminfo) != NULL)
+		if (sscanf(line, "MemAvailable: %ld kB", &kb) != 1)
+			kb = -1;
+	fclose(meminfo);
+	return kb < 0 ? -1 : kb * 1024;
+}
@@ -0,0 +1,115 @@
+// MemoryAccount.h - Header file for live-memory accounting
+
+#ifndef MEMORY_ACCOUNT_H
+#define MEMORY_ACCOUNT_H
+
+#include <atomic>
+#include <stddef.h>
+
+using namespace std;
+
+// Bytes and blocks a structure has allocated and not freed yet, as asked
+// for (malloc's own per-block overhead and rounding are not included; see
+// heapInUse() in the test suite for those). Each thread counts in its own
+// cache line, so threads allocating at once do not slow each other down;
+// the readers add the lines up. Frees may happen on another thread than
+// the allocation.
+class MemoryAccount
+{
+	static const int SLOTS = 16;
+	struct alignas(64) Slot {
+		atomic<long> bytes{0};
+		atomic<long> blocks{0};
+		atomic<long> allocations{0};	// ever made, frees not subtracted
+	};
+	Slot slots[SLOTS];
+	static int slot();	// the calling thread's
+public:
+	// Constant-initialized, so nodeMemory counts from the first node on,
+	// whatever the order of static initialization
+	MemoryAccount() = default;
+	MemoryAccount(const MemoryAccount&) = delete;
+	MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+	void allocated(size_t bytes)
+	{
+		Slot& s = slots[slot()];
+		s.bytes.fetch_add((long)bytes, memory_order_relaxed);
+		s.blocks.fetch_add(1, memory_order_relaxed);
+		s.allocations.fetch_add(1, memory_order_relaxed);
+	}
+
+	void freed(size_t bytes)
+	{
+		Slot& s = slots[slot()];
+		s.bytes.fetch_sub((long)bytes, memory_order_relaxed);
+		s.blocks.fetch_sub(1, memory_order_relaxed);
+	}
+
+	long bytes() const;
+	long blocks() const;
+	long allocations() const;
+};
+
+// Every tree node (AVL, WAVL and SplayTree, single nodes and compacted
+// regions alike) is counted here; see node::operator new in AVLTree.h. A
+// tree constructed with an account of its own counts its nodes there too.
+extern MemoryAccount nodeMemory;
+
+// A standard allocator that counts into a MemoryAccount, for the std
+// containers the tests compare against:
+//   map<int, EmployeeInfo, less<int>, CountingAllocator<pair<const int, EmployeeInfo> > > m(&account);
+template <class T>
+class CountingAllocator
+{
+	template <class U>
+	friend class CountingAllocator;
+	MemoryAccount* account;
+public:
+	typedef T value_type;
+
+	explicit CountingAllocator(MemoryAccount* account) : account(account)
+	{
+	}
+
+	template <class U>
+	CountingAllocator(const CountingAllocator<U>& other) : account(other.account)
+	{
+	}
+
+	T* allocate(size_t n)
+	{
+		T* p = static_cast<T*>(::operator new(n * sizeof(T)));
+		account->allocated(n * sizeof(T));
+		return p;
+	}
+
+	void deallocate(T* p, size_t n)
+	{
+		account->freed(n * sizeof(T));
+		::operator delete(p);
+	}
+
+	template <class U>
+	bool operator==(const CountingAllocator<U>& other) const
+	{
+		return account == other.account;
+	}
+
+	template <class U>
+	bool operator!=(const CountingAllocator<U>& other) const
+	{
+		return account != other.account;
+	}
+};
+
+// The process's resident set right now, in bytes, from /proc/self/statm
+// (getrusage's ru_maxrss is the peak, which never comes down). Falls back
+// to the peak where there is no /proc.
+long residentBytes();
+
+// Memory the system could hand out without swapping, in bytes, from
+// MemAvailable in /proc/meminfo; -1 where that is not known.
+long availableBytes();
+
+#endif // MEMORY_ACCOUNT_H
@@ -0,0 +1,193 @@
+#include <PerfCounters.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+const char *perfEventName(PerfEvent event)
+{
+	static const char *names[PERF_EVENTS] = {"cycles", "instructions", "L1d-misses", "LLC-misses", "dTLB-misses",
+											 "branch-misses"};
+	return names[event];
+}
+
+void perfClear(PerfSample &sum)
+{
+	sum.samples = 0;
+	for (int e = 0; e < PERF_EVENTS; e++)
+	{
+		sum.counted[e] = false;
+		sum.value[e] = 0;
+	}
+}
+
+void perfAdd(PerfSample &sum, const PerfSample &sample)
+{
+	for (int e = 0; e < PERF_EVENTS; e++)
+	{
+		sum.counted[e] = sample.counted[e] && (sum.samples == 0 || sum.counted[e]);
+		sum.value[e] += sample.value[e];
+	}
+	sum.samples += sample.samples;
+}
+
+#if defined(__linux__)
+
+// Sets the type and config of event in attr.
+static void perfEventConfig(PerfEvent event, struct perf_event_attr &attr)
+{
+	const uint64_t readMiss = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+	uint32_t type = PERF_TYPE_HARDWARE;
+	uint64_t config;
+	switch (event)
+	{
+	case PERF_CYCLES:
+		config = PERF_COUNT_HW_CPU_CYCLES;
+		break;
+	case PERF_INSTRUCTIONS:
+		config = PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+	case PERF_L1D_MISSES:
+		type = PERF_TYPE_HW_CACHE;
+		config = PERF_COUNT_HW_CACHE_L1D | readMiss;
+		break;
+	case PERF_LLC_MISSES:
+		config = PERF_COUNT_HW_CACHE_MISSES;
+		break;
+	case PERF_DTLB_MISSES:
+		type = PERF_TYPE_HW_CACHE;
+		config = PERF_COUNT_HW_CACHE_DTLB | readMiss;
+		break;
+	default:
+		config = PERF_COUNT_HW_BRANCH_MISSES;
+		break;
+	}
+	attr.type = type;
+	attr.config = config;
+}
+
+PerfCounters::PerfCounters() : leader(-1)
+{
+	for (int e = 0; e < PERF_EVENTS; e++)
+	{
+		fds[e] = -1;
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		perfEventConfig((PerfEvent)e, attr);
+		attr.disabled = leader < 0;	// the group starts and stops with its leader
+		attr.exclude_kernel = 1;	// allowed at perf_event_paranoid 2
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+		if (fds[e] < 0)
+		{
+			if (reason.empty())
+				reason = string(perfEventName((PerfEvent)e)) + ": " + strerror(errno);
+		}
+		else if (leader < 0)
+			leader = fds[e];
+	}
+}
+
+PerfCounters::~PerfCounters()
+{
+	for (int e = 0; e < PERF_EVENTS; e++)
+		if (fds[e] >= 0)
+			close(fds[e]);
+}
+
+void PerfCounters::start()
+{
+	if (leader < 0)
+		return;
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::stop()
+{
+	if (leader >= 0)
+		ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::resume()
+{
+	if (leader >= 0)
+		ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+bool PerfCounters::read(PerfSample &sample) const
+{
+	perfClear(sample);
+	if (leader < 0)
+		return false;
+	// nr, time enabled, time running, then one value per open event in the
+	// order they were opened
+	uint64_t data[3 + PERF_EVENTS];
+	ssize_t n = ::read(leader, data, sizeof(data));
+	if (n < (ssize_t)(3 * sizeof(uint64_t)) || data[2] == 0)
+		return false;	// never got onto the PMU
+	double scale = (double)data[1] / data[2];
+	uint64_t next = 0;
+	for (int e = 0; e < PERF_EVENTS; e++)
+		if (fds[e] >= 0 && next < data[0])
+		{
+			sample.counted[e] = true;
+			sample.value[e] = data[3 + next++] * scale;
+		}
+	sample.samples = 1;
+	return true;
+}
+
+#else
+
+PerfCounters::PerfCounters() : leader(-1), reason("perf_event_open is Linux only")
+{
+	for (int e = 0; e < PERF_EVENTS; e++)
+		fds[e] = -1;
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+void PerfCounters::start()
+{
+}
+
+void PerfCounters::stop()
+{
+}
+
+void PerfCounters::resume()
+{
+}
+
+bool PerfCounters::read(PerfSample &sample) const
+{
+	perfClear(sample);
+	return false;
+}
+
+#endif
+
+bool PerfCounters::available() const
+{
+	return leader >= 0;
+}
+
+bool PerfCounters::has(PerfEvent event) const
+{
+	return fds[event] >= 0;
+}
+
+const string &PerfCounters::unavailableReason() const
+{
+	return reason;
+}
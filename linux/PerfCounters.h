@@ -0,0 +1,71 @@
+// PerfCounters.h - Header file for the hardware performance counters
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+enum PerfEvent {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,	// L1 data cache read misses
+	PERF_LLC_MISSES,	// last-level cache misses
+	PERF_DTLB_MISSES,	// data TLB read misses
+	PERF_BRANCH_MISSES,
+	PERF_EVENTS
+};
+
+// "cycles", "instructions", "L1d-misses", ...
+const char* perfEventName(PerfEvent event);
+
+// What a PerfCounters group counted between start() and stop(). Counts
+// are scaled up if the kernel had to share the counters with other groups
+// (multiplexing) for part of the time.
+// Sums of samples (over threads or repetitions) are PerfSamples too.
+typedef struct PerfSample {
+	int samples;	// how many reads were added up, 0 for an empty sum
+	bool counted[PERF_EVENTS];	// false for events some sample did not have
+	double value[PERF_EVENTS];
+}PerfSample;
+
+// Empties sum / adds sample to it.
+void perfClear(PerfSample& sum);
+void perfAdd(PerfSample& sum, const PerfSample& sample);
+
+// The hardware counters of the calling thread, opened as one group with
+// perf_event_open so they all count over exactly the same instructions.
+// Events the machine or the kernel does not offer are left out of the
+// group; in a container or VM without a PMU, or with
+// kernel.perf_event_paranoid too high, none may open at all, and then
+// start(), stop() and read() do nothing and available() is false.
+// A group counts only the thread that opened it, so every thread that
+// should be measured opens its own.
+class PerfCounters
+{
+	int fds[PERF_EVENTS];	// -1 for the events left out
+	int leader;	// fd of the group leader, -1 if nothing opened
+	string reason;
+public:
+	PerfCounters();
+	~PerfCounters();
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool available() const;
+	bool has(PerfEvent event) const;
+	// Why some or all events are missing, empty if none is
+	const string& unavailableReason() const;
+
+	// Zero the counts and start counting / stop counting
+	void start();
+	void stop();
+	// Start counting again after stop(), adding to the counts so far
+	void resume();
+	// The counts since start(); false if nothing is counted.
+	bool read(PerfSample& sample) const;
+};
+
+#endif // PERF_COUNTERS_H
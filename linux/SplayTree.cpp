@@ -0,0 +1,205 @@
+// SplayTree.cpp: Top-down Splay Tree Implementation in C++
+#include <fstream>
+#include <vector>
+#include "SplayTree.h"
+#include "MemoryAccount.h"
+
+using namespace std;
+
+SplayTree::SplayTree(MemoryAccount *account)
+{
+	root = NULL;
+	memory = account;
+}
+
+// Top-down splay (Sleator & Tarjan): brings sin, or the last node on its
+// search path, to the root of t and returns the new root.
+node *SplayTree::splay(int sin, node *t)
+{
+	if (t == NULL)
+		return NULL;
+	node header;
+	header.left = header.right = NULL;
+	node *leftMax = &header;  // largest node of the "less than" tree
+	node *rightMin = &header; // smallest node of the "greater than" tree
+	for (;;)
+	{
+		if (sin < t->empl.sin)
+		{
+			if (t->left == NULL)
+				break;
+			if (sin < t->left->empl.sin)
+			{ // zig-zig: rotate right first
+				node *u = t->left;
+				t->left = u->right;
+				u->right = t;
+				t = u;
+				if (t->left == NULL)
+					break;
+			}
+			// Link t into the right tree
+			rightMin->left = t;
+			rightMin = t;
+			t = t->left;
+		}
+		else if (sin > t->empl.sin)
+		{
+			if (t->right == NULL)
+				break;
+			if (sin > t->right->empl.sin)
+			{ // zag-zag: rotate left first
+				node *u = t->right;
+				t->right = u->left;
+				u->left = t;
+				t = u;
+				if (t->right == NULL)
+					break;
+			}
+			// Link t into the left tree
+			leftMax->right = t;
+			leftMax = t;
+			t = t->right;
+		}
+		else
+			break;
+	}
+	// Reassemble
+	leftMax->right = t->left;
+	rightMin->left = t->right;
+	t->left = header.right;
+	t->right = header.left;
+	return t;
+}
+
+void SplayTree::insert(EmployeeInfo empl)
+{
+	if (root != NULL)
+	{
+		root = splay(empl.sin, root);
+		if (root->empl.sin == empl.sin)
+			return; // Duplicate sin is ignored, as in AVL::insert
+	}
+	node *t = new node;
+	if (memory != NULL)
+		memory->allocated(sizeof(node));
+	t->empl = empl;
+	t->height = 0;
+	if (root == NULL)
+		t->left = t->right = NULL;
+	else if (empl.sin < root->empl.sin)
+	{
+		t->left = root->left;
+		t->right = root;
+		root->left = NULL;
+	}
+	else
+	{
+		t->right = root->right;
+		t->left = root;
+		root->right = NULL;
+	}
+	root = t;
+}
+
+void SplayTree::remove(int sin)
+{
+	if (root == NULL)
+		return;
+	root = splay(sin, root);
+	if (root->empl.sin != sin)
+		return;
+	node *temp = root;
+	if (root->left == NULL)
+		root = root->right;
+	else
+	{
+		// sin is larger than everything on the left, so splaying it there
+		// brings the left maximum up with an empty right subtree
+		root = splay(sin, root->left);
+		root->right = temp->right;
+	}
+	if (memory != NULL)
+		memory->freed(sizeof(node));
+	delete temp;
+}
+
+node *SplayTree::GetRoot()
+{
+	return root;
+}
+
+node *SplayTree::Find(node *node, int sin)
+{
+	if (node != NULL && node == root)
+	{
+		root = splay(sin, root);
+		return root->empl.sin == sin ? root : NULL;
+	}
+	while (node != NULL && node->empl.sin != sin)
+		node = sin < node->empl.sin ? node->left : node->right;
+	return node;
+}
+
+void SplayTree::makeEmpty(node *t)
+{
+	// Rotate left children up until none is left, then free the node and
+	// continue right; no recursion, so degenerate trees are fine.
+	if (t == root)
+		root = NULL;
+	while (t != NULL)
+	{
+		if (t->left != NULL)
+		{
+			node *u = t->left;
+			t->left = u->right;
+			u->right = t;
+			t = u;
+		}
+		else
+		{
+			node *next = t->right;
+			if (memory != NULL)
+				memory->freed(sizeof(node));
+			delete t;
+			t = next;
+		}
+	}
+}
+
+node *SplayTree::findMin(node *t)
+{
+	while (t != NULL && t->left != NULL)
+		t = t->left;
+	return t;
+}
+
+node *SplayTree::findMax(node *t)
+{
+	while (t != NULL && t->right != NULL)
+		t = t->right;
+	return t;
+}
+
+void SplayTree::inorder(node *t, ofstream &out)
+{
+	vector<node *> stack;
+	while (t != NULL || !stack.empty())
+	{
+		while (t != NULL)
+		{
+			stack.push_back(t);
+			t = t->left;
+		}
+		t = stack.back();
+		stack.pop_back();
+		out << " sin:" << t->empl.sin << " employee number:" << t->empl.emplNumber << " salary:" << t->empl.salary << " age:" << t->empl.age << "\n";
+		t = t->right;
+	}
+}
+
+void SplayTree::display(char file[])
+{
+	ofstream out(file);
+	inorder(root, out);
+	out << endl;
+}
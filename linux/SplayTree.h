@@ -0,0 +1,34 @@
+// SplayTree.h - Header file for Splay Tree
+
+#ifndef SPLAY_TREE_H
+#define SPLAY_TREE_H
+
+#include "AVLTree.h"
+
+// Self-adjusting alternative to AVL with the same interface and node type.
+// Every insert, remove and Find(GetRoot(), sin) splays the accessed sin to
+// the root, so hot keys of a skewed (e.g. Zipfian) workload stay a few levels
+// deep instead of at depth log n. The tree is not height balanced (sequential
+// inserts build a path), so every walk over it is iterative; node::height is
+// unused.
+class SplayTree
+{
+	node* root;
+	MemoryAccount* memory;	// also counts this tree's nodes, NULL if none
+	node* splay(int sin, node* t);
+	void inorder(node* t, ofstream& out);
+public:
+	// Nodes are counted as for AVL: in nodeMemory, and in account if given.
+	explicit SplayTree(MemoryAccount* account = NULL);
+	void insert(EmployeeInfo empl);
+	void remove(int sin);
+	void display(char filename[]);
+	node * GetRoot();
+	// Splays when node is the root; any other subtree is searched read-only
+	node * Find(node *node, int sin);
+	void makeEmpty(node* t);
+	node* findMin(node* t);
+	node* findMax(node* t);
+};
+
+#endif // SPLAY_TREE_H
@@ -0,0 +1,96 @@
+// StaticAVL.h - Fixed-capacity AVL tree without heap allocation
+
+#ifndef STATIC_AVL_H
+#define STATIC_AVL_H
+
+#include "AVLTree.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Result of a StaticAVL update. Nothing is thrown.
+enum StaticStatus {
+	STATIC_OK = 0,
+	STATIC_FULL,	// insert: every slot is in use
+	STATIC_EXISTS,	// insert: the sin is already present (the record is kept)
+	STATIC_NOT_FOUND	// remove: no record with this sin
+};
+
+// Upper bound on the height of an AVL tree with n nodes: the sparsest AVL
+// tree of height h has N(h) = N(h-1) + N(h-2) + 1 nodes.
+constexpr int staticAVLMaxHeight(size_t n)
+{
+	size_t a = 0, b = 1; // N(-1), N(0)
+	int h = 0;
+	while (b <= n)
+	{
+		size_t c = a + b + 1;
+		a = b;
+		b = c;
+		h++;
+	}
+	return h;
+}
+
+// AVL tree of EmployeeInfo keyed by sin, for the real-time setting: the
+// generic AVLTree with FixedNodes, so all Capacity nodes live in an array
+// inside the object, free slots form a linked list threaded through it, and
+// children are 32-bit slot indices. Nothing is allocated after
+// construction, so declare large instances static rather than on the
+// stack. Insert, remove and find visit at most staticAVLMaxHeight(Capacity)
+// nodes on the way down and as many on the way back up, which bounds their
+// running time (and the depth of their recursion) independently of the key
+// sequence.
+template <size_t Capacity>
+class StaticAVL
+{
+	AVLTree<int, EmployeeInfo, std::less<int>, FixedNodes<Capacity>, SinKey> tree;
+
+public:
+	// Empties the tree in O(Capacity), relinking every slot into the free list.
+	void clear()
+	{
+		tree.clear();
+	}
+
+	StaticStatus insert(const EmployeeInfo &empl)
+	{
+		if (full())
+			return tree.find(empl.sin) != NULL ? STATIC_EXISTS : STATIC_FULL;
+		return tree.insert(empl) ? STATIC_OK : STATIC_EXISTS;
+	}
+
+	StaticStatus remove(int sin)
+	{
+		return tree.remove(sin) ? STATIC_OK : STATIC_NOT_FOUND;
+	}
+
+	// The stored record, or NULL. The pointer is valid until the next
+	// remove, which may move a record into another slot.
+	const EmployeeInfo *find(int sin) const
+	{
+		return tree.find(sin);
+	}
+
+	size_t size() const
+	{
+		return tree.size();
+	}
+
+	static constexpr size_t capacity()
+	{
+		return Capacity;
+	}
+
+	bool full() const
+	{
+		return tree.size() == Capacity;
+	}
+
+	int treeHeight() const
+	{
+		return tree.treeHeight();
+	}
+};
+
+#endif // STATIC_AVL_H
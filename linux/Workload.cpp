@@ -0,0 +1,507 @@
+#include <Workload.h>
+#include <SplayTree.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <ctype.h>
+#include <iomanip>
+
+// ---------------------------------------------------------------------------
+// Key distributions
+// ---------------------------------------------------------------------------
+
+const char *distributionName(KeyDistribution dist)
+{
+	switch (dist)
+	{
+	case DIST_UNIFORM:
+		return "uniform";
+	case DIST_ZIPFIAN:
+		return "zipfian";
+	case DIST_LATEST:
+		return "latest";
+	default:
+		return "hotspot";
+	}
+}
+
+bool parseDistribution(const string &name, KeyDistribution &dist)
+{
+	for (int d = DIST_UNIFORM; d <= DIST_HOTSPOT; d++)
+		if (name == distributionName((KeyDistribution)d))
+		{
+			dist = (KeyDistribution)d;
+			return true;
+		}
+	return false;
+}
+
+// FNV-1a over the 8 bytes of v: spreads Zipfian ranks over the key space
+static uint64_t fnv64(uint64_t v)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < 8; i++)
+	{
+		h ^= v & 0xff;
+		h *= 0x100000001b3ULL;
+		v >>= 8;
+	}
+	return h;
+}
+
+KeyChooser::KeyChooser(KeyDistribution dist, uint64_t count, double theta, double hotData, double hotOps)
+	: dist(dist), items(0), theta(theta), hotData(hotData), hotOps(hotOps), zetaN(0)
+{
+	zeta2 = 1 + pow(0.5, theta);
+	alpha = 1 / (1 - theta);
+	grow(count);
+}
+
+void KeyChooser::grow(uint64_t count)
+{
+	if (dist == DIST_ZIPFIAN || dist == DIST_LATEST)
+		for (uint64_t i = items + 1; i <= count; i++)
+			zetaN += 1 / pow((double)i, theta);
+	items = count;
+	eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2 / zetaN);
+}
+
+uint64_t KeyChooser::count()
+{
+	return items;
+}
+
+// Rank 0 is the most popular
+uint64_t KeyChooser::zipfRank(Xoshiro256 &rng)
+{
+	double u = rng.unit();
+	double uz = u * zetaN;
+	if (uz < 1)
+		return 0;
+	if (uz < zeta2)
+		return 1;
+	uint64_t rank = (uint64_t)(items * pow(eta * u - eta + 1, alpha));
+	return rank < items ? rank : items - 1;
+}
+
+uint64_t KeyChooser::next(Xoshiro256 &rng)
+{
+	switch (dist)
+	{
+	case DIST_UNIFORM:
+		return rng.below(items);
+	case DIST_ZIPFIAN:
+		return fnv64(zipfRank(rng)) % items;
+	case DIST_LATEST:
+		return items - 1 - zipfRank(rng);
+	default:
+	{
+		uint64_t hot = (uint64_t)(items * hotData);
+		if (hot == 0 || hot == items)
+			return rng.below(items);
+		if (rng.unit() < hotOps)
+			return rng.below(hot);
+		return hot + rng.below(items - hot);
+	}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Engines
+// ---------------------------------------------------------------------------
+
+MapEngine::MapEngine() : records(CountedMap::allocator_type(&memory)), sink(0)
+{
+}
+
+const char *MapEngine::name()
+{
+	return "map";
+}
+
+void MapEngine::insert(const EmployeeInfo &empl)
+{
+	records.insert(make_pair(empl.sin, empl));
+}
+
+bool MapEngine::read(int sin)
+{
+	return records.find(sin) != records.end();
+}
+
+bool MapEngine::update(const EmployeeInfo &empl)
+{
+	CountedMap::iterator it = records.find(empl.sin);
+	if (it == records.end())
+		return false;
+	it->second = empl;
+	return true;
+}
+
+void MapEngine::remove(int sin)
+{
+	records.erase(sin);
+}
+
+int MapEngine::scan(int start, int count)
+{
+	int visited = 0;
+	long checksum = 0;
+	for (CountedMap::iterator it = records.lower_bound(start); it != records.end() && visited < count;
+		 ++it, visited++)
+		checksum += it->second.salary;
+	sink += checksum;
+	return visited;
+}
+
+bool MapEngine::bounds(int &lo, int &hi)
+{
+	if (records.empty())
+		return false;
+	lo = records.begin()->first;
+	hi = records.rbegin()->first;
+	return true;
+}
+
+long MapEngine::liveBytes()
+{
+	return memory.bytes();
+}
+
+void MapEngine::clear()
+{
+	records.clear();
+}
+
+UnorderedMapEngine::UnorderedMapEngine() : records(CountedHashMap::allocator_type(&memory)), sink(0)
+{
+}
+
+const char *UnorderedMapEngine::name()
+{
+	return "unordered_map";
+}
+
+void UnorderedMapEngine::insert(const EmployeeInfo &empl)
+{
+	records.insert(make_pair(empl.sin, empl));
+}
+
+bool UnorderedMapEngine::read(int sin)
+{
+	return records.find(sin) != records.end();
+}
+
+bool UnorderedMapEngine::update(const EmployeeInfo &empl)
+{
+	CountedHashMap::iterator it = records.find(empl.sin);
+	if (it == records.end())
+		return false;
+	it->second = empl;
+	return true;
+}
+
+void UnorderedMapEngine::remove(int sin)
+{
+	records.erase(sin);
+}
+
+int UnorderedMapEngine::scan(int start, int count)
+{
+	keys.clear();
+	for (CountedHashMap::iterator it = records.begin(); it != records.end(); ++it)
+		if (it->first >= start)
+			keys.push_back(it->first);
+	int visited = (int)min((size_t)count, keys.size());
+	partial_sort(keys.begin(), keys.begin() + visited, keys.end());
+	long checksum = 0;
+	for (int i = 0; i < visited; i++)
+		checksum += records[keys[i]].salary;
+	sink += checksum;
+	return visited;
+}
+
+bool UnorderedMapEngine::bounds(int &lo, int &hi)
+{
+	if (records.empty())
+		return false;
+	lo = INT_MAX;
+	hi = INT_MIN;
+	for (CountedHashMap::iterator it = records.begin(); it != records.end(); ++it)
+	{
+		lo = min(lo, it->first);
+		hi = max(hi, it->first);
+	}
+	return true;
+}
+
+long UnorderedMapEngine::liveBytes()
+{
+	return memory.bytes();
+}
+
+void UnorderedMapEngine::clear()
+{
+	// clear() would keep the bucket array
+	CountedHashMap(records.get_allocator()).swap(records);
+	vector<int>().swap(keys);
+}
+
+SortedVectorEngine::SortedVectorEngine() : records(CountedVector::allocator_type(&memory)), sink(0)
+{
+}
+
+const char *SortedVectorEngine::name()
+{
+	return "sorted_vector";
+}
+
+CountedVector::iterator SortedVectorEngine::position(int sin)
+{
+	return lower_bound(records.begin(), records.end(), sin,
+					   [](const EmployeeInfo &e, int key) { return e.sin < key; });
+}
+
+void SortedVectorEngine::insert(const EmployeeInfo &empl)
+{
+	CountedVector::iterator it = position(empl.sin);
+	if (it == records.end() || it->sin != empl.sin)
+		records.insert(it, empl);
+}
+
+bool SortedVectorEngine::read(int sin)
+{
+	CountedVector::iterator it = position(sin);
+	return it != records.end() && it->sin == sin;
+}
+
+bool SortedVectorEngine::update(const EmployeeInfo &empl)
+{
+	CountedVector::iterator it = position(empl.sin);
+	if (it == records.end() || it->sin != empl.sin)
+		return false;
+	*it = empl;
+	return true;
+}
+
+void SortedVectorEngine::remove(int sin)
+{
+	CountedVector::iterator it = position(sin);
+	if (it != records.end() && it->sin == sin)
+		records.erase(it);
+}
+
+int SortedVectorEngine::scan(int start, int count)
+{
+	CountedVector::iterator it = position(start);
+	int visited = (int)min((size_t)count, (size_t)(records.end() - it));
+	long checksum = 0;
+	for (int i = 0; i < visited; i++)
+		checksum += it[i].salary;
+	sink += checksum;
+	return visited;
+}
+
+bool SortedVectorEngine::bounds(int &lo, int &hi)
+{
+	if (records.empty())
+		return false;
+	lo = records.front().sin;
+	hi = records.back().sin;
+	return true;
+}
+
+long SortedVectorEngine::liveBytes()
+{
+	return memory.bytes();
+}
+
+void SortedVectorEngine::clear()
+{
+	CountedVector(records.get_allocator()).swap(records);
+}
+
+WorkloadEngine *makeEngine(const string &name)
+{
+	if (name == "avl")
+		return new TreeEngine<AVL>("avl");
+	if (name == "wavl")
+		return new TreeEngine<WAVL>("wavl");
+	if (name == "splay")
+		return new TreeEngine<SplayTree>("splay");
+	if (name == "map")
+		return new MapEngine();
+	if (name == "unordered_map")
+		return new UnorderedMapEngine();
+	if (name == "sorted_vector")
+		return new SortedVectorEngine();
+	return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Workloads
+// ---------------------------------------------------------------------------
+
+const char *opName(WorkloadOp op)
+{
+	static const char *names[OP_TYPES] = {"read", "update", "insert", "scan", "read-modify-write", "remove"};
+	return names[op];
+}
+
+void workloadDefaults(WorkloadSpec &spec)
+{
+	spec.records = 100000;
+	spec.operations = 100000;
+	for (int op = 0; op < OP_TYPES; op++)
+		spec.mix[op] = 0;
+	spec.mix[OP_READ] = 1;
+	spec.dist = DIST_ZIPFIAN;
+	spec.theta = 0.99;
+	spec.hotData = 0.2;
+	spec.hotOps = 0.8;
+	spec.maxScan = 100;
+	spec.seed = 1;
+}
+
+bool ycsbWorkload(char letter, WorkloadSpec &spec)
+{
+	double mix[OP_TYPES] = {0};
+	KeyDistribution dist = DIST_ZIPFIAN;
+	switch (toupper(letter))
+	{
+	case 'A':
+		mix[OP_READ] = 0.5;
+		mix[OP_UPDATE] = 0.5;
+		break;
+	case 'B':
+		mix[OP_READ] = 0.95;
+		mix[OP_UPDATE] = 0.05;
+		break;
+	case 'C':
+		mix[OP_READ] = 1;
+		break;
+	case 'D':
+		mix[OP_READ] = 0.95;
+		mix[OP_INSERT] = 0.05;
+		dist = DIST_LATEST;
+		break;
+	case 'E':
+		mix[OP_SCAN] = 0.95;
+		mix[OP_INSERT] = 0.05;
+		break;
+	case 'F':
+		mix[OP_READ] = 0.5;
+		mix[OP_READ_MODIFY_WRITE] = 0.5;
+		break;
+	default:
+		return false;
+	}
+	for (int op = 0; op < OP_TYPES; op++)
+		spec.mix[op] = mix[op];
+	spec.dist = dist;
+	return true;
+}
+
+static EmployeeInfo workloadRecord(int sin, Xoshiro256 &rng)
+{
+	EmployeeInfo e;
+	e.sin = sin;
+	e.emplNumber = sin;
+	e.salary = 30000 + (int)rng.below(100000);
+	e.age = 20 + (int)rng.below(45);
+	return e;
+}
+
+void loadWorkload(const WorkloadSpec &spec, WorkloadEngine &engine)
+{
+	Xoshiro256 rng(spec.seed);
+	vector<int> order(spec.records);
+	for (long i = 0; i < spec.records; i++)
+		order[i] = (int)i;
+	for (long i = spec.records - 1; i > 0; i--)
+		swap(order[i], order[rng.below(i + 1)]);
+	for (long i = 0; i < spec.records; i++)
+		engine.insert(workloadRecord(order[i], rng));
+}
+
+void runWorkload(const WorkloadSpec &spec, WorkloadEngine &engine, WorkloadResult &result)
+{
+	Xoshiro256 rng(spec.seed + 1);
+	KeyChooser keys(spec.dist, spec.records, spec.theta, spec.hotData, spec.hotOps);
+	double cumulative[OP_TYPES], total = 0;
+	for (int op = 0; op < OP_TYPES; op++)
+		cumulative[op] = total += spec.mix[op];
+	for (int op = 0; op < OP_TYPES; op++)
+	{
+		OpStats &s = result.ops[op];
+		s.count = s.hits = 0;
+		s.seconds = 0;
+		s.latency.reset();
+	}
+	int nextSin = (int)spec.records;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (long i = 0; i < spec.operations; i++)
+	{
+		double pick = rng.unit() * total;
+		int op = 0;
+		while (op < OP_TYPES - 1 && pick >= cumulative[op])
+			op++;
+		// Everything but the engine call stays outside the timed part
+		int sin = op == OP_INSERT ? nextSin++ : (int)keys.next(rng);
+		EmployeeInfo empl = workloadRecord(sin, rng);
+		int length = op == OP_SCAN ? 1 + (int)rng.below(spec.maxScan) : 0;
+		bool hit = true;
+		uint64_t t0 = Timer::ticks();
+		switch (op)
+		{
+		case OP_READ:
+			hit = engine.read(sin);
+			break;
+		case OP_UPDATE:
+			hit = engine.update(empl);
+			break;
+		case OP_INSERT:
+			engine.insert(empl);
+			break;
+		case OP_SCAN:
+			hit = engine.scan(sin, length) > 0;
+			break;
+		case OP_READ_MODIFY_WRITE:
+			hit = engine.read(sin) && engine.update(empl);
+			break;
+		default:
+			engine.remove(sin);
+			break;
+		}
+		int64_t ns = Timer::ticksToNs(Timer::ticks() - t0);
+		OpStats &s = result.ops[op];
+		s.count++;
+		s.hits += hit;
+		s.seconds += ns * 1e-9;
+		s.latency.record(ns);
+		if (op == OP_INSERT)
+			keys.grow(nextSin);
+	}
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	result.operations = spec.operations;
+}
+
+void printWorkload(ostream &out, const string &label, const WorkloadResult &result)
+{
+	out << label << ": " << result.operations << " operations in " << result.seconds << " s, "
+		<< (result.seconds > 0 ? result.operations / result.seconds : 0) << " ops/sec\n";
+	for (int op = 0; op < OP_TYPES; op++)
+	{
+		const OpStats &s = result.ops[op];
+		if (s.count == 0)
+			continue;
+		out << label << "   " << left << setw(17) << opName((WorkloadOp)op) << right << ": " << s.count << " ops";
+		if (op != OP_INSERT && op != OP_REMOVE)
+			out << ", " << fixed << setprecision(1) << 100.0 * s.hits / s.count << "% found" << defaultfloat
+				<< setprecision(6);
+		out << ", " << (s.seconds > 0 ? s.count / s.seconds : 0) << " ops/sec, p50 " << s.latency.percentile(0.5)
+			<< ", p99 " << s.latency.percentile(0.99) << ", p99.9 " << s.latency.percentile(0.999) << " ns\n";
+	}
+}
@@ -0,0 +1,429 @@
+// Workload.h - Header file for the YCSB-style workload generator
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "AVLTree.h"
+#include "MemoryAccount.h"
+#include "timer.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// ---------------------------------------------------------------------------
+// Random numbers
+// ---------------------------------------------------------------------------
+
+// SplitMix64: one multiply-xorshift step per number. Used to seed
+// Xoshiro256 from a single value.
+class SplitMix64
+{
+	uint64_t state;
+public:
+	explicit SplitMix64(uint64_t seed) : state(seed)
+	{
+	}
+
+	uint64_t next()
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+};
+
+// xoshiro256**: the generator the workloads draw from. A few cycles per
+// number (rand() is a locked libc call) and the same sequence for the same
+// seed on every platform.
+class Xoshiro256
+{
+	uint64_t s[4];
+
+	static uint64_t rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+public:
+	explicit Xoshiro256(uint64_t seed)
+	{
+		SplitMix64 init(seed);
+		for (int i = 0; i < 4; i++)
+			s[i] = init.next();
+	}
+
+	uint64_t next()
+	{
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	// Uniform in [0, n), by multiplying instead of dividing (the bias is
+	// below 2^-32 for any n that fits 32 bits).
+	uint64_t below(uint64_t n)
+	{
+		return (uint64_t)(((unsigned __int128)next() * n) >> 64);
+	}
+
+	// Uniform in [0, 1)
+	double unit()
+	{
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Key distributions
+// ---------------------------------------------------------------------------
+
+enum KeyDistribution {
+	DIST_UNIFORM,	// every record equally likely
+	DIST_ZIPFIAN,	// popularity falls off as 1/rank^theta; the popular records are scattered over the key space
+	DIST_LATEST,	// Zipfian over age: the most recently inserted records are the most popular
+	DIST_HOTSPOT	// hotOps of the operations go to a hot set of hotData of the records
+};
+
+const char* distributionName(KeyDistribution dist);
+bool parseDistribution(const string& name, KeyDistribution& dist);
+
+// Draws record numbers in [0, count()) from a distribution. grow() makes
+// newly inserted records eligible, in O(new records) for the Zipfian ones.
+// The Zipfian draw is the constant-time method of Gray et al., "Quickly
+// Generating Billion-Record Synthetic Databases" (SIGMOD 1994), as in YCSB;
+// it needs 0 < theta < 1.
+class KeyChooser
+{
+	KeyDistribution dist;
+	uint64_t items;
+	double theta;
+	double hotData;
+	double hotOps;
+	double zetaN;	// sum of 1/i^theta for i = 1..items
+	double zeta2;
+	double alpha;
+	double eta;
+	uint64_t zipfRank(Xoshiro256& rng);
+public:
+	KeyChooser(KeyDistribution dist, uint64_t count, double theta = 0.99, double hotData = 0.2, double hotOps = 0.8);
+	uint64_t next(Xoshiro256& rng);
+	void grow(uint64_t count);
+	uint64_t count();
+};
+
+// ---------------------------------------------------------------------------
+// Engines
+// ---------------------------------------------------------------------------
+
+// What a workload or a comparison test needs from a table, keyed by sin.
+// One adapter per engine; a new engine only needs a new subclass (and a
+// name in makeEngine and a line in forEachEngine). The adapters are final,
+// so code templated on the concrete adapter calls them without virtual
+// dispatch.
+class WorkloadEngine
+{
+public:
+	virtual ~WorkloadEngine()
+	{
+	}
+	virtual const char* name() = 0;
+	virtual void insert(const EmployeeInfo& empl) = 0;
+	virtual bool read(int sin) = 0;
+	// Replaces the record with empl's sin; false if there is none.
+	virtual bool update(const EmployeeInfo& empl) = 0;
+	virtual void remove(int sin) = 0;
+	// Visits up to count records in key order from the first sin >= start;
+	// returns how many there were.
+	virtual int scan(int start, int count) = 0;
+	// The smallest and largest sin; false if the table is empty.
+	virtual bool bounds(int& lo, int& hi) = 0;
+	// Bytes the table's own allocations hold right now, as counted by its
+	// MemoryAccount (malloc's overhead not included).
+	virtual long liveBytes() = 0;
+	// Empties the table and frees what it held.
+	virtual void clear() = 0;
+};
+
+// AVL, WAVL and SplayTree: node-based trees with the AVL interface. Scans
+// walk the nodes iteratively (a splay tree can be as deep as it is big).
+template <class Tree>
+class TreeEngine final : public WorkloadEngine
+{
+	MemoryAccount memory;
+	Tree tree;
+	const char* label;
+	vector<node*> path;
+	long sink;	// what scans read, so they are not optimized away
+public:
+	explicit TreeEngine(const char* label) : tree(&memory), label(label), sink(0)
+	{
+	}
+
+	~TreeEngine()
+	{
+		clear();
+	}
+
+	const char* name()
+	{
+		return label;
+	}
+
+	void insert(const EmployeeInfo& empl)
+	{
+		tree.insert(empl);
+	}
+
+	bool read(int sin)
+	{
+		return tree.Find(tree.GetRoot(), sin) != NULL;
+	}
+
+	// The trees have no in-place update: Find may hand out a copy (small
+	// trees, snapshots), and a write through it would also bypass the log
+	// and a running checkpoint. So an update is a remove and an insert.
+	bool update(const EmployeeInfo& empl)
+	{
+		if (tree.Find(tree.GetRoot(), empl.sin) == NULL)
+			return false;
+		tree.remove(empl.sin);
+		tree.insert(empl);
+		return true;
+	}
+
+	void remove(int sin)
+	{
+		tree.remove(sin);
+	}
+
+	int scan(int start, int count)
+	{
+		// path holds the nodes >= start whose right subtrees are still to
+		// be visited, smallest on top
+		path.clear();
+		for (node* t = tree.GetRoot(); t != NULL;)
+			if (t->empl.sin < start)
+				t = t->right;
+			else
+			{
+				path.push_back(t);
+				t = t->left;
+			}
+		int visited = 0;
+		long checksum = 0;
+		while (visited < count && !path.empty())
+		{
+			node* t = path.back();
+			path.pop_back();
+			checksum += t->empl.salary;
+			visited++;
+			for (t = t->right; t != NULL; t = t->left)
+				path.push_back(t);
+		}
+		sink += checksum;
+		return visited;
+	}
+
+	bool bounds(int& lo, int& hi)
+	{
+		node* root = tree.GetRoot();
+		if (root == NULL)
+			return false;
+		lo = tree.findMin(root)->empl.sin;
+		hi = tree.findMax(root)->empl.sin;
+		return true;
+	}
+
+	long liveBytes()
+	{
+		return memory.bytes();
+	}
+
+	void clear()
+	{
+		tree.makeEmpty(tree.GetRoot());
+		vector<node*>().swap(path);
+	}
+};
+
+// The standard containers behind the other engines, counting what they
+// allocate.
+typedef map<int, EmployeeInfo, less<int>, CountingAllocator<pair<const int, EmployeeInfo> > > CountedMap;
+typedef unordered_map<int, EmployeeInfo, hash<int>, equal_to<int>, CountingAllocator<pair<const int, EmployeeInfo> > >
+	CountedHashMap;
+typedef vector<EmployeeInfo, CountingAllocator<EmployeeInfo> > CountedVector;
+
+class MapEngine final : public WorkloadEngine
+{
+	MemoryAccount memory;
+	CountedMap records;
+	long sink;	// what scans read, so they are not optimized away
+public:
+	MapEngine();
+	const char* name();
+	void insert(const EmployeeInfo& empl);
+	bool read(int sin);
+	bool update(const EmployeeInfo& empl);
+	void remove(int sin);
+	int scan(int start, int count);
+	bool bounds(int& lo, int& hi);
+	long liveBytes();
+	void clear();
+};
+
+// Hash table: constant-time point operations, but no key order, so scan()
+// and bounds() look at every record.
+class UnorderedMapEngine final : public WorkloadEngine
+{
+	MemoryAccount memory;
+	CountedHashMap records;
+	vector<int> keys;	// scan's scratch space
+	long sink;	// what scans read, so they are not optimized away
+public:
+	UnorderedMapEngine();
+	const char* name();
+	void insert(const EmployeeInfo& empl);
+	bool read(int sin);
+	bool update(const EmployeeInfo& empl);
+	void remove(int sin);
+	int scan(int start, int count);
+	bool bounds(int& lo, int& hi);
+	long liveBytes();
+	void clear();
+};
+
+// One sorted array searched by bisection: the most compact layout and fast
+// lookups, but an insert or remove moves every record behind it.
+class SortedVectorEngine final : public WorkloadEngine
+{
+	MemoryAccount memory;
+	CountedVector records;
+	long sink;	// what scans read, so they are not optimized away
+	CountedVector::iterator position(int sin);
+public:
+	SortedVectorEngine();
+	const char* name();
+	void insert(const EmployeeInfo& empl);
+	bool read(int sin);
+	bool update(const EmployeeInfo& empl);
+	void remove(int sin);
+	int scan(int start, int count);
+	bool bounds(int& lo, int& hi);
+	long liveBytes();
+	void clear();
+};
+
+// avl, wavl, splay, map, unordered_map or sorted_vector; NULL for any other
+// name.
+WorkloadEngine* makeEngine(const string& name);
+
+// Calls f(engine) with a new, empty engine of each kind the comparison
+// tests cover: AVL, std::map, std::unordered_map and a sorted std::vector.
+// f gets the concrete adapter (pass a generic lambda), so one templated
+// body serves them all.
+template <class F>
+void forEachEngine(F f)
+{
+	{
+		TreeEngine<AVL> engine("avl");
+		f(engine);
+	}
+	{
+		MapEngine engine;
+		f(engine);
+	}
+	{
+		UnorderedMapEngine engine;
+		f(engine);
+	}
+	{
+		SortedVectorEngine engine;
+		f(engine);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Workloads
+// ---------------------------------------------------------------------------
+
+enum WorkloadOp {
+	OP_READ,
+	OP_UPDATE,
+	OP_INSERT,
+	OP_SCAN,
+	OP_READ_MODIFY_WRITE,
+	OP_REMOVE,
+	OP_TYPES
+};
+
+const char* opName(WorkloadOp op);
+
+// A table of records sin 0..records-1 (loaded in random order), then
+// operations drawn from the mix. Proportions need not add up to 1. Inserts
+// add the next sin after the largest so far; the other operations pick
+// their sin from dist over the records inserted so far (removed ones
+// included, so reads after removes can miss).
+typedef struct WorkloadSpec {
+	long records;
+	long operations;
+	double mix[OP_TYPES];	// relative frequency of each WorkloadOp
+	KeyDistribution dist;
+	double theta;	// Zipf exponent
+	double hotData;	// hotspot: fraction of the records that are hot
+	double hotOps;	// hotspot: fraction of the operations that go to them
+	int maxScan;	// scans visit 1..maxScan records (uniform)
+	uint64_t seed;
+}WorkloadSpec;
+
+// 100k records, 100k reads, Zipfian with theta 0.99 (YCSB's constant).
+void workloadDefaults(WorkloadSpec& spec);
+
+// Sets the mix and distribution of YCSB core workload A-F (records,
+// operations and seed are left alone):
+//   A  50% read, 50% update, Zipfian        (session store)
+//   B  95% read, 5% update, Zipfian         (photo tagging)
+//   C  100% read, Zipfian                   (profile cache)
+//   D  95% read, 5% insert, latest          (status updates)
+//   E  95% scan, 5% insert, Zipfian         (threaded conversations)
+//   F  50% read, 50% read-modify-write, Zipfian
+// Returns false for any other letter.
+bool ycsbWorkload(char letter, WorkloadSpec& spec);
+
+// Per operation type: how many ran, how many found their record (scans:
+// found at least one), the time spent in them and their latencies.
+typedef struct OpStats {
+	uint64_t count;
+	uint64_t hits;
+	double seconds;
+	LatencyHistogram latency;
+}OpStats;
+
+// About 210 KB (six histograms): allocate it statically or on the heap.
+typedef struct WorkloadResult {
+	double seconds;	// the whole run phase
+	uint64_t operations;
+	OpStats ops[OP_TYPES];
+}WorkloadResult;
+
+// Inserts the spec's records into engine (which should be empty).
+void loadWorkload(const WorkloadSpec& spec, WorkloadEngine& engine);
+
+// Runs the spec's operations on a loaded engine, timing each one.
+void runWorkload(const WorkloadSpec& spec, WorkloadEngine& engine, WorkloadResult& result);
+
+// One line per operation type that ran: count, hit rate, throughput and
+// latency percentiles.
+void printWorkload(ostream& out, const string& label, const WorkloadResult& result);
+
+#endif // WORKLOAD_H
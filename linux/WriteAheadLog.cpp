@@ -0,0 +1,195 @@
+#include <WriteAheadLog.h>
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+static const size_t LOG_HEADER = 1 + 8;	// op, lsn
+static const size_t LOG_CRC = 4;
+
+static size_t logPayload(int op)
+{
+	return op == LOG_INSERT ? sizeof(EmployeeInfo) : sizeof(int);
+}
+
+// ---------------------------------------------------------------------------
+// LogReader
+// ---------------------------------------------------------------------------
+
+LogReader::LogReader()
+{
+	end = 0;
+}
+
+bool LogReader::open(const char *file)
+{
+	in.open(file, ios::binary);
+	end = 0;
+	return in.is_open();
+}
+
+bool LogReader::next(LogEntry &e)
+{
+	char buf[LOG_HEADER + sizeof(EmployeeInfo) + LOG_CRC];
+	if (!in.read(buf, LOG_HEADER))
+		return false;
+	if (buf[0] != LOG_INSERT && buf[0] != LOG_REMOVE)
+		return false;
+	size_t body = logPayload(buf[0]);
+	if (!in.read(buf + LOG_HEADER, body + LOG_CRC))
+		return false;
+	uint32_t crc;
+	memcpy(&crc, buf + LOG_HEADER + body, LOG_CRC);
+	if (crc != crc32c(0, buf, LOG_HEADER + body))
+		return false;
+
+	e.op = (LogOp)buf[0];
+	memcpy(&e.lsn, buf + 1, 8);
+	memset(&e.empl, 0, sizeof(e.empl));
+	if (e.op == LOG_INSERT)
+		memcpy(&e.empl, buf + LOG_HEADER, sizeof(EmployeeInfo));
+	else
+		memcpy(&e.empl.sin, buf + LOG_HEADER, sizeof(int));
+	end += LOG_HEADER + body + LOG_CRC;
+	return true;
+}
+
+uint64_t LogReader::validEnd()
+{
+	return end;
+}
+
+// ---------------------------------------------------------------------------
+// WriteAheadLog
+// ---------------------------------------------------------------------------
+
+WriteAheadLog::WriteAheadLog()
+{
+	fd = -1;
+	nextLsn = 1;
+	durableLsn = 0;
+	syncing = false;
+	failed = false;
+	windowMicros = 0;
+	syncs = 0;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+	close();
+}
+
+bool WriteAheadLog::open(const char *file)
+{
+	close();
+	LogReader reader;
+	LogEntry e;
+	uint64_t last = 0;
+	if (reader.open(file))
+		while (reader.next(e))
+			last = e.lsn;
+	fd = ::open(file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, reader.validEnd()) != 0)
+	{
+		close();
+		return false;
+	}
+	nextLsn = last + 1;
+	durableLsn = last;
+	failed = false;
+	return true;
+}
+
+void WriteAheadLog::close()
+{
+	if (fd < 0)
+		return;
+	commit(lastLsn());
+	::close(fd);
+	fd = -1;
+	pending.clear();
+}
+
+uint64_t WriteAheadLog::append(LogOp op, const EmployeeInfo &empl)
+{
+	char buf[LOG_HEADER + sizeof(EmployeeInfo) + LOG_CRC];
+	size_t body = logPayload(op);
+	unique_lock<mutex> guard(lock);
+	uint64_t lsn = nextLsn++;
+	buf[0] = (char)op;
+	memcpy(buf + 1, &lsn, 8);
+	if (op == LOG_INSERT)
+		memcpy(buf + LOG_HEADER, &empl, sizeof(EmployeeInfo));
+	else
+		memcpy(buf + LOG_HEADER, &empl.sin, sizeof(int));
+	uint32_t crc = crc32c(0, buf, LOG_HEADER + body);
+	memcpy(buf + LOG_HEADER + body, &crc, LOG_CRC);
+	pending.append(buf, LOG_HEADER + body + LOG_CRC);
+	return lsn;
+}
+
+bool WriteAheadLog::commit(uint64_t lsn)
+{
+	unique_lock<mutex> guard(lock);
+	while (durableLsn < lsn && !failed)
+	{
+		if (syncing)
+		{
+			synced.wait(guard);
+			continue;
+		}
+		// Become the leader for the next batch
+		syncing = true;
+		if (windowMicros > 0)
+		{
+			guard.unlock();
+			this_thread::sleep_for(chrono::microseconds(windowMicros));
+			guard.lock();
+		}
+		string batch;
+		batch.swap(pending);
+		uint64_t batchLsn = nextLsn - 1;
+		guard.unlock();
+
+		bool ok = true;
+		for (size_t done = 0; ok && done < batch.size();)
+		{
+			ssize_t n = write(fd, batch.data() + done, batch.size() - done);
+			ok = n > 0;
+			done += n > 0 ? n : 0;
+		}
+		ok = ok && fdatasync(fd) == 0;
+
+		guard.lock();
+		syncs++;
+		if (ok)
+			durableLsn = batchLsn;
+		else
+			failed = true;
+		syncing = false;
+		synced.notify_all();
+	}
+	return durableLsn >= lsn;
+}
+
+void WriteAheadLog::setGroupCommit(unsigned micros)
+{
+	unique_lock<mutex> guard(lock);
+	windowMicros = micros;
+}
+
+uint64_t WriteAheadLog::lastLsn()
+{
+	unique_lock<mutex> guard(lock);
+	return nextLsn - 1;
+}
+
+unsigned long WriteAheadLog::syncCount()
+{
+	unique_lock<mutex> guard(lock);
+	return syncs;
+}
@@ -0,0 +1,85 @@
+// WriteAheadLog.h - Header file for the write-ahead log
+
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include "AVLTree.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+// On-disk entry: op (1 byte), lsn (8 bytes), the record (16 bytes) for an
+// insert or just the sin (4 bytes) for a remove, then the CRC32C of all of
+// that (4 bytes). Fields are in host byte order. LSNs start at 1 and grow
+// by one per entry.
+enum LogOp {
+	LOG_INSERT = 1,
+	LOG_REMOVE = 2
+};
+
+typedef struct LogEntry {
+	uint64_t lsn;
+	LogOp op;
+	EmployeeInfo empl;	// only empl.sin is meaningful for LOG_REMOVE
+}LogEntry;
+
+// Reads a log front to back. next() stops at the end of the file or at the
+// first torn or corrupt entry, whichever comes first; validEnd() is the file
+// offset just past the last good entry.
+class LogReader
+{
+	ifstream in;
+	uint64_t end;
+public:
+	LogReader();
+	bool open(const char* file);
+	bool next(LogEntry& e);
+	uint64_t validEnd();
+};
+
+// Append-only log of inserts and removes, shared by any number of writer
+// threads. append() only buffers the entry; commit(lsn) blocks until the
+// entry is on disk. One committing thread at a time becomes the leader:
+// it waits out the group-commit window, then writes everything appended so
+// far with a single write and fdatasync, and every thread whose entry was in
+// that batch returns. Threads that commit while a sync is running form the
+// next batch, so even with no window concurrent writers share syncs.
+class WriteAheadLog
+{
+	int fd;
+	mutex lock;
+	condition_variable synced;
+	string pending;	// appended entries not yet handed to a sync
+	uint64_t nextLsn;
+	uint64_t durableLsn;	// every entry up to here is on disk
+	bool syncing;	// a leader is writing and syncing a batch
+	bool failed;	// a write or sync failed; nothing more becomes durable
+	unsigned windowMicros;
+	unsigned long syncs;
+public:
+	WriteAheadLog();
+	~WriteAheadLog();
+
+	// Opens (or creates) file for appending. A torn or corrupt tail left by
+	// a crash is cut off, and LSNs continue after the last good entry.
+	// Returns false if the file cannot be opened.
+	bool open(const char* file);
+	void close();
+
+	// Buffers an entry and returns its LSN. Thread safe.
+	uint64_t append(LogOp op, const EmployeeInfo& empl);
+
+	// Blocks until the entry with this LSN (and all before it) is durable.
+	// Returns false if writing or syncing failed. Thread safe.
+	bool commit(uint64_t lsn);
+
+	// How long a leader collects further entries before syncing; 0 syncs
+	// as soon as the previous sync finishes.
+	void setGroupCommit(unsigned micros);
+
+	uint64_t lastLsn();	// LSN of the last entry appended
+	unsigned long syncCount();	// fdatasync calls so far
+};
+
+#endif // WRITE_AHEAD_LOG_H
@@ -10,6 +10,6 @@ if [ ! -x "./avlTree" ]; then
 fi
 
 echo "Running the AVL test suite..."
-./avlTree
+./avlTree "$@"
 
 echo "Test suite execution finished."
@@ -1,4 +1,11 @@
 #include "timer.h"
+
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TIMER_HAVE_TSC 1
+#endif
 /*
   start();  starts the clock running from the current time
   currtime();  returns the current time
@@ -8,6 +15,8 @@
 
 Timer::Timer() {
 	elapsedTime_ = 0;
+	elapsedNs_ = 0;
+	intervals_ = 0;
 	isstop_ = true;
 
 #if PLATFORM == WINDOWS
@@ -29,6 +38,8 @@ void Timer::reset() {
 	stoptime_ = starttime_;
 #endif
 	elapsedTime_ = 0;
+	elapsedNs_ = 0;
+	intervals_ = 0;
 	isstop_ = true;
 }
 void Timer::start() {
@@ -52,6 +63,8 @@ void Timer::start() {
 		clock_gettime(CLOCK_MONOTONIC_RAW, &starttime_);
 		stoptime_ = starttime_;
 		elapsedTime_ = 0;
+		elapsedNs_ = 0;
+		intervals_ = 0;
 	}
 #endif
 
@@ -63,7 +76,10 @@ void Timer::stop() {
 	clock_gettime(CLOCK_MONOTONIC_RAW, &stoptime_);
 	elapsedTime_ += (stoptime_.tv_nsec - starttime_.tv_nsec) / 1000000000.0 +
 		(stoptime_.tv_sec - starttime_.tv_sec);
+	elapsedNs_ += (int64_t)(stoptime_.tv_sec - starttime_.tv_sec) * 1000000000 +
+		(stoptime_.tv_nsec - starttime_.tv_nsec);
 #endif
+	intervals_++;
 	isstop_ = true;
 }
 double Timer::currtime() {
@@ -91,4 +107,202 @@ double Timer::starttime() {
 #else
 	return starttime_.tv_nsec / 1000000000.0 + starttime_.tv_sec;
 #endif
-}
\ No newline at end of file
+}
+int64_t Timer::elapsedNs() {
+#if PLATFORM == WINDOWS
+	int64_t ns = (int64_t)(currtime() * 1e9);
+#else
+	int64_t ns = elapsedNs_;
+#endif
+	ns -= (int64_t)(intervals_ * timerOverheadNs());
+	return ns < 0 ? 0 : ns;
+}
+
+// ---------------------------------------------------------------------------
+// Clock source
+// ---------------------------------------------------------------------------
+
+// The clock ticks() reads and what its ticks are worth. Changed only by
+// useTsc(), which is meant to be called before timing threads start.
+static bool tscOn = false;
+static double nsPerTick = 1;
+
+static uint64_t clockNs() {
+#if PLATFORM == WINDOWS
+	return (uint64_t)(clock() * (1e9 / CLOCKS_PER_SEC));
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+uint64_t Timer::ticks() {
+#ifdef TIMER_HAVE_TSC
+	if (tscOn)
+		return __rdtsc();
+#endif
+	return clockNs();
+}
+
+// The smallest of many back-to-back differences: the part of every
+// measurement that is the clock itself. Taking the minimum never subtracts
+// more than a measurement cost.
+static double measureOverhead(uint64_t (*read)(), double scale) {
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 10000; i++) {
+		uint64_t a = read();
+		uint64_t b = read();
+		best = std::min(best, b - a);
+	}
+	return best * scale;
+}
+
+// Measured once at startup (and by useTsc()), so timing threads only ever
+// read them. A start()/stop() pair costs what a pair of system clock
+// readings does.
+static double tickOverheadNs = measureOverhead(Timer::ticks, 1);
+static double startStopOverheadNs = measureOverhead(clockNs, 1);
+
+double Timer::overheadNs() {
+	return tickOverheadNs;
+}
+
+double Timer::timerOverheadNs() {
+	return startStopOverheadNs;
+}
+
+int64_t Timer::ticksToNs(uint64_t ticks) {
+	double ns = ticks * nsPerTick - overheadNs();
+	return ns < 0 ? 0 : (int64_t)(ns + 0.5);
+}
+
+bool Timer::useTsc(bool on) {
+	if (!on) {
+		tscOn = false;
+		nsPerTick = 1;
+		tickOverheadNs = measureOverhead(Timer::ticks, nsPerTick);
+		return true;
+	}
+#ifdef TIMER_HAVE_TSC
+	// CPUID 0x80000007 EDX bit 8: the TSC runs at a constant rate in every
+	// P- and C-state, so it can stand in for a clock
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8)))
+		return false;
+	// Count TSC ticks over 20 ms of the system clock
+	uint64_t ns0 = clockNs(), tsc0 = __rdtsc();
+	uint64_t ns1, tsc1;
+	do {
+		ns1 = clockNs();
+		tsc1 = __rdtsc();
+	} while (ns1 - ns0 < 20000000);
+	if (tsc1 <= tsc0)
+		return false;
+	nsPerTick = (double)(ns1 - ns0) / (tsc1 - tsc0);
+	tscOn = true;
+	tickOverheadNs = measureOverhead(Timer::ticks, nsPerTick);
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Timer::usingTsc() {
+	return tscOn;
+}
+
+// ---------------------------------------------------------------------------
+// LatencyHistogram
+// ---------------------------------------------------------------------------
+
+// Bucket of a sample: values below LINEAR are their own bucket; above that,
+// each power of two [2^e, 2^(e+1)) is split into 2^SUB_BITS equal buckets
+// by the SUB_BITS bits after the leading one.
+int LatencyHistogram::bucketOf(int64_t ns) {
+	if (ns < LINEAR)
+		return (int)ns;
+	uint64_t v = (uint64_t)ns;
+#if defined(__GNUC__)
+	int e = 63 - __builtin_clzll(v);
+#else
+	int e = 0;
+	while (v >> (e + 1))
+		e++;
+#endif
+	if (e >= MAX_EXPONENT)
+		return BUCKETS - 1;
+	int sub = (int)(v >> (e - SUB_BITS)) - (1 << SUB_BITS);
+	return LINEAR + (e - SUB_BITS - 1) * (1 << SUB_BITS) + sub;
+}
+
+// The middle of the range of values a bucket counts.
+int64_t LatencyHistogram::valueOf(int bucket) {
+	if (bucket < LINEAR)
+		return bucket;
+	int group = (bucket - LINEAR) >> SUB_BITS;
+	int sub = (bucket - LINEAR) & ((1 << SUB_BITS) - 1);
+	int shift = group + 1;
+	int64_t low = (int64_t)((1 << SUB_BITS) + sub) << shift;
+	return low + ((int64_t)1 << shift) / 2;
+}
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+void LatencyHistogram::reset() {
+	std::fill(counts_, counts_ + BUCKETS, 0);
+	total_ = 0;
+	min_ = INT64_MAX;
+	max_ = 0;
+	sum_ = 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+	for (int i = 0; i < BUCKETS; i++)
+		counts_[i] += other.counts_[i];
+	total_ += other.total_;
+	sum_ += other.sum_;
+	min_ = std::min(min_, other.min_);
+	max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::count() const {
+	return total_;
+}
+
+int64_t LatencyHistogram::min() const {
+	return total_ ? min_ : 0;
+}
+
+int64_t LatencyHistogram::max() const {
+	return max_;
+}
+
+double LatencyHistogram::mean() const {
+	return total_ ? sum_ / total_ : 0;
+}
+
+int64_t LatencyHistogram::percentile(double q) const {
+	if (total_ == 0)
+		return 0;
+	if (q >= 1)
+		return max_;
+	uint64_t rank = (uint64_t)(q * total_) + 1;	// the rank-th smallest sample
+	if (rank > total_)
+		rank = total_;
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKETS; i++) {
+		seen += counts_[i];
+		if (seen >= rank)
+			return std::max(min_, std::min(max_, valueOf(i)));
+	}
+	return max_;
+}
+
+void LatencyHistogram::print(std::ostream& out, const char* label) const {
+	out << label << ": " << total_ << " samples, min " << min() << ", p50 " << percentile(0.5) << ", p90 "
+		<< percentile(0.9) << ", p99 " << percentile(0.99) << ", p99.9 " << percentile(0.999) << ", p99.99 "
+		<< percentile(0.9999) << ", max " << max() << " ns\n";
+}